@@ -0,0 +1,425 @@
+/*
+ * pcap replay benchmark
+ *
+ * Classifies every IPv4/IPv6 packet in a pcap file against the
+ * rules in a text file, then reports the throughput, latency
+ * percentiles, and the match/unmatch split.
+ *
+ *   usage: pcapBench [-n repeat] rule-file pcap-file
+ *
+ * Rule file: one rule per line in the format of range2str()
+ * ('#' starts a comment.) Each field can be a range, a single
+ * value, or '*', and addresses can be prefixes, e.g.,
+ *
+ *   10.0.0.0/8, *, *, 80, 6, *
+ *   2001:db8::/32, 2001:db8:1::1-2001:db8:1::ff, 1024-65535, 53, 17, 0
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "rtacl.hpp"
+#include "cbProf.hpp"
+
+using bfmt = boost::format;
+
+/*
+ * pcap file format
+ */
+enum {
+    pcapMagicUsec = 0xa1b2c3d4, // microsecond time stamps
+    pcapMagicNsec = 0xa1b23c4d, // nanosecond time stamps
+
+    linkNull      = 0,          // BSD loopback
+    linkEthernet  = 1,
+    linkRaw       = 101,        // raw IPv4/IPv6
+    linkLinuxSll  = 113,        // Linux cooked capture
+    linkIPv4      = 228,
+    linkIPv6      = 229,
+
+    etherTypeIPv4 = 0x0800,
+    etherTypeIPv6 = 0x86dd,
+    etherTypeVlan = 0x8100,
+    etherTypeQinQ = 0x88a8,
+};
+
+struct pcapHdr {
+    u32 magic;
+    u16 major;
+    u16 minor;
+    s32 thisZone;
+    u32 sigFigs;
+    u32 snapLen;
+    u32 linkType;
+};
+
+struct pcapRecHdr {
+    u32 tsSec;
+    u32 tsFrac;
+    u32 inclLen;
+    u32 origLen;
+};
+
+/**
+ * @name  pkt
+ * @brief IPv4/IPv6 packet in the memory-mapped pcap file
+ */
+struct pkt {
+    const u8* l3;               // IP header
+    u32       len;              // captured bytes from \e l3
+    u8        ipVer;            // 4 or 6
+};
+
+/**
+ * @name  swap32
+ * @brief Converts a 32-bit pcap header field to the host byte order
+ */
+static inline u32
+swap32 (u32 v, bool swapped)
+{
+    return swapped ? __builtin_bswap32(v) : v;
+}
+
+/**
+ * @name  l3offset
+ * @brief Returns the offset to the IP header in a frame
+ *
+ * @param[in]  linkType pcap link type
+ * @param[in]  p        Pointer to the frame
+ * @param[in]  len      Captured length of the frame
+ * @param[out] ipVer    4 or 6
+ *
+ * @retval >=0 Offset to the IP header
+ * @retval -1  Not an IPv4/IPv6 packet
+ */
+static int
+l3offset (u32 linkType, const u8* p, u32 len, u8& ipVer)
+{
+    u32 off;
+    u16 type;
+
+    switch (linkType) {
+    case linkEthernet:
+        off = 12;
+        if (len < off + 2) {
+            return -1;
+        }
+        type = rtacl::pktRd16(p + off);
+        while (type == etherTypeVlan || type == etherTypeQinQ) {
+            off += 4;
+            if (len < off + 2) {
+                return -1;
+            }
+            type = rtacl::pktRd16(p + off);
+        }
+        off += 2;
+        break;
+    case linkLinuxSll:
+        off = 14;
+        if (len < off + 2) {
+            return -1;
+        }
+        type = rtacl::pktRd16(p + off);
+        off += 2;
+        break;
+    case linkNull:
+        off = 4;
+        type = 0;
+        break;
+    case linkRaw:
+    case linkIPv4:
+    case linkIPv6:
+        off = 0;
+        type = 0;
+        break;
+    default:
+        return -1;
+    }
+    if (len <= off) {
+        return -1;
+    }
+    ipVer = p[off] >> 4;
+    if ((type == etherTypeIPv4 && ipVer != 4) ||
+        (type == etherTypeIPv6 && ipVer != 6) ||
+        (type != 0 && type != etherTypeIPv4 && type != etherTypeIPv6) ||
+        (ipVer != 4 && ipVer != 6)) {
+        return -1;
+    }
+    return off;
+}
+
+/**
+ * @name  loadPcap
+ * @brief Memory-maps a pcap file and makes the list of IPv4/IPv6
+ *        packets in it
+ *
+ * @param[in]  path  pcap file name
+ * @param[out] pkts  IPv4/IPv6 packets
+ * @param[out] nSkip Number of non-IP (or truncated) frames
+ *
+ * @retval true  Success
+ * @retval false Failed to open/map the file or not a pcap file
+ */
+static bool
+loadPcap (const char* path, std::vector<pkt>& pkts, size_t& nSkip)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(pcapHdr)) {
+        fprintf(stderr, "%s: not a pcap file\n", path);
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    madvise(map, size, MADV_WILLNEED);
+    /*
+     * The mapping is kept until the process exits
+     */
+    const u8* base = static_cast<const u8*>(map);
+    pcapHdr hdr;
+    memcpy(&hdr, base, sizeof(hdr));
+    bool swapped;
+    if (hdr.magic == pcapMagicUsec || hdr.magic == pcapMagicNsec) {
+        swapped = false;
+    } else if (__builtin_bswap32(hdr.magic) == pcapMagicUsec ||
+               __builtin_bswap32(hdr.magic) == pcapMagicNsec) {
+        swapped = true;
+    } else {
+        fprintf(stderr, "%s: not a pcap file (magic: 0x%08x)\n",
+                path, hdr.magic);
+        return false;
+    }
+    u32 linkType = swap32(hdr.linkType, swapped);
+
+    size_t off = sizeof(hdr);
+    nSkip = 0;
+    while (off + sizeof(pcapRecHdr) <= size) {
+        pcapRecHdr rec;
+        memcpy(&rec, base + off, sizeof(rec));
+        u32 len = swap32(rec.inclLen, swapped);
+        off += sizeof(rec);
+        if (off + len > size) {
+            break;              // truncated file
+        }
+        pkt p;
+        int l3 = l3offset(linkType, base + off, len, p.ipVer);
+        if (l3 < 0) {
+            ++nSkip;
+        } else {
+            p.l3  = base + off + l3;
+            p.len = len - l3;
+            pkts.push_back(p);
+        }
+        off += len;
+    }
+    return true;
+}
+
+/**
+ * @name  loadRules
+ * @brief Reads the rule file and inserts the rules into the ACLs.
+ *        The payload of each R-tree entry is the line number.
+ *
+ * @param[in]  path Rule file name
+ * @param[out] acl4 IPv4 ACL
+ * @param[out] acl6 IPv6 ACL
+ *
+ * @retval true  Success
+ * @retval false Failed to open the file or malformed rule
+ */
+static bool
+loadRules (const char* path,
+           rtacl::db<rtacl::ipv4a>& acl4,
+           rtacl::db<rtacl::ipv6a>& acl6)
+{
+    std::ifstream in(path);
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    std::string line;
+    uintptr_t n = 0;
+    while (std::getline(in, line)) {
+        ++n;
+        std::string::size_type c = line.find('#');
+        if (c != std::string::npos) {
+            line.erase(c);
+        }
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        bool rc;
+        if (line.find(':') != std::string::npos) {
+            rtacl::entry<rtacl::ipv6a> e;
+            rc = rtacl::str2range(line, e.first);
+            e.second = n;
+            if (rc) {
+                acl6.insert(e);
+            }
+        } else {
+            rtacl::entry<rtacl::ipv4a> e;
+            rc = rtacl::str2range(line, e.first);
+            e.second = n;
+            if (rc) {
+                acl4.insert(e);
+            }
+        }
+        if (!rc) {
+            fprintf(stderr, "%s:%lu: malformed rule: %s\n",
+                    path, (unsigned long)n, line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @name  classify
+ * @brief Classifies a packet
+ *
+ * @retval  1 Matched
+ * @retval  0 Unmatched
+ * @retval -1 Malformed packet
+ */
+static inline int
+classify (rtacl::db<rtacl::ipv4a>& acl4,
+          rtacl::db<rtacl::ipv6a>& acl6,
+          const pkt& p)
+{
+    if (p.ipVer == 4) {
+        rtacl::tuple<rtacl::ipv4a> key;
+        if (!acl4.makeKey(p.l3, p.len, key)) {
+            return -1;
+        }
+        return acl4.find(key).empty() ? 0 : 1;
+    }
+    rtacl::tuple<rtacl::ipv6a> key;
+    if (!acl6.makeKey(p.l3, p.len, key)) {
+        return -1;
+    }
+    return acl6.find(key).empty() ? 0 : 1;
+}
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr, "usage: %s [-n repeat] rule-file pcap-file\n", prog);
+    exit(1);
+}
+
+int
+main (int argc, char *argv[])
+{
+    size_t repeat = 1;
+    int c;
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+        case 'n':
+            repeat = strtoul(optarg, NULL, 0);
+            if (repeat == 0) {
+                usage(argv[0]);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+    }
+
+    rtacl::db<rtacl::ipv4a> acl4;
+    rtacl::db<rtacl::ipv6a> acl6;
+    cbProf::timePoint t0 = cbProf::hrclock::now();
+    if (!loadRules(argv[optind], acl4, acl6)) {
+        return 1;
+    }
+    cbProf::nsec dt = cbProf::hrclock::now() - t0;
+    std::cout << (bfmt("rules: %ld (IPv4: %ld, IPv6: %ld), "
+                       "loaded in %.2f ms\n")
+                  % (acl4.size() + acl6.size())
+                  % acl4.size()
+                  % acl6.size()
+                  % (dt.count() / 1e6)).str();
+
+    std::vector<pkt> pkts;
+    size_t nSkip;
+    if (!loadPcap(argv[optind + 1], pkts, nSkip)) {
+        return 1;
+    }
+    size_t nv4 = std::count_if(pkts.begin(), pkts.end(),
+                               [](const pkt& p) { return p.ipVer == 4; });
+    std::cout << (bfmt("packets: %ld (IPv4: %ld, IPv6: %ld), "
+                       "non-IP: %ld\n")
+                  % pkts.size() % nv4 % (pkts.size() - nv4) % nSkip).str();
+    if (pkts.empty()) {
+        return 0;
+    }
+
+    /*
+     * Throughput (no per-packet time stamps)
+     */
+    size_t nMatch = 0;
+    size_t nUnmatch = 0;
+    size_t nBad = 0;
+    size_t r;
+    t0 = cbProf::hrclock::now();
+    for (r = 0; r < repeat; ++r) {
+        for (const pkt& p : pkts) {
+            switch (classify(acl4, acl6, p)) {
+            case 1:  ++nMatch;   break;
+            case 0:  ++nUnmatch; break;
+            default: ++nBad;     break;
+            }
+        }
+    }
+    dt = cbProf::hrclock::now() - t0;
+    size_t total = repeat * pkts.size();
+    std::cout << (bfmt("throughput: %.3f Mpps (%ld packets in %.2f ms)\n")
+                  % (total * 1e3 / dt.count())
+                  % total
+                  % (dt.count() / 1e6)).str();
+    std::cout << (bfmt("match: %ld (%.2f%%), unmatch: %ld (%.2f%%), "
+                       "malformed: %ld\n")
+                  % nMatch % (nMatch * 100.0 / total)
+                  % nUnmatch % (nUnmatch * 100.0 / total)
+                  % nBad).str();
+
+    /*
+     * Latency
+     */
+    std::vector<u32> lat;
+    lat.reserve(total);
+    for (r = 0; r < repeat; ++r) {
+        for (const pkt& p : pkts) {
+            cbProf::timePoint b = cbProf::hrclock::now();
+            classify(acl4, acl6, p);
+            cbProf::nsec d = cbProf::hrclock::now() - b;
+            lat.push_back(static_cast<u32>(d.count()));
+        }
+    }
+    std::sort(lat.begin(), lat.end());
+    static const double pct[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+    std::cout << "latency:";
+    for (double p : pct) {
+        size_t i = static_cast<size_t>(p / 100.0 * (lat.size() - 1));
+        std::cout << (bfmt(" p%g: %d ns,") % p % lat[i]).str();
+    }
+    std::cout << (bfmt(" max: %d ns\n") % lat.back()).str();
+
+    return 0;
+}
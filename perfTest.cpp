@@ -1,6 +1,15 @@
+#include <chrono>
 #include <random>
 
 #include "rtacl.hpp"
+#include "rtaclAsync.hpp"
+#include "rtaclBv.hpp"
+#include "rtaclDefer.hpp"
+#include "rtaclEpoch.hpp"
+#include "rtaclNuma.hpp"
+#include "rtaclPart.hpp"
+#include "rtaclPool.hpp"
+#include "rtaclRfc.hpp"
 #include "cbProf.hpp"
 
 using bfmt = boost::format;
@@ -42,11 +51,2034 @@ showSockItem (rtacl::sockItem<SADDR>& i)
     std::cout << (bfmt("sockItem: %s\n") % i.str()).str();
 }
 
+/**
+ * @name  pktBench
+ * @brief Per-packet cost of making search keys from raw IPv4/IPv6
+ *        headers compared with the \e sockaddr based path
+ */
+static void
+pktBench ()
+{
+    enum {
+        nPkts  = 4096,          // number of distinct packets
+        nCalls = 1000000,
+        pktLen = 64,
+    };
+    static u8 v4[nPkts][pktLen];
+    static u8 v6[nPkts][pktLen];
+    cbProf::prof prof[6];
+    size_t i;
+
+    prof[0].setBanner("v4 sockaddr: ");
+    prof[1].setBanner("v4 raw key: ");
+    prof[2].setBanner("v4 classify: ");
+    prof[3].setBanner("v6 sockaddr: ");
+    prof[4].setBanner("v6 raw key: ");
+    prof[5].setBanner("v6 classify: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    /*
+     * IPv4/TCP and IPv6 (hop-by-hop options)/TCP packets
+     * to 80/tcp from random sources
+     */
+    std::mt19937 mt(time(NULL));
+    memset(v4, 0, sizeof(v4));
+    memset(v6, 0, sizeof(v6));
+    for (i = 0; i < nPkts; ++i) {
+        u32 sa = htonl(0x0a000000 | (mt() & 0xffffff));
+        u16 sp = htons(1024 + (mt() & 0x7fff));
+        u16 dp = htons(80);
+        u32 da = htonl(0xc0a80001);
+
+        v4[i][0] = 0x45;
+        v4[i][9] = IPPROTO_TCP;
+        memcpy(&v4[i][12], &sa, sizeof(sa));
+        memcpy(&v4[i][16], &da, sizeof(da));
+        memcpy(&v4[i][20], &sp, sizeof(sp));
+        memcpy(&v4[i][22], &dp, sizeof(dp));
+
+        v6[i][0] = 0x60;
+        v6[i][6] = IPPROTO_HOPOPTS;
+        v6[i][8] = 0x20;
+        v6[i][9] = 0x01;
+        memcpy(&v6[i][20], &sa, sizeof(sa));
+        v6[i][24] = 0x20;
+        v6[i][25] = 0x01;
+        memcpy(&v6[i][36], &da, sizeof(da));
+        v6[i][40] = IPPROTO_TCP;
+        memcpy(&v6[i][48], &sp, sizeof(sp));
+        memcpy(&v6[i][50], &dp, sizeof(dp));
+    }
+
+    /*
+     * ACL: 10.0.0.0/8 -> any:80/tcp (and the IPv6 equivalent)
+     */
+    rtacl::db<rtacl::ipv4a> acl4;
+    rtacl::entry<rtacl::ipv4a> e4;
+    acl4.makeMin(0x0a000000, 0, 0, 80, 6, 0,
+                 e4.first.min_corner());
+    acl4.makeMax(0x0affffff, 0xffffffff, 0xffff, 80, 6, 0xff,
+                 e4.first.max_corner());
+    e4.second = 1;
+    acl4.insert(e4);
+    rtacl::db<rtacl::ipv6a> acl6;
+    rtacl::entry<rtacl::ipv6a> e6;
+    rtacl::ipv6a net = rtacl::ipv6a(0x2001) << 112;
+    acl6.makeMin(net, net, 0, 80, 6, 0, e6.first.min_corner());
+    acl6.makeMax(net + ((rtacl::ipv6a(1) << 112) - 1),
+                 net + ((rtacl::ipv6a(1) << 112) - 1),
+                 0xffff, 80, 6, 0xff, e6.first.max_corner());
+    e6.second = 1;
+    acl6.insert(e6);
+
+    rtacl::sockItem<sockaddr_in>  sKey4;
+    rtacl::sockItem<sockaddr_in6> sKey6;
+    sockaddr_in  si4[2];
+    sockaddr_in6 si6[2];
+    memset(si4, 0, sizeof(si4));
+    memset(si6, 0, sizeof(si6));
+    si4[0].sin_family = si4[1].sin_family = AF_INET;
+    si6[0].sin6_family = si6[1].sin6_family = AF_INET6;
+    rtacl::tuple<rtacl::ipv4a> k4;
+    rtacl::tuple<rtacl::ipv6a> k6;
+    size_t nMatch = 0;
+
+    for (i = 0; i < nCalls; ++i) {
+        const u8* p = v4[i % nPkts];
+        prof[0].begin();
+        memcpy(&si4[0].sin_addr, p + 12, sizeof(in_addr));
+        memcpy(&si4[1].sin_addr, p + 16, sizeof(in_addr));
+        memcpy(&si4[0].sin_port, p + 20, sizeof(u16));
+        memcpy(&si4[1].sin_port, p + 22, sizeof(u16));
+        sKey4.set(si4[0], si4[1], p[9], p[1] >> 2);
+        acl4.makeKey(sKey4.getSrc(), sKey4.getDst(),
+                     sKey4.getProto(), sKey4.getDSCP(), k4);
+        prof[0].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        prof[1].begin();
+        acl4.makeKey(v4[i % nPkts], pktLen, k4);
+        prof[1].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        prof[2].begin();
+        rtacl::result<rtacl::ipv4a> r = acl4.classifyPacket(v4[i % nPkts],
+                                                            pktLen);
+        prof[2].end();
+        nMatch += r.size();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const u8* p = v6[i % nPkts];
+        prof[3].begin();
+        memcpy(&si6[0].sin6_addr, p + 8, sizeof(in6_addr));
+        memcpy(&si6[1].sin6_addr, p + 24, sizeof(in6_addr));
+        memcpy(&si6[0].sin6_port, p + 48, sizeof(u16));
+        memcpy(&si6[1].sin6_port, p + 50, sizeof(u16));
+        sKey6.set(si6[0], si6[1], p[40], 0);
+        acl6.makeKey(sKey6.getSrc(), sKey6.getDst(),
+                     sKey6.getProto(), sKey6.getDSCP(), k6);
+        prof[3].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        prof[4].begin();
+        acl6.makeKey(v6[i % nPkts], pktLen, k6);
+        prof[4].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        prof[5].begin();
+        rtacl::result<rtacl::ipv6a> r = acl6.classifyPacket(v6[i % nPkts],
+                                                            pktLen);
+        prof[5].end();
+        nMatch += r.size();
+    }
+    if (nMatch != 2 * nCalls) {
+        std::cout << (bfmt("Error: %ld matches (expected %ld)\n")
+                      % nMatch % (2 * nCalls)).str();
+    }
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  sin6a2intBytewise
+ * @brief Reference byte-by-byte IPv6 address conversion
+ *        (the implementation prior to \e rtacl::in6a2int())
+ */
+static s256
+sin6a2intBytewise (const sockaddr_in6& sin6)
+{
+    s256 addr = 0;
+    size_t i;
+    for (i = 0; i < elementsof(sin6.sin6_addr.s6_addr) - 1; ++i) {
+        addr |= sin6.sin6_addr.s6_addr[i];
+        addr <<= 8;
+    }
+    addr |= sin6.sin6_addr.s6_addr[i];
+    return addr;
+}
+
+/**
+ * @name  keyBench
+ * @brief Cost of making search keys from \e sockaddr_in and
+ *        \e sockaddr_in6
+ */
+static void
+keyBench ()
+{
+    enum {
+        nAddrs = 4096,
+        nCalls = 1000000,
+    };
+    static sockaddr_in  si4[nAddrs];
+    static sockaddr_in6 si6[nAddrs];
+    cbProf::prof prof[4];
+    size_t i, j;
+
+    prof[0].setBanner("v4 makeKey: ");
+    prof[1].setBanner("v6 bytewise: ");
+    prof[2].setBanner("v6 sin6a2int: ");
+    prof[3].setBanner("v6 makeKey: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    std::mt19937 mt(time(NULL));
+    memset(si4, 0, sizeof(si4));
+    memset(si6, 0, sizeof(si6));
+    for (i = 0; i < nAddrs; ++i) {
+        si4[i].sin_family = AF_INET;
+        si4[i].sin_addr.s_addr = mt();
+        si4[i].sin_port = mt();
+        si6[i].sin6_family = AF_INET6;
+        for (j = 0; j < sizeof(si6[i].sin6_addr.s6_addr); ++j) {
+            si6[i].sin6_addr.s6_addr[j] = mt();
+        }
+        si6[i].sin6_port = mt();
+    }
+
+    rtacl::db<rtacl::ipv4a> acl4;
+    rtacl::db<rtacl::ipv6a> acl6;
+    rtacl::tuple<rtacl::ipv4a> k4;
+    rtacl::tuple<rtacl::ipv6a> k6;
+    s256 sum = 0;
+    for (i = 0; i < nCalls; ++i) {
+        const sockaddr_in& sa = si4[i % nAddrs];
+        const sockaddr_in& da = si4[(i + 1) % nAddrs];
+        prof[0].begin();
+        acl4.makeKey(sa, da, 6, 0, k4);
+        prof[0].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const sockaddr_in6& sa = si6[i % nAddrs];
+        const sockaddr_in6& da = si6[(i + 1) % nAddrs];
+        prof[1].begin();
+        s256 a = sin6a2intBytewise(sa);
+        s256 b = sin6a2intBytewise(da);
+        prof[1].end();
+        sum += (a ^ b) & 1;
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const sockaddr_in6& sa = si6[i % nAddrs];
+        const sockaddr_in6& da = si6[(i + 1) % nAddrs];
+        prof[2].begin();
+        s256 a = rtacl::sin6a2int<s256>(sa);
+        s256 b = rtacl::sin6a2int<s256>(da);
+        prof[2].end();
+        sum += (a ^ b) & 1;
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const sockaddr_in6& sa = si6[i % nAddrs];
+        const sockaddr_in6& da = si6[(i + 1) % nAddrs];
+        prof[3].begin();
+        acl6.makeKey(sa, da, 6, 0, k6);
+        prof[3].end();
+    }
+    std::cout << (bfmt("(checksum: %s)\n") % sum).str();
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  numaBench
+ * @brief Placement of the replicas (pages not on their nodes) and
+ *        the lookup cost of the NUMA node local replica compared
+ *        with the remote ones
+ *        A reader thread runs on each node in turn and searches the
+ *        replica of every node.
+ */
+static void
+numaBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        nCalls = 1000000,
+    };
+    const rtacl::numa::topology& topo = rtacl::numa::topology::get();
+    rtacl::numaDb<rtacl::ipv4a> acl;
+    rtacl::db<rtacl::ipv4a>& m = acl.getMaster();
+    rtacl::entry<rtacl::ipv4a> e;
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    std::vector<u32> sa(nKeys), da(nKeys);
+    std::mt19937 mt(time(NULL));
+    size_t i;
+
+    /*
+     * Random /24 -> /24 rules to 1024-65535/tcp
+     */
+    for (i = 0; i < nRules; ++i) {
+        u32 s = mt() & 0xffffff00;
+        u32 d = mt() & 0xffffff00;
+        m.makeMin(s, d, 0, 1024, 6, 0, e.first.min_corner());
+        m.makeMax(s | 0xff, d | 0xff, 0xffff, 0xffff, 6, 0xff,
+                  e.first.max_corner());
+        e.second = i;
+        m.insert(e);
+        if (i < nKeys) {
+            sa[i] = s;
+            da[i] = d;
+        }
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    acl.commit();
+    auto t1 = std::chrono::steady_clock::now();
+    std::cout << (bfmt("%u rules, %u node(s)%s, commit: %.1f ms, "
+                       "misplaced pages: %u\n")
+                  % nRules % acl.nodes()
+                  % (topo.available() ? "" : " (no NUMA support)")
+                  % (std::chrono::duration<double, std::milli>(t1 - t0)
+                     .count()) % acl.misplaced()).str();
+    /*
+     * Half of the keys hit a rule
+     */
+    for (i = 0; i < nKeys; ++i) {
+        if (i & 1) {
+            m.makeKey(sa[i] | 1, da[i] | 1, mt() & 0xffff,
+                      1024 + (mt() & 0x7fff), 6, 0, keys[i]);
+        } else {
+            m.makeKey(mt(), mt(), mt() & 0xffff, 1024 + (mt() & 0x7fff),
+                      6, 0, keys[i]);
+        }
+    }
+
+    for (size_t rd = 0; rd < acl.nodes(); ++rd) {
+        for (size_t rp = 0; rp < acl.nodes(); ++rp) {
+            double ns = 0;
+            size_t hits = 0;
+            std::thread th([&]() {
+                    topo.runOnNode(rd);
+                    auto b = std::chrono::steady_clock::now();
+                    for (size_t j = 0; j < nCalls; ++j) {
+                        hits += acl.find(keys[j % nKeys], rp).size();
+                    }
+                    auto f = std::chrono::steady_clock::now();
+                    ns = std::chrono::duration<double, std::nano>(f - b)
+                        .count() / nCalls;
+                });
+            th.join();
+            std::cout << (bfmt("reader node %u, replica node %u (%s): "
+                               "%.1f ns/lookup (hits: %u)\n")
+                          % rd % rp % ((rd == rp) ? "local" : "remote")
+                          % ns % hits).str();
+        }
+    }
+}
+
+/**
+ * @name  countBench
+ * @brief Overhead of the per-rule hit counters at 1 and N threads
+ *        All the keys hit the same (popular) rule.
+ */
+static void
+countBench ()
+{
+    enum {
+        nRules = 1000,
+        nKeys  = 4096,
+        nCalls = 1000000,       // per thread
+    };
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::entry<rtacl::ipv4a> e;
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    std::mt19937 mt(time(NULL));
+    size_t i;
+
+    for (i = 0; i < nRules; ++i) {
+        u32 s = mt() & 0xffffff00;
+        acl.makeMin(s, 0, 0, 0, 17, 0, e.first.min_corner());
+        acl.makeMax(s | 0xff, 0xffffffff, 0xffff, 0xffff, 17, 0xff,
+                    e.first.max_corner());
+        e.second = i;
+        acl.insert(e);
+    }
+    acl.makeMin(0x0a000000, 0, 0, 80, 6, 0, e.first.min_corner());
+    acl.makeMax(0x0affffff, 0xffffffff, 0xffff, 80, 6, 0xff,
+                e.first.max_corner());
+    e.second = nRules;
+    acl.insert(e);
+    for (i = 0; i < nKeys; ++i) {
+        acl.makeKey(0x0a000000 | (mt() & 0xffffff), mt(),
+                    1024 + (mt() & 0x7fff), 80, 6, 0, keys[i]);
+    }
+
+    size_t nThreads = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t n : { (size_t)1, nThreads }) {
+        for (bool count : { false, true }) {
+            acl.enableCounters(count);
+            std::vector<std::thread> th;
+            auto b = std::chrono::steady_clock::now();
+            for (i = 0; i < n; ++i) {
+                th.push_back(std::thread([&]() {
+                            size_t hits = 0;
+                            for (size_t j = 0; j < nCalls; ++j) {
+                                hits += acl.find(keys[j % nKeys], 64).size();
+                            }
+                            assert(hits == nCalls);
+                        }));
+            }
+            for (auto& t : th) {
+                t.join();
+            }
+            auto f = std::chrono::steady_clock::now();
+            double sec = std::chrono::duration<double>(f - b).count();
+            std::cout << (bfmt("%u thread(s), counters %s: "
+                               "%.2f Mlookups/s")
+                          % n % (count ? "on " : "off")
+                          % (n * nCalls / sec / 1e6)).str();
+            if (count) {
+                std::cout << (bfmt(" (popular rule: %u packets)")
+                              % acl.stats(nRules).packets).str();
+            }
+            std::cout << "\n";
+        }
+    }
+}
+
+/**
+ * @name  makeNestedAcl
+ * @brief Makes a rule set where each key matches many overlapping
+ *        rules: /16, /17, ..., /32 nested in each of \b nNets /16
+ *        networks (every key matches 17 rules)
+ *
+ * @param[out] acl   R-tree ACL
+ * @param[out] keys  Search keys (matching)
+ * @param[in]  nNets Number of /16 networks
+ */
+static void
+makeNestedAcl (rtacl::db<rtacl::ipv4a>& acl,
+               std::vector<rtacl::tuple<rtacl::ipv4a> >& keys,
+               size_t nNets)
+{
+    rtacl::entry<rtacl::ipv4a> e;
+    std::mt19937 mt(time(NULL));
+    std::vector<u32> nets(nNets);
+    size_t i, len;
+
+    for (i = 0; i < nNets; ++i) {
+        nets[i] = mt() & 0xffff0000;
+        for (len = 16; len <= 32; ++len) {
+            u32 mask = (len == 32) ? 0xffffffff : ~(0xffffffff >> len);
+            acl.makeMin(nets[i], 0, 0, 0, 6, 0, e.first.min_corner());
+            acl.makeMax(nets[i] | ~mask, 0xffffffff, 0xffff, 0xffff, 6,
+                        0xff, e.first.max_corner());
+            e.second = i * 32 + len;
+            acl.insert(e);
+        }
+    }
+    for (i = 0; i < keys.size(); ++i) {
+        acl.makeKey(nets[mt() % nNets], mt(), mt() & 0xffff, 80, 6, 0,
+                    keys[i]);
+    }
+}
+
+/**
+ * @name  queryBench
+ * @brief Cost of getting the first match (or the first k matches)
+ *        with the lazy search compared with \e find() on a rule set
+ *        where each key matches many overlapping rules
+ */
+static void
+queryBench ()
+{
+    enum {
+        nNets  = 1000,          // number of /16 networks
+        nKeys  = 4096,
+        nCalls = 100000,
+        k      = 4,
+    };
+    rtacl::db<rtacl::ipv4a> acl;
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    cbProf::prof prof[3];
+    size_t i, j;
+
+    prof[0].setBanner("find(): ");
+    prof[1].setBanner("first match: ");
+    prof[2].setBanner((bfmt("first %d matches: ") % k).str());
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    makeNestedAcl(acl, keys, nNets);
+
+    size_t sum[3] = { 0, 0, 0 };
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[0].begin();
+        rtacl::result<rtacl::ipv4a> r = acl.find(key);
+        prof[0].end();
+        sum[0] += r.size();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[1].begin();
+        auto it = acl.qbegin(key);
+        if (it != acl.qend()) {
+            sum[1] += it->second & 1;
+        }
+        prof[1].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[2].begin();
+        j = 0;
+        for (auto it = acl.qbegin(key); it != acl.qend() && j < k; ++it) {
+            ++j;
+        }
+        prof[2].end();
+        sum[2] += j;
+    }
+    std::cout << (bfmt("%u rules, %u matches/key "
+                       "(checksum: %u %u %u)\n")
+                  % acl.size() % (sum[0] / nCalls)
+                  % sum[0] % sum[1] % sum[2]).str();
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  anyBench
+ * @brief Cost of \e matchesAny() and \e countMatches() compared
+ *        with \e find() on a rule set where each key matches many
+ *        overlapping rules
+ */
+static void
+anyBench ()
+{
+    enum {
+        nNets  = 1000,          // number of /16 networks
+        nKeys  = 4096,
+        nCalls = 100000,
+    };
+    rtacl::db<rtacl::ipv4a> acl;
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    cbProf::prof prof[3];
+    size_t i;
+
+    prof[0].setBanner("find(): ");
+    prof[1].setBanner("matchesAny(): ");
+    prof[2].setBanner("countMatches(): ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+    makeNestedAcl(acl, keys, nNets);
+
+    size_t sum[3] = { 0, 0, 0 };
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[0].begin();
+        bool hit = !acl.find(key).empty();
+        prof[0].end();
+        sum[0] += hit;
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[1].begin();
+        bool hit = acl.matchesAny(key);
+        prof[1].end();
+        sum[1] += hit;
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[2].begin();
+        size_t n = acl.countMatches(key);
+        prof[2].end();
+        sum[2] += n;
+    }
+    std::cout << (bfmt("%u rules (checksum: %u %u %u)\n")
+                  % acl.size() % sum[0] % sum[1] % sum[2]).str();
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/*
+ * Inline payload used by payloadBench()
+ */
+struct inlineRule {
+    u32 id;
+    u16 priority;
+    u8  action;
+    bool operator== (const inlineRule& r) const {
+        return id == r.id && priority == r.priority && action == r.action;
+    };
+};
+
+/**
+ * @name  payloadBench
+ * @brief Cost of resolving the highest priority match with the
+ *        payload inline in the R-tree leaf compared with a pointer
+ *        to \e rtacl::sockEnt<SADDR>
+ */
+static void
+payloadBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        nCalls = 100000,
+    };
+    rtacl::db<rtacl::ipv4a> accPtr;
+    rtacl::db<rtacl::ipv4a, inlineRule> accInl;
+    rtacl::entry<rtacl::ipv4a> ep;
+    rtacl::entry<rtacl::ipv4a, inlineRule> ei;
+    std::vector<std::unique_ptr<rtacl::sockEnt<sockaddr_in> > > ents;
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    std::mt19937 mt(time(NULL));
+    cbProf::prof prof[2];
+    size_t i;
+
+    prof[0].setBanner("pointer: ");
+    prof[1].setBanner("inline: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    /*
+     * Random /20 -> any rules from 10.0.0.0/8: a key matches
+     * about 24 rules. The sockEnt objects are allocated in random
+     * order to the rules like a long running process.
+     */
+    for (i = 0; i < nRules; ++i) {
+        ents.emplace_back(new rtacl::sockEnt<sockaddr_in>);
+    }
+    std::shuffle(ents.begin(), ents.end(), mt);
+    for (i = 0; i < nRules; ++i) {
+        u32 s = 0x0a000000 | (mt() & 0x00fff000);
+        u16 pri = mt() & 0xffff;
+        accPtr.makeMin(s, 0, 0, 0, 6, 0, ep.first.min_corner());
+        accPtr.makeMax(s | 0xfff, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                       ep.first.max_corner());
+        ents[i]->setPriority(pri);
+        ep.second = reinterpret_cast<uintptr_t>(ents[i].get());
+        accPtr.insert(ep);
+        ei.first = ep.first;
+        ei.second = { static_cast<u32>(i), pri, 0 };
+        accInl.insert(ei);
+    }
+    for (i = 0; i < nKeys; ++i) {
+        accPtr.makeKey(0x0a000000 | (mt() & 0x00ffffff), mt(), mt() & 0xffff,
+                       80, 6, 0, keys[i]);
+    }
+
+    u64 sum[2] = { 0, 0 };
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[0].begin();
+        u32 best = 0;
+        for (auto& m : accPtr.matches(key)) {
+            rtacl::sockEnt<sockaddr_in>* p =
+                reinterpret_cast<rtacl::sockEnt<sockaddr_in>*>(m.second);
+            best = std::max(best, p->getPriority());
+        }
+        prof[0].end();
+        sum[0] += best;
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[1].begin();
+        u32 best = 0;
+        for (auto& m : accInl.matches(key)) {
+            best = std::max(best, static_cast<u32>(m.second.priority));
+        }
+        prof[1].end();
+        sum[1] += best;
+    }
+    std::cout << (bfmt("%u rules (checksum: %u %u)\n")
+                  % nRules % sum[0] % sum[1]).str();
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  allocRun
+ * @brief Inserts \b nRules rules to \b acl and looks them up
+ *        (used by allocBench())
+ *
+ * @param DB \e rtacl::db<rtacl::ipv4a, uintptr_t, rtacl::dim, ALLOC>
+ *
+ * @param[in] banner Banner of the results
+ * @param[in] acl    R-tree ACL (empty)
+ * @param[in] nRules Number of rules
+ */
+template <class DB>
+static void
+allocRun (const std::string& banner, DB& acl, size_t nRules)
+{
+    enum {
+        nCalls = 1000000,
+    };
+    rtacl::entry<rtacl::ipv4a> e;
+    rtacl::tuple<rtacl::ipv4a> key;
+    cbProf::prof prof[2];
+    std::mt19937 mt(1);
+    size_t i, hits = 0;
+
+    prof[0].setBanner(banner + " insert: ");
+    prof[1].setBanner(banner + " match: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    /*
+     * Same rules as the default test: 10.0.0.0 + i * 0x20 + [0, 10]
+     */
+    for (i = 0; i < nRules; ++i) {
+        ipv4a sa = 0x0a000000 + (i * 0x20);
+        acl.makeMin(sa, 0, 0, 0, 6, 0, e.first.min_corner());
+        acl.makeMax(sa + 10, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                    e.first.max_corner());
+        e.second = i;
+        prof[0].begin();
+        acl.insert(e);
+        prof[0].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        ipv4a sa = 0x0a000000 + ((mt() % nRules) * 0x20) + 2;
+        acl.makeKey(sa, 0x12345678, 0x1234, 80, 6, 0, key);
+        prof[1].begin();
+        hits += acl.countMatches(key);
+        prof[1].end();
+    }
+    assert(hits == nCalls);
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  allocBench
+ * @brief Insertion and lookup cost at 1M rules with
+ *        \e std::allocator and \e rtacl::poolAllocator (with and
+ *        without huge pages)
+ */
+static void
+allocBench ()
+{
+    enum {
+        nRules = 1000000,
+    };
+    typedef rtacl::poolAllocator<rtacl::entry<rtacl::ipv4a> > pool;
+
+    {
+        rtacl::db<rtacl::ipv4a> acl;
+        allocRun("std::allocator", acl, nRules);
+    }
+    for (bool huge : { false, true }) {
+        pool a(0, huge);
+        rtacl::db<rtacl::ipv4a, uintptr_t, rtacl::dim, pool> acl(a);
+        allocRun(huge ? "pool (2MB pages)" : "pool (4KB pages)",
+                 acl, nRules);
+        std::cout << (bfmt("reserved: %u MB, MAP_HUGETLB chunks: %u\n\n")
+                      % (a.getArena().reserved() >> 20)
+                      % a.getArena().hugeTlbChunks()).str();
+    }
+}
+
+/**
+ * @name  memRun
+ * @brief Inserts rules to an IPv4 or IPv6 R-tree ACL until it has
+ *        1K, 100K and 1M rules and shows the memory usage
+ *        (used by memBench())
+ *
+ * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] banner Banner of the results
+ * @param[in] base   Base address of the rules
+ * @param[in] shift  The i-th rule is (\b base + (i << \b shift)) +
+ *                   [0, 10]
+ */
+template <class ADDR>
+static void
+memRun (const char* banner, const ADDR base, size_t shift)
+{
+    typedef rtacl::countingAllocator<rtacl::entry<ADDR> > alloc;
+    const size_t sizes[] = { 1000, 100000, 1000000 };
+    alloc a;
+    rtacl::db<ADDR, uintptr_t, rtacl::dim, alloc> acl(a);
+    rtacl::entry<ADDR> e;
+    size_t i = 0, j;
+
+    for (j = 0; j < elementsof(sizes); ++j) {
+        for (; i < sizes[j]; ++i) {
+            ADDR sa = base + (ADDR(i) << shift);
+            acl.makeMin(sa, 0, 0, 0, 6, 0, e.first.min_corner());
+            acl.makeMax(sa + 10, base - 1, 0xffff, 0xffff, 6, 0xff,
+                        e.first.max_corner());
+            e.second = i;
+            acl.insert(e);
+        }
+        rtacl::memUsage m = acl.memoryUsage();
+        std::cout << (bfmt("%s %7u rules: %.1f bytes/rule "
+                           "(internal %.1f, leaf boxes %.1f, payload %.1f, "
+                           "slack %.1f), %u levels, %u bytes/node\n")
+                      % banner % m.rules % m.bytesPerRule()
+                      % (double(m.internalBytes) / m.rules)
+                      % (double(m.leafBytes) / m.rules)
+                      % (double(m.payloadBytes) / m.rules)
+                      % (double(m.slackBytes) / m.rules)
+                      % m.levels % m.nodeSize).str();
+    }
+}
+
+/**
+ * @name  memBench
+ * @brief Memory footprint (bytes/rule) at 1K, 100K, and 1M rules
+ */
+static void
+memBench ()
+{
+    memRun<rtacl::ipv4a>("IPv4", 0x0a000000, 5);
+    memRun<rtacl::ipv6a>("IPv6", rtacl::ipv6a(0x20010db8) << 96, 64);
+}
+
+/**
+ * @name  dimRun
+ * @brief Inserts \b nRules rules to an R-tree ACL of \b N fields
+ *        and looks them up (used by dimBench())
+ *
+ * @param N Number of the fields (dimensions)
+ *
+ * @param[in] nRules Number of rules
+ */
+template <size_t N>
+static void
+dimRun (size_t nRules)
+{
+    enum {
+        nCalls = 1000000,
+    };
+    rtacl::db<rtacl::ipv4a, uintptr_t, N> acl;
+    rtacl::entry<rtacl::ipv4a, uintptr_t, N> e;
+    rtacl::tuple<rtacl::ipv4a, N> key;
+    cbProf::prof prof[2];
+    std::mt19937 mt(1);
+    size_t i, hits = 0;
+
+    prof[0].setBanner((bfmt("%u-D insert: ") % N).str());
+    prof[1].setBanner((bfmt("%u-D match: ") % N).str());
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+    for (i = 0; i < nRules; ++i) {
+        ipv4a sa = 0x0a000000 + (i * 0x20);
+        acl.makeMin(sa, 0, 0, 0, 6, 0, e.first.min_corner());
+        acl.makeMax(sa + 10, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                    e.first.max_corner());
+        e.second = i;
+        prof[0].begin();
+        acl.insert(e);
+        prof[0].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        ipv4a sa = 0x0a000000 + ((mt() % nRules) * 0x20) + 2;
+        acl.makeKey(sa, 0x12345678, 0x1234, 80, 6, 0, key);
+        prof[1].begin();
+        hits += acl.countMatches(key);
+        prof[1].end();
+    }
+    assert(hits == nCalls);
+    rtacl::memUsage m = acl.memoryUsage();
+    std::cout << (bfmt("%u-D: %u bytes/node, %.1f bytes/rule, %u levels\n")
+                  % N % m.nodeSize % m.bytesPerRule() % m.levels).str();
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  dimBench
+ * @brief Insertion and lookup cost and memory footprint at 1M rules
+ *        with 6, 5 (5-tuple), and 2 (src/dst IP) fields
+ */
+static void
+dimBench ()
+{
+    enum {
+        nRules = 1000000,
+    };
+    dimRun<rtacl::dim>(nRules);
+    dimRun<rtacl::dim5Tuple>(nRules);
+    dimRun<rtacl::dimSrcDst>(nRules);
+}
+
+/**
+ * @name  makeMixedRules
+ * @brief Makes \b rules and the keys matching them: \b wildPct %
+ *        of the rules wildcard the ports, protocol, and DSCP
+ *        (src /24, dst /16), and the others are 5-tuple rules
+ *        (src /24, dst /24, a dst port, TCP or UDP)
+ *
+ * @param[out] rules   ACL rules
+ * @param[out] keys    Keys matching at least one rule each
+ * @param[in]  wildPct Percentage of the wildcard rules
+ */
+static void
+makeMixedRules (std::vector<rtacl::entry<rtacl::ipv4a> >& rules,
+                std::vector<rtacl::tuple<rtacl::ipv4a> >& keys,
+                u32 wildPct)
+{
+    static const u32 dports[] = { 22, 25, 53, 80, 123, 443, 993, 8080 };
+    rtacl::db<rtacl::ipv4a> acl;
+    std::mt19937 mt(1);
+    size_t i;
+
+    for (i = 0; i < rules.size(); ++i) {
+        rtacl::entry<rtacl::ipv4a>& e = rules[i];
+        ipv4a sa = 0x0a000000 | (mt() & 0x00ffff00);
+        if (mt() % 100 < wildPct) {
+            ipv4a da = mt() & 0xffff0000;
+            acl.makeMin(sa, da, 0, 0, 0, 0, e.first.min_corner());
+            acl.makeMax(sa + 0xff, da + 0xffff, 0xffff, 0xffff, 0xff, 0xff,
+                        e.first.max_corner());
+        } else {
+            ipv4a da = mt() & 0xffffff00;
+            ipv4a dp = dports[mt() % elementsof(dports)];
+            ipv4a proto = (mt() & 1) ? 6 : 17;
+            acl.makeMin(sa, da, 0, dp, proto, 0, e.first.min_corner());
+            acl.makeMax(sa + 0xff, da + 0xff, 0xffff, dp, proto, 0xff,
+                        e.first.max_corner());
+        }
+        e.second = i;
+    }
+    for (i = 0; i < keys.size(); ++i) {
+        const rtacl::range<rtacl::ipv4a>& r = rules[mt() % rules.size()].first;
+        acl.makeKey(r.min_corner().get<0>() + 1 + (mt() & 0xff),
+                    r.min_corner().get<1>() + 1 + (mt() & 0xff),
+                    mt() & 0xffff, r.min_corner().get<3>() + 1,
+                    r.min_corner().get<4>() + 1, 0, keys[i]);
+    }
+}
+
+/**
+ * @name  partBench
+ * @brief Lookup cost of \e rtacl::db and \e rtacl::partDb on a
+ *        rule set where 70% of the rules wildcard the ports,
+ *        protocol, and DSCP
+ */
+static void
+partBench ()
+{
+    enum {
+        nRules  = 100000,
+        nKeys   = 4096,
+        nCalls  = 1000000,
+        wildPct = 70,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > misses(nKeys);
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::partDb<rtacl::ipv4a, uintptr_t, std::less<uintptr_t> > part;
+    cbProf::prof prof[4];
+    size_t i, sum[4] = { 0, 0, 0, 0 };
+
+    prof[0].setBanner("db match: ");
+    prof[1].setBanner("partDb match: ");
+    prof[2].setBanner("db unmatch: ");
+    prof[3].setBanner("partDb unmatch: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    makeMixedRules(rules, keys, wildPct);
+    for (auto& e : rules) {
+        acl.insert(e);
+        part.insert(e);
+    }
+    for (i = 0; i < nKeys; ++i) {
+        misses[i] = keys[i];
+        misses[i].set<0>(keys[i].get<0>() + 0x01000000); // 11.0.0.0/8
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[0].begin();
+        sum[0] += acl.find(key).size();
+        prof[0].end();
+        prof[1].begin();
+        sum[1] += part.find(key).size();
+        prof[1].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = misses[i % nKeys];
+        prof[2].begin();
+        sum[2] += acl.find(key).size();
+        prof[2].end();
+        prof[3].begin();
+        sum[3] += part.find(key).size();
+        prof[3].end();
+    }
+    assert(sum[0] == sum[1] && sum[2] == 0 && sum[3] == 0);
+    std::cout << (bfmt("%u rules (%u%% wildcard), %u partitions, "
+                       "%.2f matches/key\n")
+                  % nRules % wildPct % part.partitions()
+                  % (double(sum[0]) / nCalls)).str();
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  tierBench
+ * @brief Lookup cost of \e rtacl::db and \e rtacl::tierDb on a
+ *        rule set of 1M host rules and 1K broad rules (a /16 to
+ *        0.0.0.0/0)
+ */
+static void
+tierBench ()
+{
+    enum {
+        nHosts = 1000000,
+        nBroad = 1000,
+        nKeys  = 4096,
+        nCalls = 1000000,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nHosts + nBroad);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > misses(nKeys);
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::tierDb<rtacl::ipv4a> tier;
+    cbProf::prof prof[4];
+    std::mt19937 mt(1);
+    size_t i, sum[4] = { 0, 0, 0, 0 };
+
+    prof[0].setBanner("db match: ");
+    prof[1].setBanner("tierDb match: ");
+    prof[2].setBanner("db unmatch: ");
+    prof[3].setBanner("tierDb unmatch: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    /*
+     * Host rules: 10.0.0.0/8 to 192.168.0.0/16, TCP port 80
+     * Broad rules: a /16 out of 10.0.0.0/8 to any
+     */
+    for (i = 0; i < rules.size(); ++i) {
+        rtacl::entry<rtacl::ipv4a>& e = rules[i];
+        if (i < nHosts) {
+            ipv4a sa = 0x0a000000 | (mt() & 0x00ffffff);
+            ipv4a da = 0xc0a80000 | (mt() & 0x0000ffff);
+            acl.makeMin(sa, da, 0, 80, 6, 0, e.first.min_corner());
+            acl.makeMax(sa, da, 0xffff, 80, 6, 0xff, e.first.max_corner());
+        } else {
+            ipv4a sa = mt() & 0xffff0000;
+            if ((sa >> 24) == 10) {
+                sa += 0x01000000;
+            }
+            acl.makeMin(sa, 0, 0, 0, 0, 0, e.first.min_corner());
+            acl.makeMax(sa + 0xffff, 0xffffffff, 0xffff, 0xffff, 0xff,
+                        0xff, e.first.max_corner());
+        }
+        e.second = i;
+    }
+    std::shuffle(rules.begin(), rules.end(), mt);
+    for (auto& e : rules) {
+        acl.insert(e);
+        tier.insert(e);
+    }
+    for (i = 0; i < nKeys; ++i) {
+        const rtacl::range<rtacl::ipv4a>* r;
+        do {
+            r = &rules[mt() % rules.size()].first;
+        } while (tier.tierOf(*r) == 0);
+        acl.makeKey(r->min_corner().get<0>() + 1,
+                    r->min_corner().get<1>() + 1, 1234, 80, 6, 0, keys[i]);
+        acl.makeKey(0x0a000000 | (mt() & 0x00ffffff),
+                    0xc0a80000 | (mt() & 0x0000ffff), 1234, 443, 6, 0,
+                    misses[i]);
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+        prof[0].begin();
+        sum[0] += acl.find(key).size();
+        prof[0].end();
+        prof[1].begin();
+        sum[1] += tier.find(key).size();
+        prof[1].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        const rtacl::tuple<rtacl::ipv4a>& key = misses[i % nKeys];
+        prof[2].begin();
+        sum[2] += acl.find(key).size();
+        prof[2].end();
+        prof[3].begin();
+        sum[3] += tier.find(key).size();
+        prof[3].end();
+    }
+    assert(sum[0] == sum[1] && sum[2] == sum[3]);
+    std::cout << (bfmt("%u rules, tiers: %u, %u, %u\n")
+                  % tier.size() % tier.tierSize(0) % tier.tierSize(1)
+                  % tier.tierSize(2)).str();
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  rfcBench
+ * @brief Build time, memory, and lookup cost of \e rtacl::rfc
+ *        and \e rtacl::db at 1K, 4K, and 16K rules (the rule set of
+ *        partBench())
+ */
+static void
+rfcBench ()
+{
+    enum {
+        nKeys      = 4096,
+        nCalls     = 1000000,
+        wildPct    = 70,
+        maxEntries = 1 << 27,
+    };
+    const size_t sizes[] = { 1000, 4000, 16000 };
+    size_t i, j;
+
+    for (j = 0; j < elementsof(sizes); ++j) {
+        std::vector<rtacl::entry<rtacl::ipv4a> > rules(sizes[j]);
+        std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+        rtacl::rfc<rtacl::ipv4a> engine;
+        cbProf::prof prof[3];
+        size_t sum[3] = { 0, 0, 0 };
+
+        makeMixedRules(rules, keys, wildPct);
+        auto t0 = std::chrono::steady_clock::now();
+        rtacl::db<rtacl::ipv4a> acl(rules.begin(), rules.end());
+        auto t1 = std::chrono::steady_clock::now();
+        bool built = engine.build(rules.begin(), rules.end(), maxEntries);
+        auto t2 = std::chrono::steady_clock::now();
+        std::cout << (bfmt("%u rules: db %.1f ms %.1f MB, ")
+                      % sizes[j]
+                      % std::chrono::duration<double, std::milli>(t1 - t0)
+                        .count()
+                      % (acl.memoryUsage().total / 1e6)).str();
+        if (!built) {
+            std::cout << "rfc: tables too large\n\n";
+            continue;
+        }
+        std::cout << (bfmt("rfc %.1f ms %.1f MB (%u sub-rules, "
+                           "%u table reads)\n")
+                      % std::chrono::duration<double, std::milli>(t2 - t1)
+                        .count()
+                      % (engine.memory() / 1e6) % engine.subRules()
+                      % engine.reads()).str();
+
+        prof[0].setBanner("db find: ");
+        prof[1].setBanner("rfc find: ");
+        prof[2].setBanner("rfc first: ");
+        for (i = 0; i < elementsof(prof); ++i) {
+            prof[i].run();
+        }
+        for (i = 0; i < nCalls; ++i) {
+            const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+            prof[0].begin();
+            sum[0] += acl.find(key).size();
+            prof[0].end();
+            prof[1].begin();
+            sum[1] += engine.find(key).size();
+            prof[1].end();
+            prof[2].begin();
+            sum[2] += (engine.first(key) != nullptr);
+            prof[2].end();
+        }
+        assert(sum[0] == sum[1] && sum[2] == nCalls);
+        for (i = 0; i < elementsof(prof); ++i) {
+            prof[i].makeHist();
+            std::cout << prof[i].str() << "\n";
+        }
+    }
+}
+
+/**
+ * @name  bvBench
+ * @brief Cost of the highest priority match by \e rtacl::db
+ *        (find() and the smallest payload), and \e rtacl::bv (BV
+ *        and ABV, with and without AVX2) at 256 to 32K rules (the
+ *        rule set of partBench())
+ */
+static void
+bvBench ()
+{
+    enum {
+        nKeys   = 4096,
+        nCalls  = 200000,
+        wildPct = 70,
+    };
+    const size_t sizes[] = { 256, 1024, 4096, 16384, 32768 };
+    size_t i, j;
+
+    for (j = 0; j < elementsof(sizes); ++j) {
+        std::vector<rtacl::entry<rtacl::ipv4a> > rules(sizes[j]);
+        std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+        rtacl::bv<rtacl::ipv4a> engine;
+        cbProf::prof prof[5];
+        size_t sum[5] = { 0, 0, 0, 0, 0 };
+
+        makeMixedRules(rules, keys, wildPct);
+        rtacl::db<rtacl::ipv4a> acl(rules.begin(), rules.end());
+        engine.build(rules.begin(), rules.end());
+        std::cout << (bfmt("%u rules: bv %.1f MB\n") % sizes[j]
+                      % (engine.memory() / 1e6)).str();
+
+        prof[0].setBanner("db: ");
+        prof[1].setBanner("BV: ");
+        prof[2].setBanner("BV (AVX2): ");
+        prof[3].setBanner("ABV: ");
+        prof[4].setBanner("ABV (AVX2): ");
+        for (i = 0; i < elementsof(prof); ++i) {
+            prof[i].run();
+        }
+        for (i = 0; i < nCalls; ++i) {
+            const rtacl::tuple<rtacl::ipv4a>& key = keys[i % nKeys];
+            prof[0].begin();
+            uintptr_t best = ~uintptr_t(0);
+            for (auto& m : acl.find(key)) {
+                best = std::min(best, m.second);
+            }
+            prof[0].end();
+            sum[0] += best;
+            engine.enableSimd(false);
+            prof[1].begin();
+            sum[1] += engine.firstLinear(key)->second;
+            prof[1].end();
+            prof[3].begin();
+            sum[3] += engine.first(key)->second;
+            prof[3].end();
+            if (engine.enableSimd(true)) {
+                prof[2].begin();
+                sum[2] += engine.firstLinear(key)->second;
+                prof[2].end();
+                prof[4].begin();
+                sum[4] += engine.first(key)->second;
+                prof[4].end();
+            } else {
+                sum[2] += best;
+                sum[4] += best;
+            }
+        }
+        assert(sum[0] == sum[1] && sum[0] == sum[2] && sum[0] == sum[3] &&
+               sum[0] == sum[4]);
+        for (i = 0; i < elementsof(prof); ++i) {
+            prof[i].makeHist();
+            std::cout << prof[i].str() << "\n";
+        }
+    }
+}
+
+/**
+ * @name  epochBench
+ * @brief Lookup cost of \e rtacl::db with a mutex and of
+ *        \e rtacl::epochDb, and the update cost of
+ *        \e rtacl::epochDb (100K rules)
+ */
+static void
+epochBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        nCalls = 1000000,
+        nOps   = 10000,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::epochDb<rtacl::ipv4a> eacl;
+    std::mutex m;
+    cbProf::prof prof[5];
+    size_t i, sum[3] = { 0, 0, 0 };
+
+    prof[0].setBanner("db: ");
+    prof[1].setBanner("db + mutex: ");
+    prof[2].setBanner("epochDb: ");
+    prof[3].setBanner("epochDb remove: ");
+    prof[4].setBanner("epochDb insert: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    makeMixedRules(rules, keys, 70);
+    for (auto& e : rules) {
+        acl.insert(e);
+        eacl.insert(e);
+    }
+    for (i = 0; i < nCalls; ++i) {
+        prof[0].begin();
+        sum[0] += acl.find(keys[i % nKeys]).size();
+        prof[0].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        prof[1].begin();
+        {
+            std::lock_guard<std::mutex> l(m);
+            sum[1] += acl.find(keys[i % nKeys]).size();
+        }
+        prof[1].end();
+    }
+    for (i = 0; i < nCalls; ++i) {
+        prof[2].begin();
+        sum[2] += eacl.find(keys[i % nKeys]).size();
+        prof[2].end();
+    }
+    assert(sum[0] == sum[1] && sum[0] == sum[2]);
+    for (i = 0; i < nOps; ++i) {
+        prof[3].begin();
+        eacl.remove(rules[i]);
+        prof[3].end();
+    }
+    for (i = 0; i < nOps; ++i) {
+        prof[4].begin();
+        eacl.insert(rules[i]);
+        prof[4].end();
+    }
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+}
+
+/**
+ * @name  asyncBench
+ * @brief Caller-side update cost of \e rtacl::epochDb and of
+ *        \e rtacl::asyncDb, and the time until \e rtacl::asyncDb
+ *        has applied the updates (100K rules)
+ */
+static void
+asyncBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        nOps   = 10000,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::epochDb<rtacl::ipv4a> eacl;
+    rtacl::asyncDb<rtacl::ipv4a> aacl(16384);
+    cbProf::prof prof[4];
+    size_t i;
+    u64 seq = 0;
+
+    prof[0].setBanner("epochDb remove: ");
+    prof[1].setBanner("epochDb insert: ");
+    prof[2].setBanner("asyncDb remove: ");
+    prof[3].setBanner("asyncDb insert: ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    makeMixedRules(rules, keys, 70);
+    for (auto& e : rules) {
+        eacl.insert(e);
+        seq = aacl.insert(e);
+    }
+    aacl.wait(seq);
+    for (i = 0; i < nOps; ++i) {
+        prof[0].begin();
+        eacl.remove(rules[i]);
+        prof[0].end();
+    }
+    for (i = 0; i < nOps; ++i) {
+        prof[1].begin();
+        eacl.insert(rules[i]);
+        prof[1].end();
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    for (i = 0; i < nOps; ++i) {
+        prof[2].begin();
+        aacl.remove(rules[i]);
+        prof[2].end();
+    }
+    for (i = 0; i < nOps; ++i) {
+        prof[3].begin();
+        seq = aacl.insert(rules[i]);
+        prof[3].end();
+    }
+    aacl.wait(seq);
+    auto t1 = std::chrono::steady_clock::now();
+    for (i = 0; i < nOps; ++i) {
+        aacl.insert(rules[i]);
+        seq = aacl.remove(rules[i]);
+    }
+    aacl.wait(seq);
+    auto t2 = std::chrono::steady_clock::now();
+    assert(aacl.size() == nRules && eacl.size() == nRules);
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+    std::cout << (bfmt("asyncDb: %u removes + %u inserts applied in %.1f ms, "
+                       "%u insert+remove pairs in %.1f ms "
+                       "(%u batches, %u updates coalesced)\n")
+                  % nOps % nOps
+                  % std::chrono::duration<double, std::milli>(t1 - t0).count()
+                  % nOps
+                  % std::chrono::duration<double, std::milli>(t2 - t1).count()
+                  % aacl.batches() % aacl.coalesced()).str();
+}
+
+/**
+ * @name  ttlBench
+ * @brief Cost of \e rtacl::db::tick() when 100K rules expire at
+ *        once: rate-limited and in one call
+ */
+static void
+ttlBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        budget = 256,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::db<rtacl::ipv4a> acl, acl1;
+    cbProf::prof prof[3];
+    size_t i, n = 0;
+    u64 now;
+
+    prof[0].setBanner("timed insert: ");
+    prof[1].setBanner("idle tick: ");
+    prof[2].setBanner("tick (256 removes): ");
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].run();
+    }
+
+    makeMixedRules(rules, keys, 70);
+    for (i = 0; i < nRules; ++i) {
+        rules[i].second = i;    // unique rule handles
+        prof[0].begin();
+        acl.insert(rules[i], 60000 + (i & 7));
+        prof[0].end();
+        acl1.insert(rules[i], 60000 + (i & 7));
+    }
+    for (now = 1; now < 60000; now += 10) {
+        prof[1].begin();
+        acl.tick(now, budget);
+        prof[1].end();
+    }
+    acl1.tick(now - 10);
+    for (now = 60000; acl.size(); ++now) {
+        prof[2].begin();
+        n += acl.tick(now, budget);
+        prof[2].end();
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    size_t n1 = acl1.tick(60010, size_t(-1));
+    auto t1 = std::chrono::steady_clock::now();
+    assert(n == nRules && n1 == nRules);
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+    std::cout << (bfmt("%u rules expired: %u ticks of up to %u removes, "
+                       "or one tick of %.1f ms\n")
+                  % nRules % (now - 60000) % budget
+                  % std::chrono::duration<double, std::milli>(t1 - t0)
+                  .count()).str();
+}
+
+/**
+ * @name  latencyStr
+ * @brief Returns the percentiles and the maximum of \b lat (ns)
+ */
+static std::string
+latencyStr (const char* banner, std::vector<u32>& lat)
+{
+    static const double pct[] = { 50.0, 99.0, 99.9 };
+    std::string s = banner;
+
+    std::sort(lat.begin(), lat.end());
+    for (double p : pct) {
+        size_t i = static_cast<size_t>(p / 100.0 * (lat.size() - 1));
+        s += (bfmt(" p%g: %d ns,") % p % lat[i]).str();
+    }
+    return s + (bfmt(" max: %d ns\n") % lat.back()).str();
+}
+
+/**
+ * @name  deferBench
+ * @brief Insert latency of \e rtacl::db and of \e rtacl::deferDb
+ *        (p50, p99, p99.9, and max) under a sustained load of one
+ *        insert every 10 us and in back-to-back bursts of 256 every
+ *        5 ms, and the lookup cost (100K rules)
+ */
+static void
+deferBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        nCalls = 1000000,
+        burst  = 256,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    std::vector<u32> lat;
+    cbProf::prof prof[2];
+    size_t i, sum[2] = { 0, 0 };
+
+    makeMixedRules(rules, keys, 70);
+    lat.reserve(nRules);
+    auto run = [&](const char* banner, size_t gap, size_t pauseUs,
+                   std::function<void(const rtacl::entry<rtacl::ipv4a>&)>
+                   insert) {
+        lat.clear();
+        for (size_t j = 0; j < nRules; ++j) {
+            cbProf::timePoint b = cbProf::hrclock::now();
+            insert(rules[j]);
+            cbProf::nsec d = cbProf::hrclock::now() - b;
+            lat.push_back(static_cast<u32>(d.count()));
+            if ((j + 1) % gap == 0) {
+                std::this_thread::sleep_for(
+                    std::chrono::microseconds(pauseUs));
+            }
+        }
+        std::cout << latencyStr(banner, lat);
+    };
+    {
+        rtacl::db<rtacl::ipv4a> acl;
+        rtacl::deferDb<rtacl::ipv4a> dacl;
+        run("db insert (every 10 us):     ", 1, 10,
+            [&acl](const rtacl::entry<rtacl::ipv4a>& e) { acl.insert(e); });
+        run("deferDb insert (every 10 us):", 1, 10,
+            [&dacl](const rtacl::entry<rtacl::ipv4a>& e) { dacl.insert(e); });
+        dacl.flush();
+        std::cout << bfmt("deferDb: %u batches\n") % dacl.batches();
+    }
+    {
+        rtacl::db<rtacl::ipv4a> acl;
+        rtacl::deferDb<rtacl::ipv4a> dacl;
+        run("db insert (bursts of 256):     ", burst, 5000,
+            [&acl](const rtacl::entry<rtacl::ipv4a>& e) { acl.insert(e); });
+        run("deferDb insert (bursts of 256):", burst, 5000,
+            [&dacl](const rtacl::entry<rtacl::ipv4a>& e) { dacl.insert(e); });
+        dacl.flush();
+        std::cout << bfmt("deferDb: %u batches\n\n") % dacl.batches();
+
+        prof[0].setBanner("db find: ");
+        prof[1].setBanner("deferDb find: ");
+        for (i = 0; i < elementsof(prof); ++i) {
+            prof[i].run();
+        }
+        for (i = 0; i < nCalls; ++i) {
+            prof[0].begin();
+            sum[0] += acl.find(keys[i % nKeys]).size();
+            prof[0].end();
+        }
+        for (i = 0; i < nCalls; ++i) {
+            prof[1].begin();
+            sum[1] += dacl.find(keys[i % nKeys]).size();
+            prof[1].end();
+        }
+        assert(sum[0] == sum[1]);
+        for (i = 0; i < elementsof(prof); ++i) {
+            prof[i].makeHist();
+            std::cout << prof[i].str() << "\n";
+        }
+    }
+}
+
+/**
+ * @name  explainBench
+ * @brief Lookup cost of \e rtacl::db and what the lookups touch
+ *        (\e rtacl::db::explain()) on the rule sets of
+ *        \e partBench, before and after 50% churn
+ */
+static void
+explainBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        nCalls = 1000000,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::db<rtacl::ipv4a> acl;
+    size_t i;
+
+    makeMixedRules(rules, keys, 70);
+    for (auto& e : rules) {
+        acl.insert(e);
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        cbProf::prof prof;
+        prof.setBanner(pass ? "find after churn: " : "find: ");
+        prof.run();
+        rtacl::costStats st;
+        size_t sum = 0;
+        for (i = 0; i < nCalls; ++i) {
+            prof.begin();
+            sum += acl.find(keys[i % nKeys]).size();
+            prof.end();
+        }
+        for (auto& k : keys) {
+            st.add(acl.explain(k));
+        }
+        prof.makeHist();
+        std::cout << prof.str() << "\n" << st.str() << "\n";
+        /*
+         * Remove and insert back half of the rules
+         */
+        for (i = 0; i < nRules; i += 2) {
+            acl.remove(rules[i]);
+        }
+        for (i = 0; i < nRules; i += 2) {
+            acl.insert(rules[i]);
+        }
+        assert(sum > 0);
+    }
+}
+
+/**
+ * @name  repackBench
+ * @brief Tree quality and lookup cost of \e rtacl::epochDb when
+ *        fresh, after churn, during and after the background
+ *        repack (100K rules)
+ */
+static void
+repackBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 4096,
+        nCalls = 1000000,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::epochDb<rtacl::ipv4a> acl;
+    cbProf::prof prof[4];
+    size_t i, n, sum[4] = { 0, 0, 0, 0 };
+
+    prof[0].setBanner("fresh: ");
+    prof[1].setBanner("after churn: ");
+    prof[2].setBanner("during repack: ");
+    prof[3].setBanner("after repack: ");
+
+    makeMixedRules(rules, keys, 70);
+    for (auto& e : rules) {
+        acl.insert(e);
+    }
+    auto lookups = [&](int p, size_t calls) {
+        prof[p].run();
+        for (size_t j = 0; j < calls; ++j) {
+            prof[p].begin();
+            sum[p] += acl.find(keys[j % nKeys]).size();
+            prof[p].end();
+        }
+    };
+    std::cout << "fresh:        " << acl.quality().str() << "\n";
+    lookups(0, nCalls);
+    /*
+     * Churn: remove 2/3 of the rules, insert them back, and remove
+     * them again
+     */
+    for (int round = 0; round < 2; ++round) {
+        for (i = 0; i < nRules; ++i) {
+            if (i % 3) {
+                acl.remove(rules[i]);
+            }
+        }
+        if (round == 0) {
+            for (i = 0; i < nRules; ++i) {
+                if (i % 3) {
+                    acl.insert(rules[i]);
+                }
+            }
+        }
+    }
+    std::cout << "after churn:  " << acl.quality().str() << "\n";
+    lookups(1, nCalls);
+    auto t0 = std::chrono::steady_clock::now();
+    bool started = acl.autoRepack();
+    assert(started);
+    for (n = 0; acl.isRepacking(); n += 1000) {
+        lookups(2, 1000);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    std::cout << "after repack: " << acl.quality().str() << "\n";
+    lookups(3, nCalls);
+    assert(sum[1] == sum[3]);
+    for (i = 0; i < elementsof(prof); ++i) {
+        prof[i].makeHist();
+        std::cout << prof[i].str() << "\n";
+    }
+    std::cout << (bfmt("repack: %.1f ms with %u lookups running\n")
+                  % std::chrono::duration<double, std::milli>(t1 - t0)
+                  .count() % n).str();
+}
+
+/**
+ * @name  regionBench
+ * @brief Cost of a region query by \e rtacl::db::dump() and a scan,
+ *        and by \e rtacl::db::intersecting() (100K rules)
+ */
+static void
+regionBench ()
+{
+    enum {
+        nRules = 100000,
+        nKeys  = 16,
+        nRuns  = 20,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::db<rtacl::ipv4a> acl;
+    const ipv4a prefixes[] = { 0x0a000000, 0x0a100000, 0x0ac00000 };
+    const int lens[] = { 8, 12, 16 };
+    size_t i, j;
+
+    makeMixedRules(rules, keys, 70);
+    for (auto& e : rules) {
+        acl.insert(e);
+    }
+    /*
+     * 10.0.0.0/8, 10.16.0.0/12, 10.192.0.0/16 to port 443
+     */
+    for (i = 0; i < elementsof(prefixes); ++i) {
+        const rtacl::ipv4a lo[rtacl::dim] = { prefixes[i], 0, 0, 443, 0, 0 };
+        const rtacl::ipv4a hi[rtacl::dim] = {
+            prefixes[i] + (1 << (32 - lens[i])) - 1, 0xffffffff,
+            0xffff, 443, 0xff, 0xff
+        };
+        rtacl::range<rtacl::ipv4a> region;
+        size_t n[3] = { 0, 0, 0 };
+        acl.makeMin(lo, region.min_corner());
+        acl.makeMax(hi, region.max_corner());
+
+        auto t0 = std::chrono::steady_clock::now();
+        for (j = 0; j < nRuns; ++j) {
+            rtacl::result<rtacl::ipv4a> r = acl.dump();
+            n[0] = 0;
+            for (auto& e : r) {
+                n[0] += rtacl::bg::intersects(e.first, region);
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (j = 0; j < nRuns; ++j) {
+            n[1] = acl.intersecting(
+                region, [](const rtacl::result<rtacl::ipv4a>&) {
+                    return true;
+                });
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        for (j = 0; j < nRuns; ++j) {
+            n[2] = acl.intersecting(
+                region, [](const rtacl::result<rtacl::ipv4a>&) {
+                    return false;
+                }, 16);
+        }
+        auto t3 = std::chrono::steady_clock::now();
+        std::cout << (bfmt("10.x/%d port 443: dump + scan: %.2f ms "
+                           "(%u rules copied, %u touch), "
+                           "intersecting: %.3f ms (%u rules), "
+                           "stop after %u: %.3f ms\n")
+                      % lens[i]
+                      % (std::chrono::duration<double, std::milli>(t1 - t0)
+                         .count() / nRuns)
+                      % nRules % n[0]
+                      % (std::chrono::duration<double, std::milli>(t2 - t1)
+                         .count() / nRuns)
+                      % n[1] % n[2]
+                      % (std::chrono::duration<double, std::milli>(t3 - t2)
+                         .count() / nRuns)).str();
+    }
+}
+
+/**
+ * @name  visitBench
+ * @brief Cost of a traversal of all the entries by \e rtacl::db::dump(),
+ *        the iterator, \e rtacl::db::forEach() and
+ *        \e rtacl::db::forEachParallel() (300K rules)
+ */
+static void
+visitBench ()
+{
+    enum {
+        nRules = 300000,
+        nKeys  = 16,
+        nRuns  = 10,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::db<rtacl::ipv4a> acl;
+    const char* names[] = {
+        "dump", "iterator", "forEach", "forEachParallel"
+    };
+    size_t i, j;
+
+    makeMixedRules(rules, keys, 70);
+    for (auto& e : rules) {
+        acl.insert(e);
+    }
+    rules.clear();
+    rules.shrink_to_fit();
+
+    for (i = 0; i < elementsof(names); ++i) {
+        std::atomic<size_t> sum(0);
+        auto t0 = std::chrono::steady_clock::now();
+        for (j = 0; j < nRuns; ++j) {
+            size_t s = 0;
+            auto f = [&s](const rtacl::entry<rtacl::ipv4a>& e) {
+                s += e.second;
+            };
+            switch (i) {
+            case 0:
+                for (auto& e : acl.dump()) {
+                    f(e);
+                }
+                break;
+            case 1:
+                for (auto& e : acl) {
+                    f(e);
+                }
+                break;
+            case 2:
+                acl.forEach(f);
+                break;
+            default:
+                acl.forEachParallel(
+                    [&sum](const rtacl::entry<rtacl::ipv4a>& e) {
+                        sum.fetch_add(e.second, std::memory_order_relaxed);
+                    });
+                break;
+            }
+            sum += s;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << (bfmt("%-16s %7.2f ms, %9u bytes copied (sum %u)\n")
+                      % names[i]
+                      % (std::chrono::duration<double, std::milli>(t1 - t0)
+                         .count() / nRuns)
+                      % ((i == 0) ? acl.size() *
+                         sizeof(rtacl::entry<rtacl::ipv4a>) : 0)
+                      % (sum.load() / nRuns)).str();
+    }
+}
+
+/**
+ * @name  legacyAddr2s
+ * @brief \e rtacl::ipv4a2s() and \e rtacl::ipv6a2s() as they were
+ *        with \e boost::format and \e inet_ntop() (for textBench)
+ */
+static std::string
+legacyAddr2s (const rtacl::ipv4a a)
+{
+    std::string s;
+    for (int i = 24; i > 0; i -= 8) {
+        s += (bfmt("%d.") % ((a >> i) & 0xff)).str();
+    }
+    return s + (bfmt("%d") % (a & 0xff)).str();
+}
+
+static std::string
+legacyAddr2s (const rtacl::ipv6a& a)
+{
+    in6_addr in6;
+    char buf[64];
+    for (size_t i = 0; i < 16; ++i) {
+        in6.s6_addr[15 - i] = static_cast<u8>(a >> (i << 3));
+    }
+    inet_ntop(AF_INET6, &in6, buf, sizeof(buf));
+    return buf;
+}
+
+/**
+ * @name  legacyRange2str
+ * @brief \e rtacl::range2str() as it was with \e boost::format
+ */
+template <class ADDR>
+static std::string
+legacyRange2str (const rtacl::range<ADDR>& r)
+{
+    ADDR lo[rtacl::dim];
+    ADDR hi[rtacl::dim];
+    rtacl::fields<0, rtacl::dim>::get(r.min_corner(), lo);
+    rtacl::fields<0, rtacl::dim>::get(r.max_corner(), hi);
+    return (bfmt("%s-%s, %s-%s, %d-%d, %d-%d, %d-%d, %d-%d")
+            % legacyAddr2s(ADDR(lo[0] + 1)) % legacyAddr2s(ADDR(hi[0] - 1))
+            % legacyAddr2s(ADDR(lo[1] + 1)) % legacyAddr2s(ADDR(hi[1] - 1))
+            % static_cast<U32>(lo[2] + 1) % static_cast<U32>(hi[2] - 1)
+            % static_cast<U32>(lo[3] + 1) % static_cast<U32>(hi[3] - 1)
+            % static_cast<U32>(lo[4] + 1) % static_cast<U32>(hi[4] - 1)
+            % static_cast<U32>(lo[5] + 1) % static_cast<U32>(hi[5] - 1))
+        .str();
+}
+
+/**
+ * @name  textExport
+ * @brief Exports \b acl to /dev/null by the legacy formatting,
+ *        by \e rtacl::range2str() and by \e rtacl::db::exportText()
+ */
+template <class ADDR>
+static void
+textExport (const char* af, const rtacl::db<ADDR>& acl)
+{
+    FILE* fp = fopen("/dev/null", "w");
+    double ms[3];
+    size_t bytes = 0;
+
+    assert(fp != NULL);
+    for (int m = 0; m < 3; ++m) {
+        auto t0 = std::chrono::steady_clock::now();
+        switch (m) {
+        case 0:
+            acl.forEach([&](const rtacl::entry<ADDR>& e) {
+                    std::string s = (bfmt("%s: %u\n")
+                                     % legacyRange2str(e.first)
+                                     % e.second).str();
+                    bytes += s.size();
+                    fputs(s.c_str(), fp);
+                });
+            break;
+        case 1:
+            acl.forEach([&](const rtacl::entry<ADDR>& e) {
+                    std::string s = rtacl::range2str(e.first) + ": " +
+                        std::to_string(e.second) + "\n";
+                    fputs(s.c_str(), fp);
+                });
+            break;
+        default:
+            acl.exportText(fp);
+            break;
+        }
+        fflush(fp);
+        auto t1 = std::chrono::steady_clock::now();
+        ms[m] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    }
+    fclose(fp);
+    std::cout << (bfmt("%s %u rules (%.1f MB): boost::format %.0f ms, "
+                       "range2str %.0f ms (x%.1f), "
+                       "exportText %.0f ms (x%.1f)\n")
+                  % af % acl.size() % (bytes / 1e6) % ms[0]
+                  % ms[1] % (ms[0] / ms[1]) % ms[2] % (ms[0] / ms[2])).str();
+}
+
+/**
+ * @name  textBench
+ * @brief Throughput of the text export by \e boost::format and
+ *        by \e rtacl::db::exportText() (200K IPv4 and IPv6 rules)
+ */
+static void
+textBench ()
+{
+    enum {
+        nRules = 200000,
+        nKeys  = 16,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::vector<rtacl::tuple<rtacl::ipv4a> > keys(nKeys);
+    rtacl::db<rtacl::ipv4a> acl4;
+    rtacl::db<rtacl::ipv6a> acl6;
+    const rtacl::ipv6a net = rtacl::ipv6a(0x20010db8) << 96;
+
+    makeMixedRules(rules, keys, 70);
+    for (auto& e : rules) {
+        rtacl::ipv4a lo4[rtacl::dim], hi4[rtacl::dim];
+        rtacl::ipv6a lo6[rtacl::dim], hi6[rtacl::dim];
+        rtacl::entry<rtacl::ipv6a> e6;
+        rtacl::fields<0, rtacl::dim>::get(e.first.min_corner(), lo4);
+        rtacl::fields<0, rtacl::dim>::get(e.first.max_corner(), hi4);
+        for (size_t d = 0; d < rtacl::dim; ++d) {
+            lo6[d] = lo4[d] + 1 + ((d < 2) ? net : 0);
+            hi6[d] = hi4[d] - 1 + ((d < 2) ? net : 0);
+        }
+        acl6.makeMin(lo6, e6.first.min_corner());
+        acl6.makeMax(hi6, e6.first.max_corner());
+        e6.second = e.second;
+        acl4.insert(e);
+        acl6.insert(e6);
+    }
+    textExport("IPv4", acl4);
+    textExport("IPv6", acl6);
+}
+
+/*
+ * Benchmarks selected by the command line argument
+ */
+static const struct {
+    const char* name;
+    void (*func)();
+} benches[] = {
+    { "pkt", pktBench },
+    { "key", keyBench },
+    { "numa", numaBench },
+    { "count", countBench },
+    { "query", queryBench },
+    { "any", anyBench },
+    { "payload", payloadBench },
+    { "alloc", allocBench },
+    { "mem", memBench },
+    { "dim", dimBench },
+    { "part", partBench },
+    { "tier", tierBench },
+    { "rfc", rfcBench },
+    { "bv", bvBench },
+    { "epoch", epochBench },
+    { "async", asyncBench },
+    { "ttl", ttlBench },
+    { "defer", deferBench },
+    { "explain", explainBench },
+    { "repack", repackBench },
+    { "region", regionBench },
+    { "visit", visitBench },
+    { "text", textBench },
+};
+
 int
 main (int argc, char *argv[])
 {
     cbProf::prof prof[4];
     size_t i;
+
+    if (argc > 1) {
+        for (i = 0; i < elementsof(benches); ++i) {
+            if (strcmp(argv[1], benches[i].name) == 0) {
+                benches[i].func();
+                return 0;
+            }
+        }
+        fprintf(stderr, "usage: %s [", argv[0]);
+        for (i = 0; i < elementsof(benches); ++i) {
+            fprintf(stderr, "%s%s", (i == 0) ? "" : "|", benches[i].name);
+        }
+        fprintf(stderr, "]\n");
+        return 1;
+    }
     prof[0].setBanner("insert: ");
     prof[1].setBanner("match: ");
     prof[2].setBanner("unmatch: ");
@@ -207,6 +2239,9 @@ main (int argc, char *argv[])
 
     prof[1].init();
     prof[1].run();
+#ifdef RTACL_EXPLAIN
+    acl.clearCosts();
+#endif
     for (i = 0; i < elementsof(pEnt); ++i) {
         u32 n = mt_rand();
         ipv4a sa = 0x0a000000 + (n * 0x20) + 2;
@@ -240,12 +2275,18 @@ main (int argc, char *argv[])
     }
     prof[1].makeHist();
     std::cout << (bfmt("Random match test:\n%s\n") % prof[1].str()).str();
+#ifdef RTACL_EXPLAIN
+    std::cout << "Random match test cost:\n" << acl.costs().str() << "\n";
+#endif
 
     /*
      * Random unmatch test
      */
     prof[2].init();
     prof[2].run();
+#ifdef RTACL_EXPLAIN
+    acl.clearCosts();
+#endif
     for (i = 0; i < elementsof(pEnt); ++i) {
         u32 n = mt_rand();
         ipv4a sa = 0x0a000000 + (n * 0x20) - 1 ;
@@ -277,6 +2318,9 @@ main (int argc, char *argv[])
     }
     prof[2].makeHist();
     std::cout << (bfmt("Random unmatch test:\n%s\n") % prof[2].str()).str();
+#ifdef RTACL_EXPLAIN
+    std::cout << "Random unmatch test cost:\n" << acl.costs().str() << "\n";
+#endif
 
     /*
      * Remove ACL entries
@@ -46,16 +46,37 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <arpa/inet.h>
+#include <unistd.h>
 
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/point.hpp>
 #include <boost/geometry/geometries/box.hpp>
 #include <boost/geometry/index/rtree.hpp>
+#include <boost/geometry/index/detail/rtree/utilities/statistics.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
 #include <boost/tuple/tuple_io.hpp>
 #include <boost/format.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 
@@ -67,9 +88,12 @@ namespace rtacl {
 enum
 {
     dim = 6, // dimension: src IP, dest IP, src port, desr port, proto, dscp
+    dim5Tuple = 5,      // src IP, dest IP, src port, dest port, proto
+    dimSrcDst = 2,      // src IP, dest IP
     offsetKey = 0,
     offsetMin = -1,
     offsetMax = 1,
+    textMax = 256,      // buffer size for range2buf() and tuple2buf()
 };
 
 namespace bg  = boost::geometry;
@@ -92,11 +116,14 @@ typedef s256 ipv6a;     // since rtree supports neither <= nor >=
  *          IPv4 address: (-1, 0x100000000)
  *          Port number:  (-1, 0x10000)
  *          IP proto:     (-1, 0x100)
+ *        A tuple of \b N (< 6) dimensions has the first \b N
+ *        fields only (e.g., 2: src IP and dst IP, 5: 5-tuple).
  *
  * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param N    Number of the fields (dimensions)
  */
-template <class ADDR>
-using tuple = bg::model::point<ADDR, dim, bg::cs::cartesian>;
+template <class ADDR, size_t N=dim>
+using tuple = bg::model::point<ADDR, N, bg::cs::cartesian>;
 
 /**
  * @name  rtacl::range
@@ -104,36 +131,88 @@ using tuple = bg::model::point<ADDR, dim, bg::cs::cartesian>;
  *        Range is equivalent to box (N-dimensional rectangle)
  *
  * @param ADDR \ertacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param N    Number of the fields (dimensions)
  */
-template <class ADDR>
-using range = bg::model::box<tuple<ADDR> >;
+template <class ADDR, size_t N=dim>
+using range = bg::model::box<tuple<ADDR, N> >;
 
 /**
  * @name  rtacl::entry
  * @brief R-tree ACL entry
  *        The first parameter of the pair is an ACL range.
- *        The second parameter of the pair is an unique index
- *        associated with the first parameter. Usually the second
- *        parameter is a pointer to the user-defined ACL entry
- *        associated with the R-tree entry. Hence its type is
- *        \e uintptr_t.
- *        TODO: \e uintptr_t' can be a template parameter,
- *        but it createts compilation errors regarding
- *        \b boost::geometry::index::equal_to<>.
+ *        The second parameter of the pair is the payload
+ *        associated with the first parameter. It is either a
+ *        pointer to the user-defined ACL entry in \e uintptr_t
+ *        (default), or a small value such as action, priority and
+ *        rule id stored inline in the R-tree leaf so that a match
+ *        can be resolved without another memory access.
+ *        \b VALUE must be equality comparable
+ *        (\b boost::geometry::index::equal_to<> used by remove()).
  *
- * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type
+ * @param N     Number of the fields (dimensions)
  */
-template <class ADDR>
-using entry = std::pair<range<ADDR>, uintptr_t>;
+template <class ADDR, class VALUE=uintptr_t, size_t N=dim>
+using entry = std::pair<range<ADDR, N>, VALUE>;
 
 /**
  * @name  rtacl::result
  * @brief ACL search result
  *
- * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type
+ * @param N     Number of the fields (dimensions)
  */
-template <class ADDR>
-using result = std::vector<entry<ADDR> >;
+template <class ADDR, class VALUE=uintptr_t, size_t N=dim>
+using result = std::vector<entry<ADDR, VALUE, N> >;
+
+/**
+ * @name  setField
+ * @brief Sets the \b I-th field of \b t to \b v
+ *        (nothing if \b t has no \b I-th field)
+ *
+ * @param I Field index (0: src IP, ..., 5: dscp)
+ * @param P \e rtacl::tuple<ADDR, N>
+ */
+template <size_t I, class P, class V>
+inline typename std::enable_if<(I < bg::traits::dimension<P>::value)>::type
+setField (P& t, const V& v)
+{
+    bg::set<I>(t, v);
+}
+
+template <size_t I, class P, class V>
+inline typename std::enable_if<(I >= bg::traits::dimension<P>::value)>::type
+setField (P&, const V&)
+{
+}
+
+/**
+ * @class rtacl::fields
+ * @brief Copies the fields [\b I, \b N) of a tuple from/to an array
+ */
+template <size_t I, size_t N>
+struct fields {
+    template <class P, class ADDR>
+    static void get (const P& t, ADDR* a) {
+        a[I] = bg::get<I>(t);
+        fields<I + 1, N>::get(t, a);
+    };
+    template <class P, class ADDR>
+    static void set (P& t, const ADDR* a) {
+        bg::set<I>(t, a[I]);
+        fields<I + 1, N>::set(t, a);
+    };
+};
+
+template <size_t N>
+struct fields<N, N> {
+    template <class P, class ADDR>
+    static void get (const P&, ADDR*) {};
+    template <class P, class ADDR>
+    static void set (P&, const ADDR*) {};
+};
 
 /*
  * forward declaration
@@ -210,30 +289,779 @@ public:
     std::string str();
 };
 
+/**
+ * @class rtacl::ruleStats
+ * @brief Packet and byte counts of an ACL rule
+ */
+struct ruleStats {
+    u64 packets;
+    u64 bytes;
+    ruleStats () : packets(0), bytes(0) {};
+};
+
+/**
+ * @name  ruleHandle
+ * @brief Returns the handle identifying the rule whose payload is
+ *        \b v for the per-rule hit counters
+ *        Overload this (in the namespace of \b VALUE) for the
+ *        payload types not convertible to \e uintptr_t.
+ *
+ * @param VALUE Payload type
+ *
+ * @param[in] v Payload
+ */
+template <class VALUE>
+inline uintptr_t
+ruleHandle (const VALUE& v)
+{
+    return static_cast<uintptr_t>(v);
+}
+
+/**
+ * @class rtacl::counters
+ * @brief Per-rule hit counters
+ *        Each thread counts in its own shard with plain (relaxed)
+ *        stores, so the lookup path has neither atomic
+ *        read-modify-write nor false sharing. The shards are
+ *        summed up on demand. A rule is identified by the handle
+ *        of its payload (see \e rtacl::ruleHandle()).
+ */
+class counters {
+private:
+    struct ctr {
+        std::atomic<u64> packets;
+        std::atomic<u64> bytes;
+        ctr () : packets(0), bytes(0) {};
+    };
+    struct shard {
+        std::mutex lock;   // held to add a rule or to read the shard
+        std::unordered_map<uintptr_t, ctr> ctrs;
+    };
+    struct cacheEnt {
+        u64 id;
+        shard* s;
+    };
+    enum { cacheSize = 4 };     // dbs a thread works on at a time
+
+    const u64 id;               // unique among the \e counters objects
+    std::mutex lock;            // protects \e shards
+    std::map<std::thread::id, std::unique_ptr<shard> > shards;
+public:
+    counters() : id(newId()) {};
+    void hit (uintptr_t handle, size_t bytes) {
+        shard* s = local();
+        auto it = s->ctrs.find(handle);
+        if (it == s->ctrs.end()) {
+            std::lock_guard<std::mutex> l(s->lock);
+            it = s->ctrs.emplace(std::piecewise_construct,
+                                 std::forward_as_tuple(handle),
+                                 std::forward_as_tuple()).first;
+        }
+        ctr& c = it->second;
+        c.packets.store(c.packets.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+        c.bytes.store(c.bytes.load(std::memory_order_relaxed) + bytes,
+                      std::memory_order_relaxed);
+    };
+    ruleStats stats(uintptr_t handle);
+    std::map<uintptr_t, ruleStats> dump();
+    void clear();
+private:
+    static u64 newId () {
+        static std::atomic<u64> next(1);
+        return next.fetch_add(1);
+    };
+    shard* local();
+};
+
+/**
+ * @class rtacl::timerWheel
+ * @brief Hierarchical timer wheel
+ *        \e levels wheels of \e slots slots each cover 2^32 ticks
+ *        from the current time; the later timers wait in a list
+ *        checked every 2^32 ticks. A timer is cascaded to a finer
+ *        wheel when the current time reaches its slot, so adding
+ *        a timer is O(1) and advancing is O(1) per tick plus
+ *        O(1) per timer. The unit of the ticks (e.g., ms or s)
+ *        is up to the caller.
+ *
+ * @param T Type of the timers
+ */
+template <class T>
+class timerWheel {
+private:
+    enum {
+        bits   = 8,
+        slots  = 1 << bits,
+        levels = 4,
+    };
+    typedef std::vector<std::pair<u64, T> > slot; // (expiry, timer)
+
+    slot wheel[levels][slots];
+    slot far;                   // beyond 2^32 ticks
+    size_t cnt[levels + 1];     // number of the timers in each level
+    u64 cur;                    // the timers <= cur have fired
+public:
+    explicit timerWheel(u64 now = 0) : cur(now) {
+        std::fill(cnt, cnt + levels + 1, 0);
+    };
+    void add(u64 when, const T& t);
+    template <class F>
+    void advance(u64 now, F fire);
+    u64 now () const { return cur; };
+    size_t size () const {
+        return std::accumulate(cnt, cnt + levels + 1, size_t(0));
+    };
+private:
+    void place(u64 at, const std::pair<u64, T>& x);
+};
+
+/**
+ * @class rtacl::allocStats
+ * @brief Memory allocated through \e rtacl::countingAllocator
+ */
+struct allocStats {
+    size_t allocs;      // number of the live allocations
+    size_t requested;   // bytes requested
+    size_t usable;      // bytes actually taken from the allocator
+    size_t peak;        // peak of \e usable
+    allocStats () : allocs(0), requested(0), usable(0), peak(0) {};
+};
+
+/**
+ * @name  usableSize
+ * @brief Returns the number of the bytes taken by an allocation of
+ *        \b n bytes at \b p (\b n unless it is known)
+ */
+template <class A>
+inline size_t
+usableSize (const A&, void* p, size_t n)
+{
+    return n;
+}
+
+#ifdef __GLIBC__
+template <class T>
+inline size_t
+usableSize (const std::allocator<T>&, void* p, size_t n)
+{
+    return malloc_usable_size(p);
+}
+#endif
+
+/**
+ * @class rtacl::countingAllocator
+ * @brief Allocator counting the memory taken from \b BASE
+ *        Copies (including the ones rebound to the other types by
+ *        the R-tree) share the same \e rtacl::allocStats. Not
+ *        thread-safe (as the updates of \e rtacl::db.)
+ *
+ * @param T    Value type
+ * @param BASE Allocator actually allocating the memory
+ */
+template <class T, class BASE=std::allocator<T> >
+class countingAllocator {
+private:
+    template <class U, class B> friend class countingAllocator;
+    typedef typename std::allocator_traits<BASE>::template rebind_alloc<T>
+        baseType;
+    std::shared_ptr<allocStats> st;
+    baseType base;
+public:
+    typedef T value_type;
+
+    explicit countingAllocator (const BASE& b = BASE())
+        : st(std::make_shared<allocStats>()), base(b) {};
+    template <class U, class B>
+    countingAllocator (const countingAllocator<U, B>& a)
+        : st(a.st), base(a.base) {};
+    T* allocate (size_t n) {
+        T* p = std::allocator_traits<baseType>::allocate(base, n);
+        ++st->allocs;
+        st->requested += n * sizeof(T);
+        st->usable += usableSize(base, p, n * sizeof(T));
+        st->peak = std::max(st->peak, st->usable);
+        return p;
+    };
+    void deallocate (T* p, size_t n) {
+        --st->allocs;
+        st->requested -= n * sizeof(T);
+        st->usable -= usableSize(base, p, n * sizeof(T));
+        std::allocator_traits<baseType>::deallocate(base, p, n);
+    };
+    const allocStats& stats () const { return *st; };
+    template <class U, class B>
+    bool operator== (const countingAllocator<U, B>& a) const {
+        return st == a.st && base == a.base;
+    };
+    template <class U, class B>
+    bool operator!= (const countingAllocator<U, B>& a) const {
+        return !(*this == a);
+    };
+};
+
+/**
+ * @name  allocatedBytes
+ * @brief Returns the number of the bytes taken through \b a if it
+ *        counts them
+ *
+ * @retval true  \b bytes is set
+ * @retval false \b a does not count
+ */
+template <class A>
+inline bool
+allocatedBytes (const A& a, size_t& bytes)
+{
+    return false;
+}
+
+template <class T, class B>
+inline bool
+allocatedBytes (const countingAllocator<T, B>& a, size_t& bytes)
+{
+    bytes = a.stats().usable;
+    return true;
+}
+
+/**
+ * @class rtacl::memUsage
+ * @brief Memory footprint of \e rtacl::db
+ */
+struct memUsage {
+    size_t rules;
+    size_t levels;
+    size_t internalNodes;
+    size_t leaves;
+    size_t nodeSize;        // bytes of a node (internal or leaf)
+    size_t internalBytes;   // child boxes and pointers in internal nodes
+    size_t leafBytes;       // rule boxes in leaves
+    size_t payloadBytes;    // payloads (with padding) in leaves
+    size_t slackBytes;      // unused slots, headers, allocator overhead
+    size_t total;           // all of the above
+    bool measured;          // \e total measured by countingAllocator
+    double bytesPerRule () const {
+        return rules ? static_cast<double>(total) / rules : 0.0;
+    };
+    std::string str() const;
+};
+
+/**
+ * @name  memUsage::str
+ * @brief Makes a one line summary
+ */
+inline std::string
+memUsage::str () const
+{
+    return (boost::format("%d rules, %d levels, %d internal nodes, "
+                          "%d leaves (%d bytes/node): internal %d, "
+                          "leaf boxes %d, payload %d, slack %d, "
+                          "total %d bytes%s (%.1f bytes/rule)")
+            % rules % levels % internalNodes % leaves % nodeSize
+            % internalBytes % leafBytes % payloadBytes % slackBytes
+            % total % (measured ? "" : " (estimated)")
+            % bytesPerRule()).str();
+}
+
+/**
+ * @class rtacl::treeQuality
+ * @brief R-tree quality metrics (see \e db::quality())
+ *        \e overlap and \e deadSpace are averaged over the
+ *        internal nodes: the total volume of the pairwise
+ *        intersections of the children, and the volume not covered
+ *        by any child (estimated as 1 - sum of the children, in
+ *        [0, 1]), relative to the volume of the node. The leaves
+ *        are left out since the rules overlap by design.
+ */
+struct treeQuality {
+    size_t levels;
+    size_t nodes;           // internal nodes
+    size_t leaves;
+    size_t entries;
+    double fill;            // children / max children per node
+    double overlap;
+    double deadSpace;
+    treeQuality () : levels(0), nodes(0), leaves(0), entries(0),
+                     fill(0), overlap(0), deadSpace(0) {};
+    std::string str() const;
+};
+
+/**
+ * @class rtacl::repackPolicy
+ * @brief Thresholds of \e rtacl::treeQuality triggering a repack
+ *        \e maxOverlap is off by default: the packing splits the
+ *        longest side of the boxes, so the rules spanning a whole
+ *        field can leave a packed tree with the internal overlap
+ *        above 1, and a repack would not bring it down.
+ */
+struct repackPolicy {
+    double minFill;
+    double maxOverlap;
+    double maxDeadSpace;
+    size_t minEntries;      // smaller trees are never repacked
+    repackPolicy () : minFill(0.6),
+                      maxOverlap(std::numeric_limits<double>::infinity()),
+                      maxDeadSpace(0.5),
+                      minEntries(1024) {};
+    bool exceeded (const treeQuality& q) const {
+        return q.entries >= minEntries &&
+            (q.fill < minFill || q.overlap > maxOverlap ||
+             q.deadSpace > maxDeadSpace);
+    };
+};
+
+/**
+ * @name  treeQuality::str
+ * @brief Makes a one line summary
+ */
+inline std::string
+treeQuality::str () const
+{
+    return (boost::format("%d entries, %d levels, %d internal nodes, "
+                          "%d leaves, fill %.2f, overlap %.3f, "
+                          "dead space %.3f")
+            % entries % levels % nodes % leaves % fill % overlap
+            % deadSpace).str();
+}
+
+/**
+ * @class rtacl::queryCost
+ * @brief Work done by one lookup (see \e db::explain())
+ */
+struct queryCost {
+    enum { maxLevels = 16 };
+    u32 nodes[maxLevels];   // nodes visited by level (0: root)
+    u32 levels;             // depth of the tree
+    u32 leaves;             // leaves visited
+    u32 boxes;              // child boxes tested in the internal nodes
+    u32 overlaps;           // internal nodes with 2+ children matching
+    u32 tested;             // leaf entries tested
+    u32 matches;            // leaf entries matching
+    queryCost () : levels(0), leaves(0), boxes(0), overlaps(0),
+                   tested(0), matches(0) {
+        std::fill(nodes, nodes + maxLevels, 0);
+    };
+    u32 visited () const {
+        return std::accumulate(nodes, nodes + maxLevels, 0u);
+    };
+    std::string str() const;
+};
+
+/**
+ * @class rtacl::costStats
+ * @brief Lookup costs aggregated over a workload: the averages and
+ *        the histograms (power-of-2 buckets) of \e rtacl::queryCost
+ */
+class costStats {
+public:
+    enum {
+        nodes, leaves, overlaps, tested, matches, nMetrics,
+        buckets = 16,       // 0, 1, 2-3, 4-7, ..., 2^14-
+    };
+private:
+    mutable std::mutex lock;
+    u64 lookups;
+    u64 levelSum[queryCost::maxLevels];
+    u64 sum[nMetrics];
+    u64 hist[nMetrics][buckets];
+public:
+    costStats () { clear(); };
+    costStats (const costStats& o) {
+        clear();
+        merge(o);
+    };
+    costStats& operator=(const costStats&) = delete;
+    void add(const queryCost& c);
+    void merge(const costStats& o);
+    void clear();
+    u64 count () const {
+        std::lock_guard<std::mutex> l(lock);
+        return lookups;
+    };
+    double average (int metric) const {
+        std::lock_guard<std::mutex> l(lock);
+        return lookups ? static_cast<double>(sum[metric]) / lookups : 0.0;
+    };
+    std::string str() const;
+private:
+    static int bucket (u32 v) {
+        int b = 0;
+        while (v && b < buckets - 1) {
+            v >>= 1;
+            ++b;
+        }
+        return b;
+    };
+};
+
+/**
+ * @class rtacl::costShards
+ * @brief \e rtacl::costStats gathered per thread (see
+ *        \e db::costs()). A thread adds to its own shard, so the
+ *        concurrent lookups share no lock and no cache line;
+ *        \e merged() adds the shards up for a report.
+ */
+class costShards {
+public:
+    enum { shards = 16 };   // threads beyond share the shards
+private:
+    struct shard {
+        costStats st;
+        char pad[64];       // keeps the neighbors off the lines
+    };
+    shard s[shards];
+    static unsigned index () {
+        static std::atomic<unsigned> next(0);
+        static thread_local unsigned i = next++ % shards;
+        return i;
+    };
+public:
+    void add (const queryCost& c) { s[index()].st.add(c); };
+    void clear () {
+        for (auto& x : s) {
+            x.st.clear();
+        }
+    };
+    costStats merged () const {
+        costStats m;
+        for (auto& x : s) {
+            m.merge(x.st);
+        }
+        return m;
+    };
+};
+
+/**
+ * @name  queryCost::str
+ * @brief Makes a one line summary
+ */
+inline std::string
+queryCost::str () const
+{
+    std::string s;
+    u32 i;
+
+    for (i = 0; i < levels && i < maxLevels; ++i) {
+        s += (boost::format("%s%u") % (i ? "/" : "") % nodes[i]).str();
+    }
+    return (boost::format("nodes by level %s, leaves %u, boxes tested %u, "
+                          "overlapping nodes %u, entries tested %u, "
+                          "matches %u")
+            % s % leaves % boxes % overlaps % tested % matches).str();
+}
+
+/**
+ * @name  costStats::add
+ * @brief Public function
+ *        Adds the cost of a lookup
+ */
+inline void
+costStats::add (const queryCost& c)
+{
+    const u32 v[nMetrics] = {
+        c.visited(), c.leaves, c.overlaps, c.tested, c.matches
+    };
+    int i;
+
+    std::lock_guard<std::mutex> l(lock);
+    ++lookups;
+    for (i = 0; i < queryCost::maxLevels; ++i) {
+        levelSum[i] += c.nodes[i];
+    }
+    for (i = 0; i < nMetrics; ++i) {
+        sum[i] += v[i];
+        ++hist[i][bucket(v[i])];
+    }
+}
+
+/**
+ * @name  costStats::merge
+ * @brief Public function
+ *        Adds the lookups of \b o
+ */
+inline void
+costStats::merge (const costStats& o)
+{
+    u64 n, ls[queryCost::maxLevels], sm[nMetrics], h[nMetrics][buckets];
+    int i, b;
+
+    {
+        std::lock_guard<std::mutex> l(o.lock);
+        n = o.lookups;
+        std::copy(o.levelSum, o.levelSum + queryCost::maxLevels, ls);
+        std::copy(o.sum, o.sum + nMetrics, sm);
+        std::copy(&o.hist[0][0], &o.hist[0][0] + nMetrics * buckets,
+                  &h[0][0]);
+    }
+    std::lock_guard<std::mutex> l(lock);
+    lookups += n;
+    for (i = 0; i < queryCost::maxLevels; ++i) {
+        levelSum[i] += ls[i];
+    }
+    for (i = 0; i < nMetrics; ++i) {
+        sum[i] += sm[i];
+        for (b = 0; b < buckets; ++b) {
+            hist[i][b] += h[i][b];
+        }
+    }
+}
+
+/**
+ * @name  costStats::clear
+ * @brief Public function
+ *        Forgets all the lookups
+ */
+inline void
+costStats::clear ()
+{
+    std::lock_guard<std::mutex> l(lock);
+    lookups = 0;
+    std::fill(levelSum, levelSum + queryCost::maxLevels, 0);
+    std::fill(sum, sum + nMetrics, 0);
+    std::fill(&hist[0][0], &hist[0][0] + nMetrics * buckets, 0);
+}
+
+/**
+ * @name  costStats::str
+ * @brief Makes the averages and the histograms (one line per
+ *        non-empty bucket, as \e cbProf::prof does)
+ */
+inline std::string
+costStats::str () const
+{
+    static const char* names[nMetrics] = {
+        "nodes visited", "leaves visited", "overlapping nodes",
+        "entries tested", "matches"
+    };
+    std::lock_guard<std::mutex> l(lock);
+    std::string s;
+    double n = lookups ? static_cast<double>(lookups) : 1.0;
+    int i, b;
+
+    s = (boost::format("%u lookups, nodes/lookup by level:") % lookups).str();
+    for (i = 0; i < queryCost::maxLevels && levelSum[i]; ++i) {
+        s += (boost::format(" %.2f") % (levelSum[i] / n)).str();
+    }
+    s += "\n";
+    for (i = 0; i < nMetrics; ++i) {
+        s += (boost::format("%s: %.2f/lookup\n") % names[i] % (sum[i] / n))
+            .str();
+        for (b = 0; b < buckets; ++b) {
+            if (hist[i][b] == 0) {
+                continue;
+            }
+            u32 lo = b ? (1u << (b - 1)) : 0;
+            u32 hi = b ? (1u << b) - 1 : 0;
+            s += (boost::format("%s: %5u - %5u: %5.2f%%  %u\n")
+                  % names[i] % lo % hi % (hist[i][b] * 100.0 / n)
+                  % hist[i][b]).str();
+        }
+    }
+    return s;
+}
+
+/**
+ * @class rtacl::queryRange
+ * @brief Pair of query iterators usable in range-based for loops
+ *
+ * @param IT Query iterator
+ */
+template <class IT>
+struct queryRange {
+    IT first;
+    IT last;
+    queryRange (IT f, IT l) : first(f), last(l) {};
+    IT begin () const { return first; };
+    IT end () const { return last; };
+};
+
+/**
+ * @class rtacl::countIterator
+ * @brief Output iterator counting the values assigned to it
+ *        (nothing is copied)
+ */
+class countIterator {
+private:
+    size_t* n;
+public:
+    typedef std::output_iterator_tag iterator_category;
+    typedef void value_type;
+    typedef void difference_type;
+    typedef void pointer;
+    typedef void reference;
+
+    explicit countIterator (size_t& cnt) : n(&cnt) {};
+    template <class T>
+    countIterator& operator= (const T&) { ++*n; return *this; };
+    countIterator& operator* () { return *this; };
+    countIterator& operator++ () { return *this; };
+    countIterator& operator++ (int) { return *this; };
+};
+
 /**
  * @class rtacl::db
  * @brief R-tree based ACL
  *
- * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ * @param N     Number of the fields (dimensions): the first \b N
+ *              of src IP, dst IP, src port, dst port, proto, dscp
+ * @param ALLOC Allocator of the R-tree nodes
+ *              (e.g., \e rtacl::poolAllocator in rtaclPool.hpp)
  */
-template <class ADDR=rtacl::ipv4a>
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t, size_t N=dim,
+          class ALLOC=std::allocator<entry<ADDR, VALUE, N> > >
 class db
 {
+    static_assert(N >= 1 && N <= dim, "N must be 1 to 6");
+public:
+    typedef bgi::rtree<entry<ADDR, VALUE, N>, bgi::quadratic<16>,
+                       bgi::indexable<entry<ADDR, VALUE, N> >,
+                       bgi::equal_to<entry<ADDR, VALUE, N> >,
+                       ALLOC> rtreeType;
+    typedef typename rtreeType::const_query_iterator queryIterator;
+    typedef typename rtreeType::const_iterator iterator;
 private:
-    bgi::rtree<entry<ADDR>, bgi::quadratic<16> > rtree;
+    rtreeType rtree;
     sa_family_t af;           // copy of \e sin_family or \e sin6_family
     u16 ao;                   // offset to \e sin_addr or \e sin6_addr
     u16 po;                   // offset to \e sin_port or \e sin6_port
     u8 ipVer;
+    std::shared_ptr<counters> ctrs;     // per-rule hit counters
+    struct ttlTimer {
+        entry<ADDR, VALUE, N> ent;
+        u64 expiry;             // current expiry of the rule
+        u64 armed;              // time of its live wheel (or due) entry
+        bool due;               // in \e due, not in \e wheel
+    };
+    struct ttlState {
+        typedef std::unordered_multimap<uintptr_t, ttlTimer> timerMap;
+        timerWheel<entry<ADDR, VALUE, N> > wheel;
+        timerMap timers;        // by rule handle, then (box, payload)
+        std::deque<std::pair<u64, entry<ADDR, VALUE, N> > > due;
+        void (*cancel)(ttlState&, const entry<ADDR, VALUE, N>&);
+        typename timerMap::iterator lookup (const entry<ADDR, VALUE, N>& e) {
+            auto r = timers.equal_range(ruleHandle(e.second));
+            bgi::equal_to<entry<ADDR, VALUE, N> > eq;
+            for (auto it = r.first; it != r.second; ++it) {
+                if (eq(it->second.ent, e)) {
+                    return it;
+                }
+            }
+            return timers.end();
+        };
+        static void cancelTimer (ttlState& t,
+                                 const entry<ADDR, VALUE, N>& e) {
+            auto it = t.lookup(e);
+            if (it != t.timers.end()) {
+                t.timers.erase(it);
+                t.compact();
+            }
+        };
+        void compact();
+    };
+    std::shared_ptr<ttlState> ttl;      // time-bounded rules
+#ifdef RTACL_EXPLAIN
+    std::shared_ptr<costShards> cost;   // costs of find()
+#endif
 public:
-    db();
-    void insert(entry<ADDR> const& ent) { rtree.insert(ent); };
-    bool remove(entry<ADDR> const& ent) {
-        return ((rtree.remove(ent) > 0) ? true : false);
+    explicit db(const ALLOC& alloc = ALLOC());
+    template <class IT>
+    db(IT first, IT last, const ALLOC& alloc = ALLOC());
+    void insert(entry<ADDR, VALUE, N> const& ent) { rtree.insert(ent); };
+    void insert(entry<ADDR, VALUE, N> const& ent, u64 expiry);
+    bool remove(entry<ADDR, VALUE, N> const& ent) {
+        if (rtree.remove(ent) == 0) {
+            return false;
+        }
+        if (ttl) {
+            ttl->cancel(*ttl, ent); // no ruleHandle() unless timed
+        }
+        return true;
+    };
+    size_t tick(u64 now, size_t budget = 256);
+    size_t timedRules () const { return ttl ? ttl->timers.size() : 0; };
+    size_t expiryBacklog () const { return ttl ? ttl->due.size() : 0; };
+    result<ADDR, VALUE, N> find(const tuple<ADDR, N>& key) const;
+    result<ADDR, VALUE, N> find(const tuple<ADDR, N>& key, size_t bytes) const;
+    result<ADDR, VALUE, N> classifyPacket(const u8* l3hdr, size_t len) const;
+    /*
+     * lazy search: the tree is walked as the iterator advances
+     */
+    queryIterator qbegin (const tuple<ADDR, N>& key) const {
+        return rtree.qbegin(bgi::contains(key));
+    };
+    queryIterator qend () const { return rtree.qend(); };
+    queryRange<queryIterator> matches (const tuple<ADDR, N>& key) const {
+        return queryRange<queryIterator>(qbegin(key), qend());
+    };
+    bool matchesAny (const tuple<ADDR, N>& key) const {
+        return (qbegin(key) != qend());
+    };
+    size_t countMatches (const tuple<ADDR, N>& key) const {
+        size_t n = 0;
+        rtree.query(bgi::contains(key), countIterator(n));
+        return n;
+    };
+    template <class OUT>
+    size_t query (const tuple<ADDR, N>& key, OUT out) const {
+        return rtree.query(bgi::contains(key), out);
     };
-    result<ADDR> find(const tuple<ADDR>& key);
     size_t size() const { return rtree.size(); };
-    result<ADDR> dump() const;
+    queryCost explain (const tuple<ADDR, N>& key) const {
+        size_t n = 0;
+        return walk(key, countIterator(n));
+    };
+#ifdef RTACL_EXPLAIN
+    costStats costs () const { return cost->merged(); };
+    void clearCosts () { cost->clear(); };
+#endif
+    void enableCounters (bool enable) {
+        if (!enable) {
+            ctrs.reset();
+        } else if (!ctrs) {
+            ctrs = std::make_shared<counters>();
+        }
+    };
+    ruleStats stats (uintptr_t handle) const {
+        return ctrs ? ctrs->stats(handle) : ruleStats();
+    };
+    std::map<uintptr_t, ruleStats> dumpCounters () const {
+        return ctrs ? ctrs->dump() : std::map<uintptr_t, ruleStats>();
+    };
+    void clearCounters () {
+        if (ctrs) {
+            ctrs->clear();
+        }
+    };
+    result<ADDR, VALUE, N> dump() const;
+    /*
+     * zero-copy traversal of all the entries
+     */
+    iterator begin () const { return rtree.begin(); };
+    iterator end () const { return rtree.end(); };
+    template <class F>
+    size_t forEach(F f) const;
+    template <class F>
+    size_t forEachParallel(F f, size_t nThreads = 0) const;
+    /*
+     * text export: "<range2str()>: <ruleHandle(payload)>" per line
+     */
+    bool exportText(FILE* fp) const;
+    bool exportText(int fd) const;
+    /*
+     * region queries: \b cb(const result<ADDR, VALUE, N>&) gets the
+     * matching entries up to \b chunk at a time, and returns false
+     * to stop
+     */
+    template <class CB>
+    size_t intersecting(const range<ADDR, N>& region, CB cb,
+                        size_t chunk = 256) const;
+    template <class CB>
+    size_t within(const range<ADDR, N>& region, CB cb,
+                  size_t chunk = 256) const;
+    memUsage memoryUsage() const;
+    treeQuality quality() const;
+    void repack();
     /*
      * helper functions
      */
@@ -241,42 +1069,42 @@ public:
                  const sockaddr_in& dst,
                   const u8 proto,
                   const u8 dscp,
-                  tuple<rtacl::ipv4a>& result) {
+                  tuple<rtacl::ipv4a, N>& result) {
         makeTuple(src, dst, proto, dscp, offsetMin, result);
     }
     void makeMax (const sockaddr_in& src,
                   const sockaddr_in& dst,
                   const u8 proto,
                   const u8 dscp,
-                  tuple<rtacl::ipv4a>& result) {
+                  tuple<rtacl::ipv4a, N>& result) {
         makeTuple(src, dst, proto, dscp, offsetMax, result);
     }
     void makeKey (const sockaddr_in& src,
                   const sockaddr_in& dst,
                   const u8 proto,
                   const u8 dscp,
-                  tuple<rtacl::ipv4a>& result) {
+                  tuple<rtacl::ipv4a, N>& result) {
         makeTuple(src, dst, proto, dscp, offsetKey, result);
     }
     void makeMin (const sockaddr_in6& src,
                   const sockaddr_in6& dst,
                   const u8 proto,
                   const u8 dscp,
-                  tuple<rtacl::ipv6a>& result) {
+                  tuple<rtacl::ipv6a, N>& result) {
         makeTuple(src, dst, proto, dscp, offsetMin, result);
     }
     void makeMax (const sockaddr_in6& src,
                   const sockaddr_in6& dst,
                   const u8 proto,
                   const u8 dscp,
-                  tuple<rtacl::ipv6a>& result) {
+                  tuple<rtacl::ipv6a, N>& result) {
         makeTuple(src, dst, proto, dscp, offsetMax, result);
     }
     void makeKey (const sockaddr_in6& src,
                   const sockaddr_in6& dst,
                   const u8 proto,
                   const u8 dscp,
-                  tuple<rtacl::ipv6a>& key) {
+                  tuple<rtacl::ipv6a, N>& key) {
         makeTuple(src, dst, proto, dscp, offsetKey, key);
     }
     void makeMin (const ADDR sa,
@@ -285,7 +1113,7 @@ public:
                   const ADDR dp,
                   const ADDR proto,
                   const ADDR dscp,
-                  tuple<ADDR>& result) {
+                  tuple<ADDR, N>& result) {
         makeTuple(sa, da, sp, dp, proto, dscp, offsetMin, result);
     }
     void makeMax (const ADDR sa,
@@ -294,7 +1122,7 @@ public:
                   const ADDR dp,
                   const ADDR proto,
                   const ADDR dscp,
-                  tuple<ADDR>& result) {
+                  tuple<ADDR, N>& result) {
         makeTuple(sa, da, sp, dp, proto, dscp, offsetMax, result);
     }
     void makeKey (const ADDR sa,
@@ -303,22 +1131,34 @@ public:
                   const ADDR dp,
                   const ADDR proto,
                   const ADDR dscp,
-                  tuple<ADDR>& result) {
+                  tuple<ADDR, N>& result) {
         makeTuple(sa, da, sp, dp, proto, dscp, offsetKey, result);
     }
+    void makeMin (const ADDR f[N], tuple<ADDR, N>& result) {
+        makeTuple(f, offsetMin, result);
+    }
+    void makeMax (const ADDR f[N], tuple<ADDR, N>& result) {
+        makeTuple(f, offsetMax, result);
+    }
+    void makeKey (const ADDR f[N], tuple<ADDR, N>& result) {
+        makeTuple(f, offsetKey, result);
+    }
+    bool makeKey (const u8* l3hdr, size_t len, tuple<ADDR, N>& key) const {
+        return parsePkt(l3hdr, len, key);
+    }
 private:
     void makeTuple(const sockaddr_in& src,
                    const sockaddr_in& dst,
                    const u8 proto,
                    const u8 dscp,
                    const s32 offset,
-                   tuple<rtacl::ipv4a>& result);
+                   tuple<rtacl::ipv4a, N>& result);
     void makeTuple(const sockaddr_in6& src,
                    const sockaddr_in6& dst,
                    const u8 proto,
                    const u8 dscp,
                    const s32 offset,
-                   tuple<rtacl::ipv6a>& result);
+                   tuple<rtacl::ipv6a, N>& result);
     void makeTuple(const ADDR sa,
                    const ADDR da,
                    const ADDR sp,
@@ -326,7 +1166,91 @@ private:
                    const ADDR proto,
                    const ADDR dscp,
                    const s32 offset,
-                   tuple<ADDR>& result);
+                   tuple<ADDR, N>& result);
+    void makeTuple(const ADDR f[N], const s32 offset,
+                   tuple<ADDR, N>& result);
+    bool parsePkt(const u8* l3hdr, size_t len,
+                  tuple<rtacl::ipv4a, N>& key) const;
+    bool parsePkt(const u8* l3hdr, size_t len,
+                  tuple<rtacl::ipv6a, N>& key) const;
+    template <class OUT>
+    queryCost walk(const tuple<ADDR, N>& key, OUT out) const;
+    template <class PRED, class FILTER, class CB>
+    size_t regionQuery(const PRED& pred, FILTER filter, CB cb,
+                       size_t chunk) const;
+    template <class OUT>
+    bool exportTo(OUT out) const;
+    void init();
+};
+
+/**
+ * @class rtacl::dualResult
+ * @brief Search result of \e rtacl::dualDb
+ *        Either \b v4 or \b v6 is used depending on \b af.
+ *        For an IPv4-mapped key (\b af is AF_INET), \b v6 has
+ *        the matches of the IPv6 rules covering the mapped space
+ *        only partly (e.g., any-address rules).
+ */
+struct dualResult {
+    sa_family_t   af;           // AF_INET, AF_INET6, or AF_UNSPEC (error)
+    result<ipv4a> v4;
+    result<ipv6a> v6;
+    size_t size () const { return v4.size() + v6.size(); };
+    bool empty () const { return v4.empty() && v6.empty(); };
+};
+
+/**
+ * @class rtacl::dualDb
+ * @brief Dual-stack R-tree based ACL
+ *        Owns an IPv4 (\e s64) and an IPv6 (\e s256) R-tree and
+ *        dispatches each operation by the address family.
+ *        IPv4-mapped IPv6 addresses (::ffff:a.b.c.d) are treated
+ *        as IPv4 addresses: IPv6 rules whose source and
+ *        destination address ranges are both inside ::ffff:0:0/96
+ *        are stored in the IPv4 tree, and the keys made from
+ *        mapped addresses (sockaddr or packet) are looked up in
+ *        the IPv4 tree. The IPv6 rules overlapping the mapped space
+ *        (e.g., ::/0 -> ::/0) stay in the IPv6 tree, and if there
+ *        are any, every IPv4 flow, native or mapped, is also
+ *        looked up there by its mapped address (::ffff:a.b.c.d) so
+ *        that a flow matches the same rules however it arrives.
+ */
+class dualDb
+{
+private:
+    db<ipv4a> db4;
+    db<ipv6a> db6;
+    size_t mapped6;     // rules in \e db6 overlapping ::ffff:0:0/96
+public:
+    void insert(entry<ipv4a> const& ent) { db4.insert(ent); };
+    void insert(entry<ipv6a> const& ent);
+    bool remove(entry<ipv4a> const& ent) { return db4.remove(ent); };
+    bool remove(entry<ipv6a> const& ent);
+    size_t size() const { return db4.size() + db6.size(); };
+    void dump(result<ipv4a>& r4, result<ipv6a>& r6) const {
+        r4 = db4.dump();
+        r6 = db6.dump();
+    };
+    void find(const sockaddr* src, const sockaddr* dst,
+              const u8 proto, const u8 dscp, dualResult& r);
+    void classifyPacket(const u8* l3hdr, size_t len, dualResult& r);
+    void classifyBatch(const u8* const l3hdr[], const size_t len[],
+                       const size_t n, dualResult r[]);
+    db<ipv4a>& getDb4 () { return db4; };
+    db<ipv6a>& getDb6 () { return db6; };
+    dualDb () : mapped6(0) {};
+private:
+    static bool mapped2v4(const entry<ipv6a>& e6, entry<ipv4a>& e4);
+    static bool overlapsMapped(const entry<ipv6a>& e6);
+    static bool isMapped (const u8* a) {
+        static const u8 prefix[12] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+        };
+        return memcmp(a, prefix, sizeof(prefix)) == 0;
+    };
+    static void mappedKey(const u8* l3hdr, const tuple<ipv6a>& k6,
+                          tuple<ipv4a>& k4);
+    static void mappedKey(const tuple<ipv4a>& k4, tuple<ipv6a>& k6);
 };
 
 /*
@@ -334,28 +1258,349 @@ private:
  */
 
 /**
- * @name  ipv4a2s
- * @brief Converts \e rtacl::ipv4a to \e std::string
+ * @name  u64toBuf
+ * @brief Writes \b v in decimal to \b p (no terminating NUL)
  *
- * @param[in] a IPv4 address as \e rtacl::ipv4a
+ * @param[out] p Buffer (20 bytes at least)
+ * @param[in]  v Value
  *
- * @retval \e std::string IPv4 address as a string
+ * @retval Pointer to the end of the written text
  */
-inline std::string
-ipv4a2s (const rtacl::ipv4a a)
+inline char*
+u64toBuf (char* p, u64 v)
 {
-    std::string s;
-    u64 mask = 0xff000000;
-    u64 val;
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324"
+        "25262728293031323334353637383940414243444546474849"
+        "50515253545556575859606162636465666768697071727374"
+        "75767778798081828384858687888990919293949596979899";
+    char tmp[20];
+    char* q = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        const char* d = pairs + (v % 100) * 2;
+        v /= 100;
+        *--q = d[1];
+        *--q = d[0];
+    }
+    if (v >= 10) {
+        *--q = pairs[v * 2 + 1];
+        *--q = pairs[v * 2];
+    } else {
+        *--q = static_cast<char>('0' + v);
+    }
+    size_t n = tmp + sizeof(tmp) - q;
+    memcpy(p, q, n);
+    return p + n;
+}
+
+/**
+ * @name  ipv4toBuf
+ * @brief Writes an IPv4 address in the dotted decimal to \b p
+ *        (no terminating NUL)
+ *
+ * @param[out] p Buffer (15 bytes at least)
+ * @param[in]  a IPv4 address (host byte order)
+ *
+ * @retval Pointer to the end of the written text
+ */
+inline char*
+ipv4toBuf (char* p, const u32 a)
+{
+    p = u64toBuf(p, a >> 24);
+    *p++ = '.';
+    p = u64toBuf(p, (a >> 16) & 0xff);
+    *p++ = '.';
+    p = u64toBuf(p, (a >> 8) & 0xff);
+    *p++ = '.';
+    return u64toBuf(p, a & 0xff);
+}
+
+/**
+ * @name  ipv6toBuf
+ * @brief Writes an IPv6 address to \b p in the same text as
+ *        \e inet_ntop() (RFC 5952 with the IPv4-mapped and
+ *        -compatible forms; no terminating NUL)
+ *
+ * @param[out] p Buffer (45 bytes at least)
+ * @param[in]  w The 8 16-bit words of the address
+ *
+ * @retval Pointer to the end of the written text
+ */
+inline char*
+ipv6toBuf (char* p, const u16 w[8])
+{
+    static const char hex[] = "0123456789abcdef";
+    int base = -1, len = 0;
+    int i, j;
+
+    /*
+     * The longest run (the first one if tied) of 2 or more zeros
+     */
+    for (i = 0; i < 8; i = j + 1) {
+        for (j = i; j < 8 && w[j] == 0; ++j) {
+        }
+        if (j - i > len) {
+            base = i;
+            len = j - i;
+        }
+    }
+    if (len < 2) {
+        base = -1;
+    }
+    for (i = 0; i < 8; ++i) {
+        if (i == base) {
+            *p++ = ':';
+            i += len - 1;
+            if (i == 7) {
+                *p++ = ':';
+            }
+            continue;
+        }
+        if (i) {
+            *p++ = ':';
+        }
+        if (i == 6 && base == 0 &&
+            (len == 6 || (len == 5 && w[5] == 0xffff))) {
+            return ipv4toBuf(p, (u32(w[6]) << 16) | w[7]);
+        }
+        int s = 12;
+        while (s > 0 && (w[i] >> s) == 0) {
+            s -= 4;
+        }
+        for (; s >= 0; s -= 4) {
+            *p++ = hex[(w[i] >> s) & 0xf];
+        }
+    }
+    return p;
+}
+
+/**
+ * @name  ipv6toBuf
+ * @brief Writes an IPv6 address given as the upper and the lower
+ *        64 bits to \b p (no terminating NUL)
+ *
+ * @param[out] p  Buffer (45 bytes at least)
+ * @param[in]  hi Upper 64 bits
+ * @param[in]  lo Lower 64 bits
+ *
+ * @retval Pointer to the end of the written text
+ */
+inline char*
+ipv6toBuf (char* p, const u64 hi, const u64 lo)
+{
+    u16 w[8];
     int i;
-    for (i = 24; i > 0; i -= 8) {
-        val = (a & mask) >> i;
-        mask >>= 8;
-        s += (boost::format("%d.") % val).str();
+    for (i = 0; i < 4; ++i) {
+        w[i] = static_cast<u16>(hi >> (48 - i * 16));
+        w[i + 4] = static_cast<u16>(lo >> (48 - i * 16));
     }
-    val = (a & mask);
-    s += (boost::format("%d") % val).str();
-    return s;
+    return ipv6toBuf(p, w);
+}
+
+/**
+ * @name  ipv6toBuf
+ * @brief Writes a raw IPv6 address (network byte order) to \b p
+ *        (no terminating NUL)
+ *
+ * @param[out] p Buffer (45 bytes at least)
+ * @param[in]  a Pointer to the 16-byte IPv6 address
+ *
+ * @retval Pointer to the end of the written text
+ */
+inline char*
+ipv6toBuf (char* p, const u8* a)
+{
+    u16 w[8];
+    int i;
+    for (i = 0; i < 8; ++i) {
+        w[i] = static_cast<u16>((a[i * 2] << 8) | a[i * 2 + 1]);
+    }
+    return ipv6toBuf(p, w);
+}
+
+/**
+ * @name  sa2buf
+ * @brief Writes the raw IPv4 or IPv6 address in \e sockaddr to
+ *        \b p (no terminating NUL)
+ *
+ * @param[out] p  Buffer (45 bytes at least)
+ * @param[in]  af AF_INET or AF_INET6
+ * @param[in]  a  Pointer to \e sin_addr or \e sin6_addr
+ *
+ * @retval Pointer to the end of the written text
+ */
+inline char*
+sa2buf (char* p, const int af, const void* a)
+{
+    if (af == AF_INET6) {
+        return ipv6toBuf(p, static_cast<const u8*>(a));
+    }
+    u32 v;
+    memcpy(&v, a, sizeof(v));
+    return ipv4toBuf(p, ntohl(v));
+}
+
+/**
+ * @name  int2u64x2
+ * @brief Splits \e rtacl::ipv6a (modulo 2^128, so that -1 is
+ *        ::ffff...) into two 64-bit halves reading the limbs of
+ *        the multiprecision integer directly (the inverse of
+ *        \e u64x2toInt())
+ *
+ * @param[in]  v  IPv6 address as \e rtacl::ipv6a
+ * @param[out] hi Upper 64 bits
+ * @param[out] lo Lower 64 bits
+ */
+inline void
+int2u64x2 (const s256& v, u64& hi, u64& lo)
+{
+    typedef boost::multiprecision::limb_type limb;
+    const auto& b = v.backend();
+    if (sizeof(limb) != sizeof(u64)) {
+        s256 m = (v < 0) ? v + (s256(1) << 128) : v;
+        hi = static_cast<u64>((m >> 64) & 0xffffffffffffffffULL);
+        lo = static_cast<u64>(m & 0xffffffffffffffffULL);
+        return;
+    }
+    lo = b.limbs()[0];
+    hi = (b.size() > 1) ? b.limbs()[1] : 0;
+    if (b.sign()) {
+        lo = ~lo + 1;
+        hi = ~hi + (lo == 0);
+    }
+}
+
+/**
+ * @name  addr2buf
+ * @brief Writes an \e rtacl::ipv4a or \e rtacl::ipv6a address
+ *        to \b p (no terminating NUL)
+ *
+ * @param[out] p Buffer (45 bytes at least)
+ * @param[in]  a Address
+ *
+ * @retval Pointer to the end of the written text
+ */
+inline char*
+addr2buf (char* p, const rtacl::ipv4a a)
+{
+    return ipv4toBuf(p, static_cast<u32>(a));
+}
+
+inline char*
+addr2buf (char* p, const rtacl::ipv6a& a)
+{
+    u64 hi, lo;
+    int2u64x2(a, hi, lo);
+    return ipv6toBuf(p, hi, lo);
+}
+
+/**
+ * @name  field2buf
+ * @brief Writes the \b i-th field of a tuple plus \b off to \b p
+ *        (no terminating NUL)
+ *        The \e rtacl::ipv6a version adds \b off to the 64-bit
+ *        halves, not to the multiprecision integer.
+ *
+ * @param[out] p   Buffer (45 bytes at least)
+ * @param[in]  i   Field index (0: src IP, ..., 5: dscp)
+ * @param[in]  v   Value of the field
+ * @param[in]  off \e offsetKey, \e -offsetMin or \e -offsetMax
+ *
+ * @retval Pointer to the end of the written text
+ */
+inline char*
+field2buf (char* p, const size_t i, const rtacl::ipv4a v, const int off)
+{
+    return (i < 2) ? ipv4toBuf(p, static_cast<u32>(v + off)) :
+        u64toBuf(p, static_cast<U32>(v + off));
+}
+
+inline char*
+field2buf (char* p, const size_t i, const rtacl::ipv6a& v, const int off)
+{
+    u64 hi, lo;
+    int2u64x2(v, hi, lo);
+    if (off > 0) {
+        hi += (++lo == 0);
+    } else if (off < 0) {
+        hi -= (lo-- == 0);
+    }
+    return (i < 2) ? ipv6toBuf(p, hi, lo) :
+        u64toBuf(p, static_cast<U32>(lo));
+}
+
+/**
+ * @name  tuple2buf
+ * @brief Writes \e rtacl::tuple<ADDR, N> to \b p with no heap
+ *        allocation in the same text as \e tuple2str()
+ *
+ * @param[out] p Buffer (\e rtacl::textMax bytes at least)
+ * @param[in]  t Tuple of the first \b N fields (sa, da, sp, ...)
+ *
+ * @retval Pointer to the terminating NUL
+ */
+template <class ADDR, size_t N>
+inline char*
+tuple2buf (char* p, const rtacl::tuple<ADDR, N>& t)
+{
+    ADDR a[N];
+    fields<0, N>::get(t, a);
+    for (size_t i = 0; i < N; ++i) {
+        if (i) {
+            *p++ = ',';
+            *p++ = ' ';
+        }
+        p = field2buf(p, i, a[i], offsetKey);
+    }
+    *p = '\0';
+    return p;
+}
+
+/**
+ * @name  range2buf
+ * @brief Writes \e rtacl::range<ADDR, N> to \b p with no heap
+ *        allocation in the same text as \e range2str()
+ *
+ * @param[out] p Buffer (\e rtacl::textMax bytes at least)
+ * @param[in]  r Range of the first \b N fields (sa, da, sp, ...)
+ *
+ * @retval Pointer to the terminating NUL
+ */
+template <class ADDR, size_t N>
+inline char*
+range2buf (char* p, const rtacl::range<ADDR, N>& r)
+{
+    ADDR lo[N];
+    ADDR hi[N];
+    fields<0, N>::get(r.min_corner(), lo);
+    fields<0, N>::get(r.max_corner(), hi);
+    for (size_t i = 0; i < N; ++i) {
+        if (i) {
+            *p++ = ',';
+            *p++ = ' ';
+        }
+        p = field2buf(p, i, lo[i], -offsetMin);
+        *p++ = '-';
+        p = field2buf(p, i, hi[i], -offsetMax);
+    }
+    *p = '\0';
+    return p;
+}
+
+/**
+ * @name  ipv4a2s
+ * @brief Converts \e rtacl::ipv4a to \e std::string
+ *
+ * @param[in] a IPv4 address as \e rtacl::ipv4a
+ *
+ * @retval \e std::string IPv4 address as a string
+ */
+inline std::string
+ipv4a2s (const rtacl::ipv4a a)
+{
+    char buf[16];
+    return std::string(buf, ipv4toBuf(buf, static_cast<u32>(a)));
 }
 
 /**
@@ -369,352 +1614,2281 @@ ipv4a2s (const rtacl::ipv4a a)
 inline std::string
 ipv6a2s (const rtacl::ipv6a& a)
 {
-    sockaddr_in6 sa;
-    char buf[64];
+    char buf[48];
+    return std::string(buf, addr2buf(buf, a));
+}
+
+/**
+ * @name  pktRd16
+ * @brief Reads a 16-bit field in the network byte order from
+ *        a (possibly unaligned) packet header
+ *
+ * @param[in] p Pointer to the field
+ *
+ * @retval u16 The field in the host byte order
+ */
+inline u16
+pktRd16 (const u8* p)
+{
+    u16 v;
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+/**
+ * @name  pktRd32
+ * @brief Reads a 32-bit field in the network byte order from
+ *        a (possibly unaligned) packet header
+ *
+ * @param[in] p Pointer to the field
+ *
+ * @retval u32 The field in the host byte order
+ */
+inline u32
+pktRd32 (const u8* p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+/**
+ * @name  pktRd64
+ * @brief Reads a 64-bit field in the network byte order from
+ *        a (possibly unaligned) buffer
+ *
+ * @param[in] p Pointer to the field
+ *
+ * @retval u64 The field in the host byte order
+ */
+inline u64
+pktRd64 (const u8* p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/**
+ * @name  u64x2toInt
+ * @brief Makes a 128-bit integer from two 64-bit halves
+ *
+ * @param INT Must be either \e ipv6a (\e u128) or
+ *            \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in]  hi Upper 64 bits
+ * @param[in]  lo Lower 64 bits
+ * @param[out] v  (\b hi << 64) | \b lo
+ */
+template <class INT>
+inline void
+u64x2toInt (const u64 hi, const u64 lo, INT& v)
+{
+    v = hi;
+    v <<= 64;
+    v |= lo;
+}
+
+/**
+ * @name  u64x2toInt
+ * @brief Makes a 128-bit integer from two 64-bit halves
+ *        \e rtacl::ipv6a (\e s256) version: writes the limbs of
+ *        the multiprecision integer directly.
+ *
+ * @param[in]  hi Upper 64 bits
+ * @param[in]  lo Lower 64 bits
+ * @param[out] v  (\b hi << 64) | \b lo
+ */
+inline void
+u64x2toInt (const u64 hi, const u64 lo, s256& v)
+{
+    typedef boost::multiprecision::limb_type limb;
+    if (sizeof(limb) != sizeof(u64)) {
+        u64x2toInt<s256>(hi, lo, v);
+        return;
+    }
+    auto& b = v.backend();
+    b.resize(2, 2);
+    b.limbs()[0] = static_cast<limb>(lo);
+    b.limbs()[1] = static_cast<limb>(hi);
+    b.sign(false);
+    b.normalize();
+}
+
+/**
+ * @name  in6a2int
+ * @brief Converts a raw IPv6 address (network byte order) to \e INT
+ *        The address is loaded as two 64-bit words.
+ *
+ * @param INT Must be either \e ipv6a (\e u128) or
+ *            \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] a Pointer to the 16-byte IPv6 address
+ *
+ * @retval \b a as \e INT
+ */
+template <class INT>
+inline INT
+in6a2int (const u8* a)
+{
+    INT addr;
+    u64x2toInt(pktRd64(a), pktRd64(a + sizeof(u64)), addr);
+    return addr;
+}
+
+/**
+ * @name  sin6a2int
+ * @brief Converts \e sockaddr_in6 to \e INT
+ *
+ * @param INT Must be either \e ipv6a (\e u128) or
+ *            \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] a IPv6 address as \e sockaddr_in6
+ *
+ * @retval \e sin6.sin6_addr as \e INT
+ */
+template <class INT>
+inline INT
+sin6a2int (const sockaddr_in6& sin6)
+{
+    return in6a2int<INT>(sin6.sin6_addr.s6_addr);
+}
 
-    memset(&sa, 0, sizeof(sa));
-    sa.sin6_family = AF_INET6;
-    size_t max = elementsof(sa.sin6_addr.s6_addr) - 1;
+/**
+ * @name  int2sin6
+ * @brief Converts \b INT to \e sockaddr_in6
+ *
+ * @param INT Must be either \e ipv6a (\e u128) or
+ *            \e rtacl::ipv6a (\e u256)
+ *
+ * @param[in] a IPv6 address as \e INT
+ *
+ * @retval IPv6 address as \e sockaddr_in6
+ */
+template <class INT>
+inline sockaddr_in6
+int2sin6 (const INT& addr)
+{
+    sockaddr_in6 sin6;
+    size_t max = elementsof(sin6.sin6_addr.s6_addr) - 1;
     size_t i;
     for (i = 0; i <= max; ++i) {
-        u8 n = static_cast<u8>(a >> (i << 3));
-        sa.sin6_addr.s6_addr[max - i] = n;
+        u8 n = static_cast<u8>(addr >> (i << 3));
+        sin6.sin6_addr.s6_addr[max - i] = n;
+    }
+    return sin6;
+}
+
+/**
+ * @name  pktHasPorts
+ * @brief Returns true if the L4 header of \b proto starts with
+ *        the 16-bit source and destination port numbers
+ *
+ * @param[in] proto IP Protocol (TCP, UDP, etc.)
+ */
+inline bool
+pktHasPorts (const u8 proto)
+{
+    return (proto == IPPROTO_TCP ||
+            proto == IPPROTO_UDP ||
+            proto == IPPROTO_SCTP);
+}
+
+/**
+ * @name  tuple2str
+ * @brief Converts \e rtacl::tuple<ipv4a> to \e std::string
+ *
+ * @param[in] t IPv4 6-tuple (sa, da, sp, dp, proto, dscp)
+ *
+ * @retval \b t as \e std::string
+ */
+inline std::string
+tuple2str (const rtacl::tuple<ipv4a>& t)
+{
+    char buf[textMax];
+    return std::string(buf, tuple2buf(buf, t));
+}
+
+/**
+ * @name  tuple2str
+ * @brief Converts \e rtacl::tuple<ipv6a> to \e std::string
+ *
+ * @param[in] t IPv6 6-tuple (sa, da, sp, dp, proto, dscp)
+ *
+ * @retval \b t as \e std::string
+ */
+inline std::string
+tuple2str (const rtacl::tuple<ipv6a>& t)
+{
+    char buf[textMax];
+    return std::string(buf, tuple2buf(buf, t));
+}
+
+/**
+ * @name  range2str
+ * @brief Converts \e rtacl::range<ipv4a> to \e std::string
+ *
+ * @param[in] r IPv4 range of 6-tuple (sa, da, sp, dp, proto, dscp)
+ *
+ * @retval \b t as \e std::string
+ */
+inline std::string
+range2str (const rtacl::range<ipv4a>& r)
+{
+    char buf[textMax];
+    return std::string(buf, range2buf(buf, r));
+}
+
+/**
+ * @name  range2str
+ * @brief Converts \e rtacl::range<ipv6a> to \e std::string
+ *
+ * @param[in] r IPv6 range of 6-tuple (sa, da, sp, dp, proto, dscp)
+ *
+ * @retval \b t as \e std::string
+ */
+inline std::string
+range2str (const rtacl::range<ipv6a>& r)
+{
+    char buf[textMax];
+    return std::string(buf, range2buf(buf, r));
+}
+
+/**
+ * @name  field2str
+ * @brief Converts the \b i-th field of a tuple to \e std::string
+ *
+ * @param[in] i Field index (0: src IP, ..., 5: dscp)
+ * @param[in] v Value of the field
+ *
+ * @retval \b v as \e std::string
+ */
+inline std::string
+field2str (const size_t i, const rtacl::ipv4a v)
+{
+    return (i < 2) ? ipv4a2s(v) : std::to_string(static_cast<U32>(v));
+}
+
+inline std::string
+field2str (const size_t i, const rtacl::ipv6a& v)
+{
+    return (i < 2) ? ipv6a2s(v) : std::to_string(static_cast<U32>(v));
+}
+
+/**
+ * @name  fieldMax
+ * @brief Returns the largest value of the \b i-th field
+ *        (e.g., 0xffff for the port numbers)
+ *
+ * @param[in] i Field index (0: src IP, ..., 5: dscp)
+ */
+template <class ADDR>
+inline ADDR fieldMax(const size_t i);
+
+template <>
+inline rtacl::ipv4a
+fieldMax<rtacl::ipv4a> (const size_t i)
+{
+    static const u32 m[dim] = {
+        0xffffffff, 0xffffffff, 0xffff, 0xffff, 0xff, 0xff
+    };
+    return m[i];
+}
+
+template <>
+inline rtacl::ipv6a
+fieldMax<rtacl::ipv6a> (const size_t i)
+{
+    if (i < 2) {
+        return (rtacl::ipv6a(1) << 128) - 1;
+    }
+    return fieldMax<rtacl::ipv4a>(i);
+}
+
+/**
+ * @name  tuple2str
+ * @brief Converts \e rtacl::tuple<ADDR, N> to \e std::string
+ *
+ * @param[in] t Tuple of the first \b N fields (sa, da, sp, ...)
+ *
+ * @retval \b t as \e std::string
+ */
+template <class ADDR, size_t N>
+inline std::string
+tuple2str (const rtacl::tuple<ADDR, N>& t)
+{
+    char buf[textMax];
+    return std::string(buf, tuple2buf(buf, t));
+}
+
+/**
+ * @name  range2str
+ * @brief Converts \e rtacl::range<ADDR, N> to \e std::string
+ *
+ * @param[in] r Range of the first \b N fields (sa, da, sp, ...)
+ *
+ * @retval \b r as \e std::string
+ */
+template <class ADDR, size_t N>
+inline std::string
+range2str (const rtacl::range<ADDR, N>& r)
+{
+    char buf[textMax];
+    return std::string(buf, range2buf(buf, r));
+}
+
+/**
+ * @name  str2numRange
+ * @brief Converts "lo-hi", "n", or "*" to a numerical range
+ *
+ * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in]  s   String to be converted
+ * @param[in]  max The largest value allowed
+ * @param[out] lo  Lower bound
+ * @param[out] hi  Upper bound
+ *
+ * @retval true  Success
+ * @retval false \b s is malformed or out of range
+ */
+template <class ADDR>
+inline bool
+str2numRange (const std::string& s, const u32 max, ADDR& lo, ADDR& hi)
+{
+    if (s == "*") {
+        lo = 0;
+        hi = max;
+        return true;
+    }
+    const char* p = s.c_str();
+    char* end;
+    u64 l = strtoul(p, &end, 0);
+    u64 h = l;
+    if (end == p) {
+        return false;
+    }
+    if (*end == '-') {
+        p = end + 1;
+        h = strtoul(p, &end, 0);
+        if (end == p) {
+            return false;
+        }
+    }
+    if (*end != '\0' || l > h || h > max) {
+        return false;
+    }
+    lo = static_cast<ADDR>(l);
+    hi = static_cast<ADDR>(h);
+    return true;
+}
+
+/**
+ * @name  str2addrRange
+ * @brief Converts "a-b", "a/len", "a", or "*" to an IPv4 address range
+ *
+ * @param[in]  s  String to be converted
+ * @param[out] lo Lower bound
+ * @param[out] hi Upper bound
+ *
+ * @retval true  Success
+ * @retval false \b s is malformed
+ */
+inline bool
+str2addrRange (const std::string& s, rtacl::ipv4a& lo, rtacl::ipv4a& hi)
+{
+    in_addr a;
+    std::string::size_type n;
+
+    if (s == "*") {
+        lo = 0;
+        hi = 0xffffffff;
+        return true;
+    }
+    if ((n = s.find('/')) != std::string::npos) {
+        rtacl::ipv4a len;
+        if (inet_pton(AF_INET, s.substr(0, n).c_str(), &a) != 1 ||
+            !str2numRange(s.substr(n + 1), 32, len, len)) {
+            return false;
+        }
+        u64 host = (1ULL << (32 - len)) - 1;
+        lo = ntohl(a.s_addr) & ~host;
+        hi = lo + host;
+        return true;
+    }
+    n = s.find('-');
+    if (inet_pton(AF_INET, s.substr(0, n).c_str(), &a) != 1) {
+        return false;
+    }
+    lo = ntohl(a.s_addr);
+    hi = lo;
+    if (n != std::string::npos) {
+        if (inet_pton(AF_INET, s.substr(n + 1).c_str(), &a) != 1) {
+            return false;
+        }
+        hi = ntohl(a.s_addr);
+    }
+    return (lo <= hi);
+}
+
+/**
+ * @name  str2addrRange
+ * @brief Converts "a-b", "a/len", "a", or "*" to an IPv6 address range
+ *
+ * @param[in]  s  String to be converted
+ * @param[out] lo Lower bound
+ * @param[out] hi Upper bound
+ *
+ * @retval true  Success
+ * @retval false \b s is malformed
+ */
+inline bool
+str2addrRange (const std::string& s, rtacl::ipv6a& lo, rtacl::ipv6a& hi)
+{
+    in6_addr a;
+    std::string::size_type n;
+
+    if (s == "*") {
+        lo = 0;
+        hi = (rtacl::ipv6a(1) << 128) - 1;
+        return true;
+    }
+    if ((n = s.find('/')) != std::string::npos) {
+        rtacl::ipv6a len;
+        if (inet_pton(AF_INET6, s.substr(0, n).c_str(), &a) != 1 ||
+            !str2numRange(s.substr(n + 1), 128, len, len)) {
+            return false;
+        }
+        int shift = 128 - len.convert_to<int>();
+        rtacl::ipv6a host = (rtacl::ipv6a(1) << shift) - 1;
+        rtacl::ipv6a v = in6a2int<rtacl::ipv6a>(a.s6_addr);
+        lo = v - (v & host);
+        hi = lo + host;
+        return true;
+    }
+    n = s.find('-');
+    if (inet_pton(AF_INET6, s.substr(0, n).c_str(), &a) != 1) {
+        return false;
+    }
+    lo = in6a2int<rtacl::ipv6a>(a.s6_addr);
+    hi = lo;
+    if (n != std::string::npos) {
+        if (inet_pton(AF_INET6, s.substr(n + 1).c_str(), &a) != 1) {
+            return false;
+        }
+        hi = in6a2int<rtacl::ipv6a>(a.s6_addr);
+    }
+    return (lo <= hi);
+}
+
+/**
+ * @name  str2range
+ * @brief Converts a string in the format of \e range2str() to
+ *        \e rtacl::range<ADDR>. Each field can also be a single
+ *        value or "*" (any), and each address can be a prefix
+ *        (e.g., "10.0.0.0/8, *, *, 80, 6, *")
+ *
+ * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ *
+ * @param N    Number of the fields (dimensions)
+ *
+ * @param[in]  s String to be converted
+ * @param[out] r Range of the first \b N fields
+ *               (6-tuple: sa, da, sp, dp, proto, dscp)
+ *
+ * @retval true  Success
+ * @retval false \b s is malformed
+ */
+template <class ADDR, size_t N>
+inline bool
+str2range (const std::string& s, rtacl::range<ADDR, N>& r)
+{
+    static const u32 maxVal[dim] = { 0, 0, 0xffff, 0xffff, 0xff, 0xff };
+    ADDR lo[N];
+    ADDR hi[N];
+    std::string::size_type b = 0;
+    size_t i;
+
+    for (i = 0; i < N; ++i) {
+        std::string::size_type e = s.find(',', b);
+        if ((e == std::string::npos) != (i == N - 1)) {
+            return false;
+        }
+        std::string f = s.substr(b, e - b);
+        f.erase(0, f.find_first_not_of(" \t"));
+        f.erase(f.find_last_not_of(" \t\r\n") + 1);
+        bool rc = (i < 2) ? str2addrRange(f, lo[i], hi[i]) :
+                            str2numRange(f, maxVal[i], lo[i], hi[i]);
+        if (!rc) {
+            return false;
+        }
+        b = e + 1;
+    }
+    const s32 omin = offsetMin;
+    const s32 omax = offsetMax;
+    for (i = 0; i < N; ++i) {
+        lo[i] += omin;
+        hi[i] += omax;
+    }
+    fields<0, N>::set(r.min_corner(), lo);
+    fields<0, N>::set(r.max_corner(), hi);
+    return true;
+}
+
+/*
+ * Class member inline functions
+ */
+
+/**
+ * @name  counters::local
+ * @brief Private function
+ *        Returns the shard of the calling thread (made on the
+ *        first call from the thread)
+ */
+inline counters::shard*
+counters::local ()
+{
+    static thread_local cacheEnt cache[cacheSize];
+    static thread_local size_t next;
+    size_t i;
+
+    for (i = 0; i < cacheSize; ++i) {
+        if (cache[i].id == id) {
+            return cache[i].s;
+        }
+    }
+    std::lock_guard<std::mutex> l(lock);
+    std::unique_ptr<shard>& s = shards[std::this_thread::get_id()];
+    if (!s) {
+        s.reset(new shard);
+    }
+    i = next++ % cacheSize;
+    cache[i].id = id;
+    cache[i].s = s.get();
+    return s.get();
+}
+
+/**
+ * @name  counters::stats
+ * @brief Public function
+ *        Sums up the counts of \b handle in all the shards
+ *
+ * @param[in] handle Payload of the rule
+ *
+ * @retval rtacl::ruleStats Packet and byte counts
+ */
+inline ruleStats
+counters::stats (uintptr_t handle)
+{
+    ruleStats st;
+    std::lock_guard<std::mutex> l(lock);
+    for (auto& s : shards) {
+        std::lock_guard<std::mutex> sl(s.second->lock);
+        auto it = s.second->ctrs.find(handle);
+        if (it != s.second->ctrs.end()) {
+            st.packets += it->second.packets.load(std::memory_order_relaxed);
+            st.bytes += it->second.bytes.load(std::memory_order_relaxed);
+        }
+    }
+    return st;
+}
+
+/**
+ * @name  counters::dump
+ * @brief Public function
+ *        Sums up the counts of all the rules hit so far
+ *
+ * @retval std::map<uintptr_t, rtacl::ruleStats> Counts by payload
+ */
+inline std::map<uintptr_t, ruleStats>
+counters::dump ()
+{
+    std::map<uintptr_t, ruleStats> m;
+    std::lock_guard<std::mutex> l(lock);
+    for (auto& s : shards) {
+        std::lock_guard<std::mutex> sl(s.second->lock);
+        for (auto& c : s.second->ctrs) {
+            ruleStats& st = m[c.first];
+            st.packets += c.second.packets.load(std::memory_order_relaxed);
+            st.bytes += c.second.bytes.load(std::memory_order_relaxed);
+        }
+    }
+    return m;
+}
+
+/**
+ * @name  counters::clear
+ * @brief Public function
+ *        Zeroes all the counts. Counts made by the other threads
+ *        while clearing may survive.
+ */
+inline void
+counters::clear ()
+{
+    std::lock_guard<std::mutex> l(lock);
+    for (auto& s : shards) {
+        std::lock_guard<std::mutex> sl(s.second->lock);
+        for (auto& c : s.second->ctrs) {
+            c.second.packets.store(0, std::memory_order_relaxed);
+            c.second.bytes.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @name  timerWheel<T>::add
+ * @brief Public function
+ *        Adds timer \b t firing at \b when (a time already past
+ *        fires at the next \e advance())
+ */
+template <class T>
+inline void
+timerWheel<T>::add (u64 when, const T& t)
+{
+    place(std::max(when, cur + 1), std::make_pair(when, t));
+}
+
+/**
+ * @name  timerWheel<T>::place
+ * @brief Private function
+ *        Puts \b x into the slot of time \b at (>= \e cur)
+ */
+template <class T>
+inline void
+timerWheel<T>::place (u64 at, const std::pair<u64, T>& x)
+{
+    int l;
+
+    for (l = 0; l < levels; ++l) {
+        const int shift = bits * (l + 1);
+        if ((at >> shift) == (cur >> shift)) {
+            wheel[l][(at >> (bits * l)) & (slots - 1)].push_back(x);
+            ++cnt[l];
+            return;
+        }
+    }
+    far.push_back(x);
+    ++cnt[levels];
+}
+
+/**
+ * @name  timerWheel<T>::advance
+ * @brief Public function
+ *        Moves the current time to \b now, and calls
+ *        \b fire(expiry, timer) for each timer expired
+ *        Idle spans are skipped at the granularity of the finest
+ *        non-empty wheel.
+ */
+template <class T>
+template <class F>
+inline void
+timerWheel<T>::advance (u64 now, F fire)
+{
+    slot tmp;
+    int l;
+
+    while (cur < now) {
+        for (l = 0; l <= levels && cnt[l] == 0; ++l)
+            ;
+        if (l > levels) {
+            cur = now;          // no timers
+            break;
+        }
+        if (l > 0) {
+            /*
+             * Nothing fires before the next slot boundary of level l
+             */
+            const int shift = bits * l;
+            u64 next = (l == levels) ?
+                ((cur >> (bits * levels)) + 1) << (bits * levels) :
+                ((cur >> shift) + 1) << shift;
+            if (next - 1 > cur) {
+                cur = std::min(now, next - 1);
+                if (cur == now) {
+                    break;
+                }
+            }
+        }
+        ++cur;
+        /*
+         * Cascade from the coarsest wheel whose slot starts at cur
+         */
+        if ((cur & ((u64(1) << (bits * levels)) - 1)) == 0 && cnt[levels]) {
+            tmp.swap(far);
+            cnt[levels] = 0;
+            for (auto& x : tmp) {
+                place(std::max(x.first, cur), x);
+            }
+            tmp.clear();
+        }
+        for (l = levels - 1; l > 0; --l) {
+            if ((cur & ((u64(1) << (bits * l)) - 1)) != 0) {
+                continue;
+            }
+            slot& s = wheel[l][(cur >> (bits * l)) & (slots - 1)];
+            if (s.empty()) {
+                continue;
+            }
+            tmp.swap(s);
+            cnt[l] -= tmp.size();
+            for (auto& x : tmp) {
+                place(std::max(x.first, cur), x);
+            }
+            tmp.clear();
+        }
+        slot& s = wheel[0][cur & (slots - 1)];
+        if (!s.empty()) {
+            tmp.swap(s);
+            cnt[0] -= tmp.size();
+            for (auto& x : tmp) {
+                fire(x.first, x.second);
+            }
+            tmp.clear();
+        }
+    }
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::db
+ * @brief Constructor
+ *
+ * @param[in] alloc Allocator of the R-tree nodes
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline
+db<ADDR, VALUE, N, ALLOC>::db (const ALLOC& alloc)
+    : rtree(bgi::quadratic<16>(), bgi::indexable<entry<ADDR, VALUE, N> >(),
+            bgi::equal_to<entry<ADDR, VALUE, N> >(), alloc)
+{
+    init();
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::db
+ * @brief Constructor
+ *        Bulk-loads the entries in [\b first, \b last) with the
+ *        R-tree packing algorithm. The resulting tree has less
+ *        overlap than a tree made by inserting the entries one
+ *        by one.
+ *
+ * @param IT Input iterator of \e rtacl::entry<ADDR>
+ *
+ * @param[in] first First entry
+ * @param[in] last  End of the entries
+ * @param[in] alloc Allocator of the R-tree nodes
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class IT>
+inline
+db<ADDR, VALUE, N, ALLOC>::db (IT first, IT last, const ALLOC& alloc)
+    : rtree(first, last, bgi::quadratic<16>(),
+            bgi::indexable<entry<ADDR, VALUE, N> >(),
+            bgi::equal_to<entry<ADDR, VALUE, N> >(), alloc)
+{
+    init();
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::init
+ * @brief Private function
+ *        Initializes the address family dependent members
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::init ()
+ {
+#ifdef RTACL_EXPLAIN
+     cost = std::make_shared<costShards>();
+#endif
+     if (typeid(ADDR) == typeid(rtacl::ipv4a)) {
+         af = AF_INET;
+         ao = offsetof(sockaddr_in, sin_addr);
+         po = offsetof(sockaddr_in, sin_port);
+     } else {
+         af = AF_INET6;
+         ao = offsetof(sockaddr_in, sin_addr);
+         po = offsetof(sockaddr_in, sin_port);
+     }
+ }
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::insert
+ * @brief Public function
+ *        Inserts \b ent removed by \e tick() at \b expiry
+ *        A timed rule is identified by its range and payload:
+ *        inserting the same entry again moves its expiry, and
+ *        \e remove() cancels it. A later expiry is applied lazily
+ *        when the old one fires, so that a refresh adds nothing
+ *        to the wheel.
+ *
+ * @param[in] ent    Rule
+ * @param[in] expiry Time in the unit of \e tick()
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::insert (entry<ADDR, VALUE, N> const& ent,
+                                   u64 expiry)
+{
+    if (!ttl) {
+        ttl = std::make_shared<ttlState>();
+        ttl->cancel = &ttlState::cancelTimer;
+    }
+    auto it = ttl->lookup(ent);
+    if (it == ttl->timers.end()) {
+        rtree.insert(ent);
+        ttl->timers.emplace(ruleHandle(ent.second),
+                            ttlTimer{ ent, expiry, expiry, false });
+        ttl->wheel.add(expiry, ent);
+        return;
+    }
+    ttlTimer& t = it->second;
+    t.expiry = expiry;
+    if (expiry < t.armed) {
+        /*
+         * Earlier: arm again (the old wheel entry becomes stale)
+         */
+        t.armed = expiry;
+        t.due = false;
+        ttl->wheel.add(expiry, ent);
+        ttl->compact();
+    }
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::ttlState::compact
+ * @brief Private function
+ *        Rebuilds the timer wheel from the live timers when the
+ *        stale entries (left by the cancelled or advanced timers)
+ *        outnumber them, so that the wheel stays O(timed rules)
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::ttlState::compact ()
+{
+    if (wheel.size() <= 2 * timers.size() + 64) {
+        return;
+    }
+    timerWheel<entry<ADDR, VALUE, N> > w(wheel.now());
+    for (auto& t : timers) {
+        if (!t.second.due) {
+            w.add(t.second.armed, t.second.ent);
+        }
+    }
+    wheel = std::move(w);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::tick
+ * @brief Public function
+ *        Advances the time to \b now and removes up to \b budget
+ *        of the expired rules. The rest are removed by the next
+ *        calls, so that a mass expiry does not stall the caller.
+ *
+ * @param[in] now    Current time (any monotonic unit)
+ * @param[in] budget The largest number of the rules to remove
+ *
+ * @retval Number of the rules removed
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline size_t
+db<ADDR, VALUE, N, ALLOC>::tick (u64 now, size_t budget)
+{
+    size_t n = 0;
+
+    if (!ttl) {
+        return 0;
+    }
+    ttlState& t = *ttl;
+    t.wheel.advance(now, [&t](u64 when, const entry<ADDR, VALUE, N>& e) {
+            auto it = t.lookup(e);
+            if (it == t.timers.end() || it->second.due ||
+                it->second.armed != when) {
+                return;         // stale
+            }
+            ttlTimer& r = it->second;
+            if (r.expiry > when) {
+                r.armed = r.expiry;     // refreshed: arm again
+                t.wheel.add(r.expiry, e);
+            } else {
+                r.due = true;
+                t.due.emplace_back(when, e);
+            }
+        });
+    while (n < budget && !t.due.empty()) {
+        std::pair<u64, entry<ADDR, VALUE, N> > d = t.due.front();
+        t.due.pop_front();
+        auto it = t.lookup(d.second);
+        if (it == t.timers.end() || !it->second.due ||
+            it->second.armed != d.first) {
+            continue;           // cancelled or refreshed to earlier
+        }
+        ttlTimer& r = it->second;
+        if (r.expiry > d.first) {
+            r.armed = r.expiry; // refreshed while due
+            r.due = false;
+            t.wheel.add(r.expiry, d.second);
+            continue;
+        }
+        t.timers.erase(it);
+        if (rtree.remove(d.second)) {
+            ++n;
+        }
+    }
+    return n;
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::find
+ * @brief Public function
+ *        Tries to find R-tree entries matching \b key
+ *
+ * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] key ACL search key
+ *
+ * @retval rtacl::result<ADDR, VALUE, N> Search result
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline result<ADDR, VALUE, N>
+db<ADDR, VALUE, N, ALLOC>::find (const tuple<ADDR, N>& key) const
+{
+    result<ADDR, VALUE, N> r;
+#ifdef RTACL_EXPLAIN
+    queryCost c = walk(key, std::back_inserter(r));
+    cost->add(c);
+    size_t n = c.matches;
+#else
+    size_t n = rtree.query(bgi::contains(key), std::back_inserter(r));
+#endif
+    if (n != r.size()) {
+        fprintf(stderr, "n(%ld) != r.size()(%ld)\n", n, r.size());
+    }
+    assert(n == r.size());
+
+    return r;
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::find
+ * @brief Public function
+ *        Tries to find R-tree entries matching \b key and counts
+ *        a packet of \b bytes bytes on each of them if the
+ *        counters are enabled
+ *
+ * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] key   ACL search key
+ * @param[in] bytes Packet length
+ *
+ * @retval rtacl::result<ADDR, VALUE, N> Search result
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline result<ADDR, VALUE, N>
+db<ADDR, VALUE, N, ALLOC>::find (const tuple<ADDR, N>& key, size_t bytes) const
+{
+    result<ADDR, VALUE, N> r = find(key);
+    if (ctrs) {
+        for (auto& e : r) {
+            ctrs->hit(ruleHandle(e.second), bytes);
+        }
+    }
+    return r;
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::classifyPacket
+ * @brief Public function
+ *        Tries to find R-tree entries matching the packet whose
+ *        IPv4/IPv6 header starts at \b l3hdr. The search key is
+ *        extracted from the header bytes directly. The matching
+ *        rules are counted if the counters are enabled.
+ *
+ * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] l3hdr Pointer to the IP header
+ * @param[in] len   Number of bytes available from \b l3hdr
+ *
+ * @retval rtacl::result<ADDR, VALUE, N> Search result (empty if the
+ *                                    packet is not a valid IPv4/IPv6
+ *                                    packet of the address family of
+ *                                    \b db)
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline result<ADDR, VALUE, N>
+db<ADDR, VALUE, N, ALLOC>::classifyPacket (const u8* l3hdr, size_t len) const
+{
+    tuple<ADDR, N> key;
+    if (!parsePkt(l3hdr, len, key)) {
+        return result<ADDR, VALUE, N>();
+    }
+    return find(key, len);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::parsePkt
+ * @brief Private function
+ *        Makes \e rtacl::tuple<ADDR, N> (search key) from a raw IPv4
+ *        header and the TCP/UDP/SCTP header following it.
+ *        Source and destination ports are 0 if the protocol has
+ *        no ports or the packet is a non-first fragment.
+ *
+ * @param ADDR must be \e rtacl::ipv4a (\e s64)
+ *
+ * @param[in]  p   Pointer to the IPv4 header
+ * @param[in]  len Number of bytes available from \b p
+ * @param[out] key Search key
+ *
+ * @retval true  \b key is valid
+ * @retval false Truncated or not an IPv4 packet
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline bool
+db<ADDR, VALUE, N, ALLOC>::parsePkt (const u8* p, size_t len,
+                                  tuple<rtacl::ipv4a, N>& key) const
+{
+    assert(af == AF_INET);
+
+    if (len < sizeof(struct ip) || (p[0] >> 4) != 4) {
+        return false;
+    }
+    size_t hl = (p[0] & 0x0f) << 2;
+    if (hl < sizeof(struct ip) || hl > len) {
+        return false;
+    }
+    u8  proto = p[9];
+    u16 sp = 0;
+    u16 dp = 0;
+    if (pktHasPorts(proto) && (pktRd16(p + 6) & IP_OFFMASK) == 0) {
+        if (len < hl + 2 * sizeof(u16)) {
+            return false;
+        }
+        sp = pktRd16(p + hl);
+        dp = pktRd16(p + hl + sizeof(u16));
+    }
+    setField<0>(key, static_cast<s64>(pktRd32(p + 12)));
+    setField<1>(key, static_cast<s64>(pktRd32(p + 16)));
+    setField<2>(key, static_cast<s64>(sp));
+    setField<3>(key, static_cast<s64>(dp));
+    setField<4>(key, static_cast<s64>(proto));
+    setField<5>(key, static_cast<s64>(p[1] >> 2));
+    return true;
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::parsePkt
+ * @brief Private function
+ *        Makes \e rtacl::tuple<ADDR, N> (search key) from a raw IPv6
+ *        header and the TCP/UDP/SCTP header following it.
+ *        Hop-by-hop, routing, destination options, fragment, and
+ *        AH extension headers are skipped, and the protocol of
+ *        the key is the first upper layer protocol. Source and
+ *        destination ports are 0 if the protocol has no ports or
+ *        the packet is a non-first fragment.
+ *
+ * @param ADDR must be \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in]  p   Pointer to the IPv6 header
+ * @param[in]  len Number of bytes available from \b p
+ * @param[out] key Search key
+ *
+ * @retval true  \b key is valid
+ * @retval false Truncated or not an IPv6 packet
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline bool
+db<ADDR, VALUE, N, ALLOC>::parsePkt (const u8* p, size_t len,
+                                  tuple<rtacl::ipv6a, N>& key) const
+{
+    assert(af == AF_INET6);
+
+    if (len < sizeof(ip6_hdr) || (p[0] >> 4) != 6) {
+        return false;
+    }
+    u8     tc    = ((p[0] & 0x0f) << 4) | (p[1] >> 4);
+    u8     proto = p[6];
+    size_t off   = sizeof(ip6_hdr);
+    bool   first = true;    // false: non-first fragment
+    bool   ext   = true;    // true: \b proto is an extension header
+    while (ext) {
+        switch (proto) {
+        case IPPROTO_HOPOPTS:
+        case IPPROTO_ROUTING:
+        case IPPROTO_DSTOPTS:
+            if (len < off + 2) {
+                return false;
+            }
+            proto = p[off];
+            off  += (static_cast<size_t>(p[off + 1]) + 1) << 3;
+            break;
+        case IPPROTO_AH:
+            if (len < off + 2) {
+                return false;
+            }
+            proto = p[off];
+            off  += (static_cast<size_t>(p[off + 1]) + 2) << 2;
+            break;
+        case IPPROTO_FRAGMENT:
+            if (len < off + sizeof(ip6_frag)) {
+                return false;
+            }
+            proto = p[off];
+            if ((pktRd16(p + off + 2) & ~7) != 0) {
+                /*
+                 * Non-first fragment: the rest of the headers
+                 * are in the first fragment.
+                 */
+                first = false;
+                ext   = false;
+            }
+            off += sizeof(ip6_frag);
+            break;
+        default:
+            ext = false;
+            break;
+        }
+    }
+    u16 sp = 0;
+    u16 dp = 0;
+    if (first && pktHasPorts(proto)) {
+        if (len < off + 2 * sizeof(u16)) {
+            return false;
+        }
+        sp = pktRd16(p + off);
+        dp = pktRd16(p + off + sizeof(u16));
+    }
+    setField<0>(key, in6a2int<s256>(p + 8));
+    setField<1>(key, in6a2int<s256>(p + 24));
+    setField<2>(key, static_cast<s256>(sp));
+    setField<3>(key, static_cast<s256>(dp));
+    setField<4>(key, static_cast<s256>(proto));
+    setField<5>(key, static_cast<s256>(tc >> 2));
+    return true;
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::makeTuple
+ * @brief Private function
+ *        Makes \e rtacl::tuple<ADDR, N> from \e sockaddr_in parameters
+ *
+ * @param ADDR must be \e rtacl::ipv4a (\e s64)
+ *
+ * @param[in]  src    Source IPv4 address and ports
+ * @param[in]  dst    Destination IPv4 address and ports
+ * @param[in]  proto  IP Protocol (TCP, UDP, etc.)
+ * @param[in]  dscp   The value of DSCP
+ * @param[in]  offset One of the followings:
+ *                    \b offsetKey, \b offsetMin, or \b offsetMax
+ * @param[out] result \e rtacl::tuple<rtacl::ipv4a> containing
+ *                    the contents of all input parameters
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::makeTuple (const sockaddr_in& src,
+                                   const sockaddr_in& dst,
+                                   const u8 proto,
+                                   const u8 dscp,
+                                   const s32 offset,
+                                   tuple<rtacl::ipv4a, N>& result)
+{
+    assert(af == AF_INET);
+
+    s64 val;
+
+    val = static_cast<s64>(ntohl(src.sin_addr.s_addr)) + offset;
+    setField<0>(result, val);
+    val = static_cast<s64>(ntohl(dst.sin_addr.s_addr)) + offset;
+    setField<1>(result, val);
+    val = static_cast<s64>(ntohs(src.sin_port)) + offset;
+    setField<2>(result, val);
+    val = static_cast<s64>(ntohs(dst.sin_port)) + offset;
+    setField<3>(result, val);
+    val = static_cast<s64>(proto) + offset;
+    setField<4>(result, val);
+    val = static_cast<s64>(dscp) + offset;
+    setField<5>(result, val);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::makeTuple
+ * @brief Private function
+ *        Makes \e rtacl::tuple<ADDR, N> from \e sockaddr_in parameters
+ *
+ * @param ADDR Must be \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] src    Source IPv6 address and ports
+ * @param[in] dst    Destination IPv6 address and ports
+ * @param[in] proto  IP Protocol (TCP, UDP, etc.)
+ * @param[in] dscp   The value of DSCP
+ * @param[in] offset One of the followings:
+ *                   \b offsetKey, \b offsetMin, or \b offsetMax
+ *
+ * @retval tuple<ADDR, N> Result
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::makeTuple (const sockaddr_in6& src,
+                                   const sockaddr_in6& dst,
+                                   const u8 proto,
+                                   const u8 dscp,
+                                   const s32 offset,
+                                   tuple<rtacl::ipv6a, N>& result)
+{
+    assert(af == AF_INET6);
+
+    s256 val;
+
+    val = sin6a2int<s256>(src) + offset;
+    setField<0>(result, val);
+    val = sin6a2int<s256>(dst) + offset;
+    setField<1>(result, val);
+    val = static_cast<s256>(ntohs(src.sin6_port)) + offset;
+    setField<2>(result, val);
+    val = static_cast<s256>(ntohs(dst.sin6_port)) + offset;
+    setField<3>(result, val);
+    val = static_cast<s256>(proto) + offset;
+    setField<4>(result, val);
+    val = static_cast<s256>(dscp) + offset;
+    setField<5>(result, val);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::makeTuple
+ * @brief Private function
+ *        Makes \e rtacl::tuple<ADDR, N> from \b ADDR parameters
+ *
+ * @param ADDR must be \e rtacl::ipv6a (\e s256)
+ *
+ * @param[in] sa     Source IP address (depending on \b ADDR)
+ * @param[in] da     Destination IP address
+ * @param[in] sp     Source port number
+ * @param[in] dp     Destination port number
+ * @param[in] proto  IP Protocol (TCP, UDP, etc.)
+ * @param[in] dscp   The value of DSCP
+ * @param[in] offset One of the followings:
+ *                   \e offsetKey, \e offsetMin, or \e offsetMax
+ *
+ * @retval tuple<ADDR, N> Result
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::makeTuple (const ADDR sa, const ADDR da,
+                                   const ADDR sp, const ADDR dp,
+                                   const ADDR proto, const ADDR dscp,
+                                   const s32 offset, tuple<ADDR, N>& result)
+{
+    setField<0>(result, sa + offset);
+    setField<1>(result, da + offset);
+    setField<2>(result, sp + offset);
+    setField<3>(result, dp + offset);
+    setField<4>(result, proto + offset);
+    setField<5>(result, dscp + offset);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::makeTuple
+ * @brief Private function
+ *        Makes a tuple of the \b N fields
+ *
+ * @param[in] f      The \b N fields (src IP, dst IP, sport, ...)
+ * @param[in] offset One of the followings:
+ *                   \e offsetKey, \e offsetMin, or \e offsetMax
+ *
+ * @retval tuple<ADDR, N> Result
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::makeTuple (const ADDR f[N], const s32 offset,
+                                   tuple<ADDR, N>& result)
+{
+    ADDR a[N];
+    for (size_t i = 0; i < N; i++) {
+        a[i] = f[i] + offset;
+    }
+    fields<0, N>::set(result, a);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::intersecting
+ * @brief Public function
+ *        Streams the entries sharing at least one point with
+ *        \b region (made by \e makeMin() and \e makeMax()) to
+ *        \b cb in chunks
+ *
+ * @param[in] region Region to search
+ * @param[in] cb     \e bool(const result<ADDR, VALUE, N>&): returns
+ *                   false to stop
+ * @param[in] chunk  The largest number of the entries per call
+ *
+ * @retval Number of the entries delivered
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class CB>
+inline size_t
+db<ADDR, VALUE, N, ALLOC>::intersecting (const range<ADDR, N>& region,
+                                         CB cb, size_t chunk) const
+{
+    ADDR rlo[N], rhi[N];
+
+    fields<0, N>::get(region.min_corner(), rlo);
+    fields<0, N>::get(region.max_corner(), rhi);
+    /*
+     * Both boxes are stored as (lo - 1, hi + 1): boxes meeting
+     * (or 1 apart) at the boundary share no point
+     */
+    auto filter = [&rlo, &rhi](const entry<ADDR, VALUE, N>& e) {
+        ADDR lo[N], hi[N];
+        fields<0, N>::get(e.first.min_corner(), lo);
+        fields<0, N>::get(e.first.max_corner(), hi);
+        for (size_t i = 0; i < N; ++i) {
+            if (std::min(hi[i], rhi[i]) - std::max(lo[i], rlo[i]) < 2) {
+                return false;
+            }
+        }
+        return true;
+    };
+    return regionQuery(bgi::intersects(region), filter, cb, chunk);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::within
+ * @brief Public function
+ *        Streams the entries inside \b region (made by
+ *        \e makeMin() and \e makeMax()) to \b cb in chunks
+ *
+ * @param[in] region Region to search
+ * @param[in] cb     \e bool(const result<ADDR, VALUE, N>&): returns
+ *                   false to stop
+ * @param[in] chunk  The largest number of the entries per call
+ *
+ * @retval Number of the entries delivered
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class CB>
+inline size_t
+db<ADDR, VALUE, N, ALLOC>::within (const range<ADDR, N>& region,
+                                   CB cb, size_t chunk) const
+{
+    return regionQuery(bgi::covered_by(region),
+                       [](const entry<ADDR, VALUE, N>&) { return true; },
+                       cb, chunk);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::regionQuery
+ * @brief Private function
+ *        Passes the entries satisfying \b pred and \b filter to
+ *        \b cb through a buffer of \b chunk entries
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class PRED, class FILTER, class CB>
+inline size_t
+db<ADDR, VALUE, N, ALLOC>::regionQuery (const PRED& pred, FILTER filter,
+                                        CB cb, size_t chunk) const
+{
+    result<ADDR, VALUE, N> buf;
+    size_t n = 0;
+
+    chunk = chunk ? chunk : 1;
+    buf.reserve(chunk);
+    /*
+     * The query iterator walks the tree lazily: stopping here leaves
+     * the rest of the matching nodes unvisited
+     */
+    for (queryIterator it = rtree.qbegin(pred); it != rtree.qend(); ++it) {
+        if (!filter(*it)) {
+            continue;
+        }
+        buf.push_back(*it);
+        if (buf.size() == chunk) {
+            n += buf.size();
+            if (!cb(buf)) {
+                return n;
+            }
+            buf.clear();
+        }
+    }
+    if (!buf.empty()) {
+        n += buf.size();
+        cb(buf);
+    }
+    return n;
+}
+
+/**
+ * @class rtacl::entryVisitor
+ * @brief R-tree visitor calling \b f on every entry in the leaves
+ */
+template <class MEMBERS, class F>
+struct entryVisitor : public MEMBERS::visitor_const {
+    typedef typename MEMBERS::internal_node internalNode;
+    typedef typename MEMBERS::leaf leaf;
+
+    F& f;
+    size_t n;
+
+    explicit entryVisitor (F& f) : f(f), n(0) {};
+    void operator() (const internalNode& node) {
+        namespace rt = bgi::detail::rtree;
+        for (auto& c : rt::elements(node)) {
+            rt::apply_visitor(*this, *c.second);
+        }
+    };
+    void operator() (const leaf& node) {
+        for (auto& e : bgi::detail::rtree::elements(node)) {
+            f(e);
+        }
+        n += bgi::detail::rtree::elements(node).size();
+    };
+};
+
+/**
+ * @class rtacl::subtreeVisitor
+ * @brief R-tree visitor collecting the subtrees at depth \e target
+ *        (or the leaves above it)
+ */
+template <class MEMBERS>
+struct subtreeVisitor : public MEMBERS::visitor_const {
+    typedef typename MEMBERS::internal_node internalNode;
+    typedef typename MEMBERS::leaf leaf;
+
+    size_t target;
+    size_t depth;
+    std::vector<const internalNode*> nodes;
+    std::vector<const leaf*> leaves;
+
+    explicit subtreeVisitor (size_t t) : target(t), depth(0) {};
+    void operator() (const internalNode& node) {
+        namespace rt = bgi::detail::rtree;
+        if (depth == target) {
+            nodes.push_back(&node);
+            return;
+        }
+        ++depth;
+        for (auto& c : rt::elements(node)) {
+            rt::apply_visitor(*this, *c.second);
+        }
+        --depth;
+    };
+    void operator() (const leaf& node) { leaves.push_back(&node); };
+};
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::forEach
+ * @brief Public function
+ *        Calls \b f(const entry<ADDR, VALUE, N>&) on every entry
+ *        in place (nothing is copied)
+ *
+ * @retval Number of the entries visited
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class F>
+inline size_t
+db<ADDR, VALUE, N, ALLOC>::forEach (F f) const
+{
+    typedef bgi::detail::rtree::utilities::view<rtreeType> view;
+    entryVisitor<typename view::members_holder, F> v(f);
+
+    if (rtree.size()) {
+        view rtv(rtree);
+        rtv.apply_visitor(v);
     }
-    inet_ntop(AF_INET6, &sa.sin6_addr, buf, sizeof(buf));
-    std::string s(buf);
-    return s;
+    return v.n;
 }
 
 /**
- * @name  sin6a2int
- * @brief Converts \e sockaddr_in6 to \e INT
- *
- * @param INT Must be either \e ipv6a (\e u128) or
- *            \e rtacl::ipv6a (\e s256)
+ * @name  db<ADDR, VALUE, N, ALLOC>::forEachParallel
+ * @brief Public function
+ *        Calls \b f(const entry<ADDR, VALUE, N>&) on every entry
+ *        from \b nThreads threads, each walking its own subtrees.
+ *        \b f must be safe to call concurrently.
  *
- * @param[in] a IPv6 address as \e sockaddr_in6
+ * @param[in] f        Function called on each entry
+ * @param[in] nThreads Number of the threads (0: one per CPU)
  *
- * @retval \e sin6.sin6_addr as \e INT
+ * @retval Number of the entries visited
  */
-template <class INT>
-inline INT
-sin6a2int (const sockaddr_in6& sin6)
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class F>
+inline size_t
+db<ADDR, VALUE, N, ALLOC>::forEachParallel (F f, size_t nThreads) const
 {
-    INT addr;
-    size_t i;
-    for (i = 0; i < elementsof(sin6.sin6_addr.s6_addr) - 1; ++i) {
-        addr |= sin6.sin6_addr.s6_addr[i];
-        addr <<= 8;
+    typedef bgi::detail::rtree::utilities::view<rtreeType> view;
+    typedef typename view::members_holder members;
+    size_t target = 0;
+
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
     }
-    addr |= sin6.sin6_addr.s6_addr[i];
-    return addr;
+    if (rtree.size() == 0) {
+        return 0;
+    }
+    view rtv(rtree);
+    /*
+     * Go down until there are 4 subtrees per thread
+     */
+    subtreeVisitor<members> sub(target);
+    for (;;) {
+        subtreeVisitor<members> s(target);
+        rtv.apply_visitor(s);
+        sub = s;
+        if (s.nodes.size() + s.leaves.size() >= 4 * nThreads ||
+            s.nodes.empty()) {
+            break;
+        }
+        ++target;
+    }
+    size_t nTasks = sub.nodes.size() + sub.leaves.size();
+    std::atomic<size_t> next(0), total(0);
+    auto work = [&]() {
+        entryVisitor<members, F> v(f);
+        size_t i;
+        while ((i = next.fetch_add(1)) < nTasks) {
+            if (i < sub.nodes.size()) {
+                v(*sub.nodes[i]);
+            } else {
+                v(*sub.leaves[i - sub.nodes.size()]);
+            }
+        }
+        total += v.n;
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(nThreads, nTasks); ++t) {
+        threads.push_back(std::thread(work));
+    }
+    work();
+    for (auto& t : threads) {
+        t.join();
+    }
+    return total.load();
 }
 
 /**
- * @name  int2sin6
- * @brief Converts \b INT to \e sockaddr_in6
- *
- * @param INT Must be either \e ipv6a (\e u128) or
- *            \e rtacl::ipv6a (\e u256)
+ * @name  db<ADDR, VALUE, N, ALLOC>::exportText
+ * @brief Public function
+ *        Writes all the entries to \b fp as text, one per line:
+ *        "<range2str()>: <ruleHandle(payload)>"
+ *        The lines are formatted by \e range2buf() into a 64KB
+ *        buffer and the entries are visited in place by
+ *        \e forEach(), so nothing is allocated per entry.
  *
- * @param[in] a IPv6 address as \e INT
+ * @param[in] fp Output stream
  *
- * @retval IPv6 address as \e sockaddr_in6
+ * @retval true  Success
+ * @retval false Write error
  */
-template <class INT>
-inline sockaddr_in6
-int2sin6 (const INT& addr)
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline bool
+db<ADDR, VALUE, N, ALLOC>::exportText (FILE* fp) const
 {
-    sockaddr_in6 sin6;
-    size_t max = elementsof(sin6.sin6_addr.s6_addr) - 1;
-    size_t i;
-    for (i = 0; i <= max; ++i) {
-        u8 n = static_cast<u8>(addr >> (i << 3));
-        sin6.sin6_addr.s6_addr[max - i] = n;
-    }
-    return sin6;
+    return exportTo([fp](const char* p, size_t n) {
+            return fwrite(p, 1, n, fp) == n;
+        });
 }
 
 /**
- * @name  tuple2str
- * @brief Converts \e rtacl::tuple<ipv4a> to \e std::string
+ * @name  db<ADDR, VALUE, N, ALLOC>::exportText
+ * @brief Public function
+ *        Writes all the entries to the file descriptor \b fd
+ *        as text (see \e exportText(FILE*))
  *
- * @param[in] t IPv4 6-tuple (sa, da, sp, dp, proto, dscp)
+ * @param[in] fd Output file descriptor
  *
- * @retval \b t as \e std::string
+ * @retval true  Success
+ * @retval false Write error (\e errno is set)
  */
-inline std::string
-tuple2str (const rtacl::tuple<ipv4a>& t)
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline bool
+db<ADDR, VALUE, N, ALLOC>::exportText (int fd) const
 {
-    return (boost::format("%s, %s, %d, %d, %d, %d")
-            % rtacl::ipv4a2s(t.get<0>())
-            % rtacl::ipv4a2s(t.get<1>())
-            % static_cast<U32>(t.get<2>())
-            % static_cast<U32>(t.get<3>())
-            % static_cast<U32>(t.get<4>())
-            % static_cast<U32>(t.get<5>())).str();
+    return exportTo([fd](const char* p, size_t n) {
+            while (n) {
+                ssize_t w = write(fd, p, n);
+                if (w < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                p += w;
+                n -= w;
+            }
+            return true;
+        });
 }
 
 /**
- * @name  tuple2str
- * @brief Converts \e rtacl::tuple<ipv6a> to \e std::string
- *
- * @param[in] t IPv6 6-tuple (sa, da, sp, dp, proto, dscp)
+ * @name  db<ADDR, VALUE, N, ALLOC>::exportTo
+ * @brief Private function
+ *        Formats the entries into a buffer and passes it to
+ *        \b out(const char*, size_t) whenever it is nearly full
  *
- * @retval \b t as \e std::string
+ * @param[in] out Writer returning false on an error
  */
-inline std::string
-tuple2str (const rtacl::tuple<ipv6a>& t)
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class OUT>
+inline bool
+db<ADDR, VALUE, N, ALLOC>::exportTo (OUT out) const
 {
-    return (boost::format("%s, %s, %d, %d, %d, %d")
-            % rtacl::ipv6a2s(t.get<0>())
-            % rtacl::ipv6a2s(t.get<1>())
-            % static_cast<U32>(t.get<2>())
-            % static_cast<U32>(t.get<3>())
-            % static_cast<U32>(t.get<4>())
-            % static_cast<U32>(t.get<5>())).str();
+    enum {
+        bufSize = 65536,
+        lineMax = textMax + 32,
+    };
+    std::unique_ptr<char[]> buf(new char[bufSize]);
+    char* p = buf.get();
+    bool ok = true;
+
+    forEach([&](const entry<ADDR, VALUE, N>& e) {
+            if (!ok) {
+                return;
+            }
+            p = range2buf(p, e.first);
+            *p++ = ':';
+            *p++ = ' ';
+            p = u64toBuf(p, ruleHandle(e.second));
+            *p++ = '\n';
+            if (p > buf.get() + bufSize - lineMax) {
+                ok = out(buf.get(), p - buf.get());
+                p = buf.get();
+            }
+        });
+    if (ok && p > buf.get()) {
+        ok = out(buf.get(), p - buf.get());
+    }
+    return ok;
 }
 
 /**
- * @name  range2str
- * @brief Converts \e rtacl::range<ipv4a> to \e std::string
+ * @name  db<ADDR, VALUE, N, ALLOC>::dump
+ * @brief Public function
+ *        Returns a copy of the entire R-tree entries
  *
- * @param[in] r IPv4 range of 6-tuple (sa, da, sp, dp, proto, dscp)
+ * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
  *
- * @retval \b t as \e std::string
+ * @retval rtacl::result<ADDR, VALUE, N> A copy of the entire entries
  */
-inline std::string
-range2str (const rtacl::range<ipv4a>& r)
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline result<ADDR, VALUE, N>
+db<ADDR, VALUE, N, ALLOC>::dump () const
 {
-    return (boost::format("%s-%s, %s-%s, %d-%d, %d-%d, %d-%d, %d-%d")
-            % rtacl::ipv4a2s(r.min_corner().get<0>() + 1)
-            % rtacl::ipv4a2s(r.max_corner().get<0>() - 1)
-            % rtacl::ipv4a2s(r.min_corner().get<1>() + 1)
-            % rtacl::ipv4a2s(r.max_corner().get<1>() - 1)
-            % static_cast<U32>(r.min_corner().get<2>() + 1)
-            % static_cast<U32>(r.max_corner().get<2>() - 1)
-            % static_cast<U32>(r.min_corner().get<3>() + 1)
-            % static_cast<U32>(r.max_corner().get<3>() - 1)
-            % static_cast<U32>(r.min_corner().get<4>() + 1)
-            % static_cast<U32>(r.max_corner().get<4>() - 1)
-            % static_cast<U32>(r.min_corner().get<5>() + 1)
-            % static_cast<U32>(r.max_corner().get<5>() - 1)).str();
+    /*
+     * Get an entire copy of the entries
+     */
+    result<ADDR, VALUE, N> r;
+    r.reserve(rtree.size());
+    forEach([&r](const entry<ADDR, VALUE, N>& e) { r.push_back(e); });
+
+    return r;
 }
 
 /**
- * @name  range2str
- * @brief Converts \e rtacl::range<ipv6a> to \e std::string
- *
- * @param[in] r IPv6 range of 6-tuple (sa, da, sp, dp, proto, dscp)
+ * @class rtacl::costVisitor
+ * @brief R-tree visitor doing a \e bgi::contains query and counting
+ *        the nodes and the entries it touches
+ */
+template <class MEMBERS, class KEY, class OUT>
+struct costVisitor : public MEMBERS::visitor_const {
+    typedef typename MEMBERS::internal_node internalNode;
+    typedef typename MEMBERS::leaf leaf;
+
+    const KEY& key;
+    OUT out;
+    queryCost cost;
+    u32 level;
+
+    costVisitor (const KEY& k, OUT o) : key(k), out(o), level(0) {};
+    void operator() (const internalNode& n) {
+        namespace rt = bgi::detail::rtree;
+        u32 hits = 0;
+        count();
+        ++level;
+        for (auto& c : rt::elements(n)) {
+            ++cost.boxes;
+            if (bg::covered_by(key, c.first)) {
+                ++hits;
+                rt::apply_visitor(*this, *c.second);
+            }
+        }
+        --level;
+        cost.overlaps += (hits > 1);
+    };
+    void operator() (const leaf& n) {
+        count();
+        ++cost.leaves;
+        for (auto& e : bgi::detail::rtree::elements(n)) {
+            ++cost.tested;
+            if (bg::within(key, e.first)) {
+                ++cost.matches;
+                *out++ = e;
+            }
+        }
+    };
+private:
+    void count () {
+        if (level < queryCost::maxLevels) {
+            ++cost.nodes[level];
+        }
+        cost.levels = std::max(cost.levels, level + 1);
+    };
+};
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::walk
+ * @brief Private function
+ *        Writes the entries matching \b key to \b out as
+ *        \e query() does, counting the work done
  *
- * @retval \b t as \e std::string
+ * @retval rtacl::queryCost Nodes visited and entries tested
  */
-inline std::string
-range2str (const rtacl::range<ipv6a>& r)
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+template <class OUT>
+inline queryCost
+db<ADDR, VALUE, N, ALLOC>::walk (const tuple<ADDR, N>& key, OUT out) const
 {
-    return (boost::format("%s-%s, %s-%s, %d-%d, %d-%d, %d-%d, %d-%d")
-            % ipv6a2s(r.min_corner().get<0>() + 1)
-            % ipv6a2s(r.max_corner().get<0>() - 1)
-            % ipv6a2s(r.min_corner().get<1>() + 1)
-            % ipv6a2s(r.max_corner().get<1>() - 1)
-            % static_cast<U32>(r.min_corner().get<2>() + 1)
-            % static_cast<U32>(r.max_corner().get<2>() - 1)
-            % static_cast<U32>(r.min_corner().get<3>() + 1)
-            % static_cast<U32>(r.max_corner().get<3>() - 1)
-            % static_cast<U32>(r.min_corner().get<4>() + 1)
-            % static_cast<U32>(r.max_corner().get<4>() - 1)
-            % static_cast<U32>(r.min_corner().get<5>() + 1)
-            % static_cast<U32>(r.max_corner().get<5>() - 1)).str();
+    typedef bgi::detail::rtree::utilities::view<rtreeType> view;
+    costVisitor<typename view::members_holder, tuple<ADDR, N>, OUT>
+        v(key, out);
+
+    if (rtree.size()) {
+        view rtv(rtree);
+        rtv.apply_visitor(v);
+    }
+    return v.cost;
 }
 
-/*
- * Class member inline functions
+/**
+ * @class rtacl::qualityVisitor
+ * @brief R-tree visitor measuring \e rtacl::treeQuality
  */
+template <class MEMBERS, class ADDR, size_t N>
+struct qualityVisitor : public MEMBERS::visitor_const {
+    typedef typename MEMBERS::internal_node internalNode;
+    typedef typename MEMBERS::leaf leaf;
+
+    size_t maxElements;
+    treeQuality q;
+    size_t level;
+    double fillSum;
+    double overlapSum;
+    double deadSum;
+
+    explicit qualityVisitor (size_t m)
+        : maxElements(m), level(0), fillSum(0), overlapSum(0), deadSum(0) {};
+    void operator() (const internalNode& n) {
+        namespace rt = bgi::detail::rtree;
+        ++q.nodes;
+        measure(rt::elements(n), true);
+        ++level;
+        for (auto& c : rt::elements(n)) {
+            rt::apply_visitor(*this, *c.second);
+        }
+        --level;
+    };
+    void operator() (const leaf& n) {
+        ++q.leaves;
+        q.entries += bgi::detail::rtree::elements(n).size();
+        q.levels = std::max(q.levels, level + 1);
+        measure(bgi::detail::rtree::elements(n), false);
+    };
+    const treeQuality& result () {
+        size_t all = q.nodes + q.leaves;
+        if (all) {
+            q.fill = fillSum / all;
+        }
+        if (q.nodes) {
+            q.overlap = overlapSum / q.nodes;
+            q.deadSpace = deadSum / q.nodes;
+        }
+        return q;
+    };
+private:
+    /*
+     * Box of element i in \e lo[i], \e hi[i]. The rules of a leaf
+     * overlap by design, so only the fill of a leaf is measured.
+     */
+    template <class ELEMS>
+    void measure (const ELEMS& el, bool internal) {
+        const size_t n = el.size();
+        std::vector<std::array<double, N> > lo(n), hi(n);
+        std::array<double, N> envLo, envHi;
+        ADDR a[N];
+        double volSum = 0, ovl = 0;
+        size_t i, j, d;
+
+        fillSum += static_cast<double>(n) / maxElements;
+        if (n == 0 || !internal) {
+            return;
+        }
+        for (i = 0; i < n; ++i) {
+            const range<ADDR, N>& b = indexable(el[i]);
+            fields<0, N>::get(b.min_corner(), a);
+            for (d = 0; d < N; ++d) {
+                lo[i][d] = static_cast<double>(a[d]);
+            }
+            fields<0, N>::get(b.max_corner(), a);
+            for (d = 0; d < N; ++d) {
+                hi[i][d] = static_cast<double>(a[d]);
+            }
+            volSum += volume(lo[i].data(), hi[i].data());
+        }
+        envLo = lo[0];
+        envHi = hi[0];
+        for (i = 1; i < n; ++i) {
+            for (d = 0; d < N; ++d) {
+                envLo[d] = std::min(envLo[d], lo[i][d]);
+                envHi[d] = std::max(envHi[d], hi[i][d]);
+            }
+        }
+        for (i = 0; i < n; ++i) {
+            for (j = i + 1; j < n; ++j) {
+                double v = 1;
+                for (d = 0; d < N && v > 0; ++d) {
+                    v *= std::max(0.0, std::min(hi[i][d], hi[j][d]) -
+                                  std::max(lo[i][d], lo[j][d]));
+                }
+                ovl += v;
+            }
+        }
+        double env = volume(envLo.data(), envHi.data());
+        if (env > 0) {
+            overlapSum += ovl / env;
+            deadSum += std::max(0.0, 1.0 - volSum / env);
+        }
+    };
+    static double volume (const double* lo, const double* hi) {
+        double v = 1;
+        for (size_t d = 0; d < N; ++d) {
+            v *= hi[d] - lo[d];
+        }
+        return v;
+    };
+    template <class E>
+    static const range<ADDR, N>& indexable (const E& e) { return e.first; };
+};
 
 /**
- * @name  db<ADDR>::db
- * @brief Constructor
+ * @name  db<ADDR, VALUE, N, ALLOC>::quality
+ * @brief Public function
+ *        Measures the depth, the fill factor, the overlap, and the
+ *        dead space of the R-tree (visits all the nodes)
+ *
+ * @retval rtacl::treeQuality Tree quality metrics
  */
-template <class ADDR>
-inline
-db<ADDR>::db ()
- {
-     if (typeid(ADDR) == typeid(rtacl::ipv4a)) {
-         af = AF_INET;
-         ao = offsetof(sockaddr_in, sin_addr);
-         po = offsetof(sockaddr_in, sin_port);
-     } else {
-         af = AF_INET6;
-         ao = offsetof(sockaddr_in, sin_addr);
-         po = offsetof(sockaddr_in, sin_port);
-     }
- }
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline treeQuality
+db<ADDR, VALUE, N, ALLOC>::quality () const
+{
+    typedef bgi::detail::rtree::utilities::view<rtreeType> view;
+    qualityVisitor<typename view::members_holder, ADDR, N>
+        v(rtree.parameters().get_max_elements());
+
+    if (rtree.size()) {
+        view rtv(rtree);
+        rtv.apply_visitor(v);
+    }
+    return v.result();
+}
 
 /**
- * @name  db<ADDR>::find
+ * @name  db<ADDR, VALUE, N, ALLOC>::repack
  * @brief Public function
- *        Tries to find R-tree entries matching \b key
- *
- * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
- *
- * @param[in] key ACL search key
+ *        Rebuilds the R-tree by packing (STR bulk loading) the
+ *        entries, which removes the overlap and the underfilled
+ *        nodes left by the inserts and removes
+ */
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline void
+db<ADDR, VALUE, N, ALLOC>::repack ()
+{
+    rtreeType t(rtree.begin(), rtree.end(), rtree.parameters(),
+                rtree.indexable_get(), rtree.value_eq(),
+                rtree.get_allocator());
+    rtree.swap(t);
+}
+
+/**
+ * @name  db<ADDR, VALUE, N, ALLOC>::memoryUsage
+ * @brief Public function
+ *        Breaks down the memory used by the R-tree. The total is
+ *        measured if \b ALLOC is \e rtacl::countingAllocator,
+ *        otherwise it is estimated from the number of the nodes.
  *
- * @retval rtacl::result<ADDR> Search result
+ * @retval rtacl::memUsage Memory footprint
  */
-template <class ADDR>
-inline result<ADDR>
-db<ADDR>::find (const tuple<ADDR>& key)
+template <class ADDR, class VALUE, size_t N, class ALLOC>
+inline memUsage
+db<ADDR, VALUE, N, ALLOC>::memoryUsage () const
 {
-    result<ADDR> r;
-    size_t n = rtree.query(bgi::contains(key), std::back_inserter(r));
-    if (n != r.size()) {
-        fprintf(stderr, "n(%ld) != r.size()(%ld)\n", n, r.size());
-    }
-    assert(n == r.size());
+    typedef bgi::detail::rtree::utilities::view<rtreeType> view;
+    typedef typename view::members_holder::node node;
+    memUsage m;
+    size_t children;
 
-    return r;
+    view v(rtree);
+    auto st = bgi::detail::rtree::utilities::statistics(v);
+    m.levels = boost::get<0>(st);
+    m.internalNodes = boost::get<1>(st);
+    m.leaves = boost::get<2>(st);
+    m.rules = boost::get<3>(st);
+    m.nodeSize = sizeof(node);
+
+    children = m.internalNodes + m.leaves;
+    children = children ? children - 1 : 0;    // all but the root
+    m.internalBytes = children * (sizeof(range<ADDR, N>) + sizeof(void*));
+    m.leafBytes = m.rules * sizeof(range<ADDR, N>);
+    m.payloadBytes = m.rules * (sizeof(entry<ADDR, VALUE, N>) -
+                                sizeof(range<ADDR, N>));
+    m.measured = allocatedBytes(rtree.get_allocator(), m.total);
+    if (!m.measured) {
+        m.total = (m.internalNodes + m.leaves) * m.nodeSize;
+    }
+    size_t used = m.internalBytes + m.leafBytes + m.payloadBytes;
+    m.slackBytes = (m.total > used) ? m.total - used : 0;
+    return m;
 }
 
 /**
- * @name  db<ADDR>::makeTuple
+ * @name  dualDb::mapped2v4
  * @brief Private function
- *        Makes \e rtacl::tuple<ADDR> from \e sockaddr_in parameters
+ *        Converts an IPv6 entry to an IPv4 entry if its source and
+ *        destination address ranges are inside ::ffff:0:0/96
  *
- * @param ADDR must be \e rtacl::ipv4a (\e s64)
+ * @param[in]  e6 IPv6 R-tree ACL entry
+ * @param[out] e4 IPv4 R-tree ACL entry
  *
- * @param[in]  src    Source IPv4 address and ports
- * @param[in]  dst    Destination IPv4 address and ports
- * @param[in]  proto  IP Protocol (TCP, UDP, etc.)
- * @param[in]  dscp   The value of DSCP
- * @param[in]  offset One of the followings:
- *                    \b offsetKey, \b offsetMin, or \b offsetMax
- * @param[out] result \e rtacl::tuple<rtacl::ipv4a> containing
- *                    the contents of all input parameters
+ * @retval true  \b e4 is valid
+ * @retval false \b e6 is not an IPv4-mapped entry
  */
-template <class ADDR>
-inline void
-db<ADDR>::makeTuple (const sockaddr_in& src,
-                     const sockaddr_in& dst,
-                     const u8 proto,
-                     const u8 dscp,
-                     const s32 offset,
-                     tuple<rtacl::ipv4a>& result)
+inline bool
+dualDb::mapped2v4 (const entry<ipv6a>& e6, entry<ipv4a>& e4)
 {
-    assert(af == AF_INET);
-
-    s64 val;
+    static const ipv6a lo = ipv6a(0xffff) << 32;
+    static const ipv6a hi = lo + 0xffffffff;
+    const tuple<ipv6a>& min6 = e6.first.min_corner();
+    const tuple<ipv6a>& max6 = e6.first.max_corner();
 
-    val = static_cast<s64>(ntohl(src.sin_addr.s_addr)) + offset;
-    bg::set<0>(result, val);
-    val = static_cast<s64>(ntohl(dst.sin_addr.s_addr)) + offset;
-    bg::set<1>(result, val);
-    val = static_cast<s64>(ntohs(src.sin_port)) + offset;
-    bg::set<2>(result, val);
-    val = static_cast<s64>(ntohs(dst.sin_port)) + offset;
-    bg::set<3>(result, val);
-    val = static_cast<s64>(proto) + offset;
-    bg::set<4>(result, val);
-    val = static_cast<s64>(dscp) + offset;
-    bg::set<5>(result, val);
+    if (min6.get<0>() + 1 < lo || max6.get<0>() - 1 > hi ||
+        min6.get<1>() + 1 < lo || max6.get<1>() - 1 > hi) {
+        return false;
+    }
+    tuple<ipv4a>& min4 = e4.first.min_corner();
+    tuple<ipv4a>& max4 = e4.first.max_corner();
+    bg::set<0>(min4, static_cast<s64>(min6.get<0>() - lo));
+    bg::set<1>(min4, static_cast<s64>(min6.get<1>() - lo));
+    bg::set<2>(min4, static_cast<s64>(min6.get<2>()));
+    bg::set<3>(min4, static_cast<s64>(min6.get<3>()));
+    bg::set<4>(min4, static_cast<s64>(min6.get<4>()));
+    bg::set<5>(min4, static_cast<s64>(min6.get<5>()));
+    bg::set<0>(max4, static_cast<s64>(max6.get<0>() - lo));
+    bg::set<1>(max4, static_cast<s64>(max6.get<1>() - lo));
+    bg::set<2>(max4, static_cast<s64>(max6.get<2>()));
+    bg::set<3>(max4, static_cast<s64>(max6.get<3>()));
+    bg::set<4>(max4, static_cast<s64>(max6.get<4>()));
+    bg::set<5>(max4, static_cast<s64>(max6.get<5>()));
+    e4.second = e6.second;
+    return true;
 }
 
 /**
- * @name  db<ADDR>::makeTuple
+ * @name  dualDb::overlapsMapped
  * @brief Private function
- *        Makes \e rtacl::tuple<ADDR> from \e sockaddr_in parameters
+ *        Returns true if both the source and the destination
+ *        address ranges of \b e6 overlap ::ffff:0:0/96
  *
- * @param ADDR Must be \e rtacl::ipv6a (\e s256)
+ * @param[in] e6 IPv6 R-tree ACL entry
+ */
+inline bool
+dualDb::overlapsMapped (const entry<ipv6a>& e6)
+{
+    static const ipv6a lo = ipv6a(0xffff) << 32;
+    static const ipv6a hi = lo + 0xffffffff;
+    const tuple<ipv6a>& min6 = e6.first.min_corner();
+    const tuple<ipv6a>& max6 = e6.first.max_corner();
+
+    return (min6.get<0>() + 1 <= hi && max6.get<0>() - 1 >= lo &&
+            min6.get<1>() + 1 <= hi && max6.get<1>() - 1 >= lo);
+}
+
+/**
+ * @name  dualDb::mappedKey
+ * @brief Private function
+ *        Makes the IPv4 key of an IPv6 packet whose source and
+ *        destination addresses are IPv4-mapped
  *
- * @param[in] src    Source IPv6 address and ports
- * @param[in] dst    Destination IPv6 address and ports
- * @param[in] proto  IP Protocol (TCP, UDP, etc.)
- * @param[in] dscp   The value of DSCP
- * @param[in] offset One of the followings:
- *                   \b offsetKey, \b offsetMin, or \b offsetMax
+ * @param[in]  l3hdr IPv6 header
+ * @param[in]  k6    IPv6 key made from \b l3hdr
+ * @param[out] k4    IPv4 key
+ */
+inline void
+dualDb::mappedKey (const u8* l3hdr, const tuple<ipv6a>& k6,
+                   tuple<ipv4a>& k4)
+{
+    bg::set<0>(k4, static_cast<s64>(pktRd32(l3hdr + 20)));
+    bg::set<1>(k4, static_cast<s64>(pktRd32(l3hdr + 36)));
+    bg::set<2>(k4, static_cast<s64>(k6.get<2>()));
+    bg::set<3>(k4, static_cast<s64>(k6.get<3>()));
+    bg::set<4>(k4, static_cast<s64>(k6.get<4>()));
+    bg::set<5>(k4, static_cast<s64>(k6.get<5>()));
+}
+
+/**
+ * @name  dualDb::mappedKey
+ * @brief Private function
+ *        Makes the IPv6 key of an IPv4 flow from its IPv4 key by
+ *        mapping the addresses into ::ffff:0:0/96
  *
- * @retval tuple<ADDR> Result
+ * @param[in]  k4 IPv4 key
+ * @param[out] k6 IPv6 key (::ffff:a.b.c.d)
  */
-template <class ADDR>
 inline void
-db<ADDR>::makeTuple (const sockaddr_in6& src,
-                     const sockaddr_in6& dst,
-                     const u8 proto,
-                     const u8 dscp,
-                     const s32 offset,
-                     tuple<rtacl::ipv6a>& result)
+dualDb::mappedKey (const tuple<ipv4a>& k4, tuple<ipv6a>& k6)
 {
-    assert(af == AF_INET6);
+    static const ipv6a lo = ipv6a(0xffff) << 32;
 
-    s256 val;
+    bg::set<0>(k6, lo + k4.get<0>());
+    bg::set<1>(k6, lo + k4.get<1>());
+    bg::set<2>(k6, ipv6a(k4.get<2>()));
+    bg::set<3>(k6, ipv6a(k4.get<3>()));
+    bg::set<4>(k6, ipv6a(k4.get<4>()));
+    bg::set<5>(k6, ipv6a(k4.get<5>()));
+}
 
-    val = sin6a2int<s256>(src) + offset;
-    bg::set<0>(result, val);
-    val = sin6a2int<s256>(dst) + offset;
-    bg::set<1>(result, val);
-    val = static_cast<s256>(ntohs(src.sin6_port)) + offset;
-    bg::set<2>(result, val);
-    val = static_cast<s256>(ntohs(dst.sin6_port)) + offset;
-    bg::set<3>(result, val);
-    val = static_cast<s256>(proto) + offset;
-    bg::set<4>(result, val);
-    val = static_cast<s256>(dscp) + offset;
-    bg::set<5>(result, val);
+/**
+ * @name  dualDb::insert
+ * @brief Public function
+ *        Inserts an IPv6 entry (into the IPv4 tree if it is an
+ *        IPv4-mapped entry)
+ *
+ * @param[in] ent IPv6 R-tree ACL entry
+ */
+inline void
+dualDb::insert (entry<ipv6a> const& ent)
+{
+    entry<ipv4a> e4;
+    if (mapped2v4(ent, e4)) {
+        db4.insert(e4);
+    } else {
+        db6.insert(ent);
+        mapped6 += overlapsMapped(ent);
+    }
 }
 
 /**
- * @name  db<ADDR>::makeTuple
- * @brief Private function
- *        Makes \e rtacl::tuple<ADDR> from \b ADDR parameters
+ * @name  dualDb::remove
+ * @brief Public function
+ *        Removes an IPv6 entry inserted by \e dualDb::insert()
  *
- * @param ADDR must be \e rtacl::ipv6a (\e s256)
+ * @param[in] ent IPv6 R-tree ACL entry
  *
- * @param[in] sa     Source IP address (depending on \b ADDR)
- * @param[in] da     Destination IP address
- * @param[in] sp     Source port number
- * @param[in] dp     Destination port number
- * @param[in] proto  IP Protocol (TCP, UDP, etc.)
- * @param[in] dscp   The value of DSCP
- * @param[in] offset One of the followings:
- *                   \e offsetKey, \e offsetMin, or \e offsetMax
+ * @retval true  Removed
+ * @retval false Not found
+ */
+inline bool
+dualDb::remove (entry<ipv6a> const& ent)
+{
+    entry<ipv4a> e4;
+    if (mapped2v4(ent, e4)) {
+        return db4.remove(e4);
+    }
+    if (!db6.remove(ent)) {
+        return false;
+    }
+    mapped6 -= overlapsMapped(ent);
+    return true;
+}
+
+/**
+ * @name  dualDb::find
+ * @brief Public function
+ *        Tries to find R-tree entries matching the 6-tuple.
+ *        The IPv4 tree is used if both \b src and \b dst are
+ *        \e sockaddr_in or IPv4-mapped \e sockaddr_in6. The
+ *        IPv6 rules overlapping the mapped space match both in
+ *        \b r.v6.
  *
- * @retval tuple<ADDR> Result
+ * @param[in]  src   Source address and port
+ *                   (\e sockaddr_in or \e sockaddr_in6)
+ * @param[in]  dst   Destination address and port
+ *                   (same address family as \b src)
+ * @param[in]  proto IP Protocol (TCP, UDP, etc.)
+ * @param[in]  dscp  The value of DSCP
+ * @param[out] r     Search result (\b r.af is AF_UNSPEC if the
+ *                   address families are invalid)
  */
-template <class ADDR>
 inline void
-db<ADDR>::makeTuple (const ADDR sa, const ADDR da,
-                     const ADDR sp, const ADDR dp,
-                     const ADDR proto, const ADDR dscp,
-                     const s32 offset, tuple<ADDR>& result)
+dualDb::find (const sockaddr* src, const sockaddr* dst,
+              const u8 proto, const u8 dscp, dualResult& r)
 {
-    bg::set<0>(result, sa + offset);
-    bg::set<1>(result, da + offset);
-    bg::set<2>(result, sp + offset);
-    bg::set<3>(result, dp + offset);
-    bg::set<4>(result, proto + offset);
-    bg::set<5>(result, dscp + offset);
+    r.v4.clear();
+    r.v6.clear();
+    if (src->sa_family != dst->sa_family) {
+        r.af = AF_UNSPEC;
+        return;
+    }
+    if (src->sa_family == AF_INET) {
+        const sockaddr_in* s = reinterpret_cast<const sockaddr_in*>(src);
+        const sockaddr_in* d = reinterpret_cast<const sockaddr_in*>(dst);
+        tuple<ipv4a> key;
+        db4.makeKey(*s, *d, proto, dscp, key);
+        r.af = AF_INET;
+        r.v4 = db4.find(key);
+        if (mapped6) {
+            tuple<ipv6a> k6;
+            mappedKey(key, k6);
+            r.v6 = db6.find(k6);
+        }
+    } else if (src->sa_family == AF_INET6) {
+        const sockaddr_in6* s = reinterpret_cast<const sockaddr_in6*>(src);
+        const sockaddr_in6* d = reinterpret_cast<const sockaddr_in6*>(dst);
+        if (IN6_IS_ADDR_V4MAPPED(&s->sin6_addr) &&
+            IN6_IS_ADDR_V4MAPPED(&d->sin6_addr)) {
+            tuple<ipv4a> key;
+            db4.makeKey(pktRd32(s->sin6_addr.s6_addr + 12),
+                        pktRd32(d->sin6_addr.s6_addr + 12),
+                        ntohs(s->sin6_port), ntohs(d->sin6_port),
+                        proto, dscp, key);
+            r.af = AF_INET;
+            r.v4 = db4.find(key);
+            if (mapped6) {
+                tuple<ipv6a> k6;
+                db6.makeKey(*s, *d, proto, dscp, k6);
+                r.v6 = db6.find(k6);
+            }
+        } else {
+            tuple<ipv6a> key;
+            db6.makeKey(*s, *d, proto, dscp, key);
+            r.af = AF_INET6;
+            r.v6 = db6.find(key);
+        }
+    } else {
+        r.af = AF_UNSPEC;
+    }
 }
 
 /**
- * @name  db<ADDR>::dump
+ * @name  dualDb::classifyPacket
  * @brief Public function
- *        Returns a copy of the entire R-tree entries
+ *        Tries to find R-tree entries matching the IPv4 or IPv6
+ *        packet at \b l3hdr. The tree is selected by the IP
+ *        version of the packet; IPv4 packets and IPv6 packets
+ *        between IPv4-mapped addresses are looked up as in
+ *        \e find().
  *
- * @param ADDR \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param[in]  l3hdr Pointer to the IP header
+ * @param[in]  len   Number of bytes available from \b l3hdr
+ * @param[out] r     Search result (\b r.af is AF_UNSPEC if the
+ *                   packet is malformed)
+ */
+inline void
+dualDb::classifyPacket (const u8* l3hdr, size_t len, dualResult& r)
+{
+    r.v4.clear();
+    r.v6.clear();
+    r.af = AF_UNSPEC;
+    if (len == 0) {
+        return;
+    }
+    if ((l3hdr[0] >> 4) == 4) {
+        tuple<ipv4a> key;
+        if (db4.makeKey(l3hdr, len, key)) {
+            r.af = AF_INET;
+            r.v4 = db4.find(key, len);
+            if (mapped6) {
+                tuple<ipv6a> k6;
+                mappedKey(key, k6);
+                r.v6 = db6.find(k6, len);
+            }
+        }
+    } else {
+        tuple<ipv6a> key;
+        if (!db6.makeKey(l3hdr, len, key)) {
+            return;
+        }
+        if (isMapped(l3hdr + 8) && isMapped(l3hdr + 24)) {
+            tuple<ipv4a> k4;
+            mappedKey(l3hdr, key, k4);
+            r.af = AF_INET;
+            r.v4 = db4.find(k4, len);
+            if (mapped6) {
+                r.v6 = db6.find(key, len);
+            }
+        } else {
+            r.af = AF_INET6;
+            r.v6 = db6.find(key, len);
+        }
+    }
+}
+
+/**
+ * @name  dualDb::classifyBatch
+ * @brief Public function
+ *        Classifies a batch of IPv4/IPv6 packets. All the search
+ *        keys are made first, then the IPv4 keys and the IPv6 keys
+ *        are looked up in turn so that each tree is walked by
+ *        consecutive lookups. IPv4 packets and IPv6 packets
+ *        between IPv4-mapped addresses are looked up as in
+ *        \e classifyPacket().
  *
- * @retval rtacl::result<ADDR> A copy of the entire entries in \b db<ADDR>
+ * @param[in]  l3hdr Pointers to the IP headers
+ * @param[in]  len   Number of bytes available from each \b l3hdr
+ * @param[in]  n     Number of packets
+ * @param[out] r     Search results (\b n entries)
  */
-template <class ADDR>
-inline result<ADDR>
-db<ADDR>::dump () const
+inline void
+dualDb::classifyBatch (const u8* const l3hdr[], const size_t len[],
+                       const size_t n, dualResult r[])
 {
-    /*
-     * Get an entire copy of the entries
-     */
-    range<ADDR>  b = rtree.bounds();
-    result<ADDR> r;
-    rtree.query(bgi::covered_by(b), std::back_inserter(r));
+    std::vector<std::pair<tuple<ipv4a>, size_t> > k4;
+    std::vector<std::pair<tuple<ipv6a>, size_t> > k6;
+    size_t i;
 
-    return r;
+    k4.reserve(n);
+    for (i = 0; i < n; ++i) {
+        r[i].v4.clear();
+        r[i].v6.clear();
+        r[i].af = AF_UNSPEC;
+        if (len[i] == 0) {
+            continue;
+        }
+        if ((l3hdr[i][0] >> 4) == 4) {
+            k4.resize(k4.size() + 1);
+            if (db4.makeKey(l3hdr[i], len[i], k4.back().first)) {
+                k4.back().second = i;
+                r[i].af = AF_INET;
+                if (mapped6) {
+                    k6.resize(k6.size() + 1);
+                    mappedKey(k4.back().first, k6.back().first);
+                    k6.back().second = i;
+                }
+            } else {
+                k4.pop_back();
+            }
+        } else {
+            k6.resize(k6.size() + 1);
+            if (!db6.makeKey(l3hdr[i], len[i], k6.back().first)) {
+                k6.pop_back();
+                continue;
+            }
+            k6.back().second = i;
+            r[i].af = AF_INET6;
+            if (isMapped(l3hdr[i] + 8) && isMapped(l3hdr[i] + 24)) {
+                k4.resize(k4.size() + 1);
+                mappedKey(l3hdr[i], k6.back().first, k4.back().first);
+                k4.back().second = i;
+                r[i].af = AF_INET;
+                if (!mapped6) {
+                    k6.pop_back();
+                }
+            }
+        }
+    }
+    for (auto& k : k4) {
+        r[k.second].v4 = db4.find(k.first, len[k.second]);
+    }
+    for (auto& k : k6) {
+        r[k.second].v6 = db6.find(k.first, len[k.second]);
+    }
 }
 
 /**
@@ -760,18 +3934,25 @@ template <class SADDR>
 inline std::string
 sockItem<SADDR>::str ()
 {
-    char src[64];
-    char dst[64];
-    inet_ntop(af, getsa(), src, sizeof(src));
-    inet_ntop(af, getda(), dst, sizeof(dst));
-    return (boost::format("%s, %s, %d, %d, %d, %d")
-            % src
-            % dst
-            % (u32)(getsp())
-            % (u32)(getdp())
-            % (u32)(getProto())
-            % (u32)(getDSCP())).str();
-
+    char buf[textMax];
+    char* p = buf;
+    p = sa2buf(p, af, getsa());
+    *p++ = ',';
+    *p++ = ' ';
+    p = sa2buf(p, af, getda());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, getsp());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, getdp());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, getProto());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, getDSCP());
+    return std::string(buf, p);
 }
 
 /**
@@ -788,28 +3969,37 @@ template <class SADDR>
 inline std::string
 sockEnt<SADDR>::str ()
 {
-    char saLo[64];
-    char saHi[64];
-    char daLo[64];
-    char daHi[64];
-
-    inet_ntop(min.af, min.getsa(), saLo, sizeof(saLo));
-    inet_ntop(min.af, min.getda(), daLo, sizeof(daLo));
-    inet_ntop(max.af, max.getsa(), saHi, sizeof(saHi));
-    inet_ntop(max.af, max.getda(), daHi, sizeof(daHi));
-    return (boost::format("%s-%s, %s-%s, %d-%d, %d-%d, %d-%d, %d-%d")
-            % saLo
-            % saHi
-            % daLo
-            % daHi
-            % (u32)(min.getsp())
-            % (u32)(max.getsp())
-            % (u32)(min.getdp())
-            % (u32)(max.getdp())
-            % (u32)(min.getProto())
-            % (u32)(max.getProto())
-            % (u32)(min.getDSCP())
-            % (u32)(max.getDSCP())).str();
+    char buf[textMax];
+    char* p = buf;
+    p = sa2buf(p, min.af, min.getsa());
+    *p++ = '-';
+    p = sa2buf(p, max.af, max.getsa());
+    *p++ = ',';
+    *p++ = ' ';
+    p = sa2buf(p, min.af, min.getda());
+    *p++ = '-';
+    p = sa2buf(p, max.af, max.getda());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, min.getsp());
+    *p++ = '-';
+    p = u64toBuf(p, max.getsp());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, min.getdp());
+    *p++ = '-';
+    p = u64toBuf(p, max.getdp());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, min.getProto());
+    *p++ = '-';
+    p = u64toBuf(p, max.getProto());
+    *p++ = ',';
+    *p++ = ' ';
+    p = u64toBuf(p, min.getDSCP());
+    *p++ = '-';
+    p = u64toBuf(p, max.getDSCP());
+    return std::string(buf, p);
 }
 
 
@@ -0,0 +1,307 @@
+#ifndef __RTACL_ASYNC_HPP__
+#define __RTACL_ASYNC_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Asynchronous update queue
+ *
+ * rtacl::asyncDb takes the updates into a bounded MPSC ring and
+ * returns at once with a sequence number. A background writer
+ * thread drains the ring, cancels an insert against a later remove
+ * of the same entry in the same batch, and applies each batch to an
+ * rtacl::epochDb with one grace period. Lookups do not take a lock.
+ */
+
+#include "rtaclEpoch.hpp"
+
+#include <chrono>
+#include <unordered_map>
+
+namespace rtacl {
+
+/**
+ * @class rtacl::asyncDb
+ * @brief R-tree ACL updated by a background writer thread
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ */
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t>
+class asyncDb
+{
+public:
+    typedef epochDb<ADDR, VALUE> dbType;
+    typedef std::pair<bool, entry<ADDR, VALUE> > update; // (insert?, ent)
+private:
+    struct cell {
+        std::atomic<u64> turn;
+        u64 seq;
+        update u;
+    };
+
+    std::unique_ptr<cell[]> ring;
+    size_t mask;
+    size_t maxBatch;
+    std::atomic<u64> head;      // next position to enqueue
+    u64 tail;                   // next position to dequeue (writer)
+    std::atomic<u64> applied;   // the last sequence number applied
+    std::atomic<u64> nBatches;
+    std::atomic<u64> nCoalesced;
+    std::atomic<bool> stop;
+    dbType acl;
+    std::thread writer;
+public:
+    explicit asyncDb(size_t capacity = 4096, size_t maxBatch = 1024);
+    ~asyncDb();
+    u64 insert (entry<ADDR, VALUE> const& ent) {
+        return enqueue(update(true, ent));
+    };
+    u64 remove (entry<ADDR, VALUE> const& ent) {
+        return enqueue(update(false, ent));
+    };
+    bool done (u64 seq) const { return applied.load() >= seq; };
+    void wait(u64 seq) const;
+    void flush () { wait(head.load()); };
+    result<ADDR, VALUE> find (const tuple<ADDR>& key) const {
+        return acl.find(key);
+    };
+    bool matchesAny (const tuple<ADDR>& key) const {
+        return acl.matchesAny(key);
+    };
+    size_t size () const { return acl.size(); };
+    u64 batches () const { return nBatches.load(); };
+    u64 coalesced () const { return nCoalesced.load(); };
+    typename dbType::dbType& getDb () { return acl.getDb(); };
+    static size_t coalesce(std::vector<update>& b);
+private:
+    u64 enqueue(const update& u);
+    bool dequeue(update& u, u64& seq);
+    void run();
+};
+
+/**
+ * @name  asyncDb<ADDR, VALUE>::asyncDb
+ * @brief Constructor (starts the writer thread)
+ *
+ * @param[in] capacity Number of the slots of the ring (rounded up
+ *                     to a power of 2)
+ * @param[in] maxBatch The largest number of the updates per batch
+ */
+template <class ADDR, class VALUE>
+inline
+asyncDb<ADDR, VALUE>::asyncDb (size_t capacity, size_t maxBatch)
+    : maxBatch(maxBatch), head(0), tail(0), applied(0), nBatches(0),
+      nCoalesced(0), stop(false)
+{
+    size_t n = 1;
+    size_t i;
+
+    while (n < capacity) {
+        n <<= 1;
+    }
+    ring.reset(new cell[n]);
+    mask = n - 1;
+    for (i = 0; i < n; ++i) {
+        ring[i].turn.store(i);
+    }
+    writer = std::thread([this]() { run(); });
+}
+
+/**
+ * @name  asyncDb<ADDR, VALUE>::~asyncDb
+ * @brief Destructor (applies the queued updates and stops the
+ *        writer thread)
+ */
+template <class ADDR, class VALUE>
+inline
+asyncDb<ADDR, VALUE>::~asyncDb ()
+{
+    stop.store(true);
+    writer.join();
+}
+
+/**
+ * @name  asyncDb<ADDR, VALUE>::enqueue
+ * @brief Private function
+ *        Puts \b u into the ring (waits while it is full)
+ *
+ * @retval Sequence number of \b u
+ */
+template <class ADDR, class VALUE>
+inline u64
+asyncDb<ADDR, VALUE>::enqueue (const update& u)
+{
+    u64 pos = head.load(std::memory_order_relaxed);
+    cell* c;
+
+    for (;;) {
+        c = &ring[pos & mask];
+        u64 t = c->turn.load(std::memory_order_acquire);
+        if (t == pos) {
+            if (head.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (t < pos) {
+            std::this_thread::yield(); // full
+            pos = head.load(std::memory_order_relaxed);
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    c->seq = pos + 1;
+    c->u = u;
+    c->turn.store(pos + 1, std::memory_order_release);
+    return pos + 1;
+}
+
+/**
+ * @name  asyncDb<ADDR, VALUE>::dequeue
+ * @brief Private function
+ *        Takes the oldest update out of the ring (writer only)
+ *
+ * @retval false The ring is empty
+ */
+template <class ADDR, class VALUE>
+inline bool
+asyncDb<ADDR, VALUE>::dequeue (update& u, u64& seq)
+{
+    cell& c = ring[tail & mask];
+
+    if (c.turn.load(std::memory_order_acquire) != tail + 1) {
+        return false;
+    }
+    u = c.u;
+    seq = c.seq;
+    c.turn.store(tail + mask + 1, std::memory_order_release);
+    ++tail;
+    return true;
+}
+
+/**
+ * @name  asyncDb<ADDR, VALUE>::wait
+ * @brief Public function
+ *        Waits until the update of \b seq (and all the ones
+ *        before) has been applied
+ */
+template <class ADDR, class VALUE>
+inline void
+asyncDb<ADDR, VALUE>::wait (u64 seq) const
+{
+    while (!done(seq)) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @name  asyncDb<ADDR, VALUE>::coalesce
+ * @brief Public function
+ *        Cancels an insert against a later remove of the same
+ *        entry in \b b (the order of the rest is kept)
+ *
+ * @retval Number of the updates cancelled
+ */
+template <class ADDR, class VALUE>
+inline size_t
+asyncDb<ADDR, VALUE>::coalesce (std::vector<update>& b)
+{
+    std::unordered_multimap<uintptr_t, size_t> adds;
+    std::vector<bool> dead(b.size(), false);
+    size_t i, n = 0;
+
+    for (i = 0; i < b.size(); ++i) {
+        uintptr_t h = ruleHandle(b[i].second.second);
+        if (b[i].first) {
+            adds.emplace(h, i);
+            continue;
+        }
+        auto r = adds.equal_range(h);
+        for (auto it = r.first; it != r.second; ++it) {
+            const entry<ADDR, VALUE>& e = b[it->second].second;
+            if (e.second == b[i].second.second &&
+                bg::equals(e.first, b[i].second.first)) {
+                dead[it->second] = dead[i] = true;
+                adds.erase(it);
+                n += 2;
+                break;
+            }
+        }
+    }
+    if (n) {
+        size_t j = 0;
+        for (i = 0; i < b.size(); ++i) {
+            if (!dead[i]) {
+                b[j++] = b[i];
+            }
+        }
+        b.resize(j);
+    }
+    return n;
+}
+
+/**
+ * @name  asyncDb<ADDR, VALUE>::run
+ * @brief Private function
+ *        Writer thread: applies the updates in batches
+ */
+template <class ADDR, class VALUE>
+inline void
+asyncDb<ADDR, VALUE>::run ()
+{
+    std::vector<update> b;
+    update u;
+    u64 seq = 0;
+
+    for (;;) {
+        b.clear();
+        while (b.size() < maxBatch && dequeue(u, seq)) {
+            b.push_back(u);
+        }
+        if (b.empty()) {
+            if (stop.load()) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            continue;
+        }
+        nCoalesced += coalesce(b);
+        acl.update([&b](typename dbType::dbType& d) {
+                for (auto& x : b) {
+                    if (x.first) {
+                        d.insert(x.second);
+                    } else {
+                        d.remove(x.second);
+                    }
+                }
+                return true;
+            });
+        ++nBatches;
+        applied.store(seq);
+    }
+}
+
+} //namespace
+#endif// __RTACL_ASYNC_HPP__
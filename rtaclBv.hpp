@@ -0,0 +1,454 @@
+#ifndef __RTACL_BV_HPP__
+#define __RTACL_BV_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Bit-vector (Lucent BV / ABV) engine
+ *
+ * rtacl::bv projects the rules onto each of the 6 fields. A field
+ * value is mapped to an elementary interval by a binary search, and
+ * each interval has the bitmap of the rules covering it (bit i:
+ * the i-th rule in the order of priority). A lookup ANDs the 6
+ * bitmaps, and the first set bit is the highest priority match.
+ * The aggregated bit vectors (ABV) have a bit per 256-bit block of
+ * the bitmaps, set if the block is not empty, so that a lookup ANDs
+ * the aggregates first and reads the non-empty blocks only. The
+ * bitmap AND of both BV and ABV is done by AVX2 (a block at a time)
+ * on x86 CPUs supporting it (detected at run time); the aggregate
+ * AND is left scalar as it is 2 words at 32K rules. Memory grows
+ * with (number of rules)^2 on the address fields, so it is meant
+ * for 1K-32K rules.
+ */
+
+#include "rtacl.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RTACL_BV_AVX2
+#include <immintrin.h>
+#endif
+
+namespace rtacl {
+
+/**
+ * @class rtacl::bv
+ * @brief Bit-vector engine built from R-tree ACL entries
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ */
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t>
+class bv
+{
+private:
+    struct field {
+        std::vector<ADDR> bounds; // start of the elementary intervals
+        std::vector<u64>  bits;   // bitmap of each interval
+        std::vector<u64>  agg;    // aggregate of each interval (a bit
+                                  // per block of 4 words)
+    };
+
+    std::vector<entry<ADDR, VALUE> > rules;
+    field f[dim];
+    size_t words;               // bitmap words (multiple of 4)
+    size_t aggWords;            // aggregate words
+    bool avx2;
+public:
+    bv();
+    template <class IT>
+    void build(IT first, IT last);
+    const entry<ADDR, VALUE>* first(const tuple<ADDR>& key) const;
+    const entry<ADDR, VALUE>* firstLinear(const tuple<ADDR>& key) const;
+    result<ADDR, VALUE> find(const tuple<ADDR>& key) const;
+    size_t size () const { return rules.size(); };
+    size_t memory() const;
+    bool enableSimd(bool enable);
+private:
+    void rows(const tuple<ADDR>& key, const u64* r[dim],
+              const u64* a[dim]) const;
+    bool andBlock(const u64* const r[dim], size_t k, u64 t[4]) const;
+    static size_t andFirst(const u64* const r[dim], size_t n, u64& w);
+#if defined(RTACL_BV_AVX2)
+    __attribute__((target("avx2")))
+    static size_t andFirstAvx2(const u64* const r[dim], size_t n, u64& w);
+    __attribute__((target("avx2")))
+    static bool andBlockAvx2(const u64* const r[dim], size_t k, u64 t[4]);
+#endif
+};
+
+/**
+ * @name  bv<ADDR, VALUE>::bv
+ * @brief Constructor
+ */
+template <class ADDR, class VALUE>
+inline
+bv<ADDR, VALUE>::bv () : words(0), aggWords(0), avx2(false)
+{
+    enableSimd(true);
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::enableSimd
+ * @brief Public function
+ *        Enables/disables AVX2
+ *
+ * @retval true  AVX2 is used
+ * @retval false AVX2 is not used (disabled or not supported)
+ */
+template <class ADDR, class VALUE>
+inline bool
+bv<ADDR, VALUE>::enableSimd (bool enable)
+{
+#if defined(RTACL_BV_AVX2)
+    avx2 = enable && __builtin_cpu_supports("avx2");
+#else
+    avx2 = false;
+#endif
+    return avx2;
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::build
+ * @brief Public function
+ *        Builds the bitmaps from the R-tree ACL entries
+ *        [\b first, \b last) in the order of priority (the first
+ *        one has the highest priority)
+ */
+template <class ADDR, class VALUE>
+template <class IT>
+inline void
+bv<ADDR, VALUE>::build (IT first, IT last)
+{
+    ADDR lo[dim];
+    ADDR hi[dim];
+    size_t d, i, j, r;
+
+    rules.assign(first, last);
+    words = ((rules.size() + 255) / 256) * 4;
+    aggWords = (words / 4 + 63) / 64;
+    for (d = 0; d < dim; ++d) {
+        field& fd = f[d];
+        fd.bounds.assign(1, 0);
+        for (r = 0; r < rules.size(); ++r) {
+            fields<0, dim>::get(rules[r].first.min_corner(), lo);
+            fields<0, dim>::get(rules[r].first.max_corner(), hi);
+            fd.bounds.push_back(lo[d] + 1);
+            if (hi[d] - 1 < fieldMax<ADDR>(d)) {
+                fd.bounds.push_back(hi[d]);
+            }
+        }
+        std::sort(fd.bounds.begin(), fd.bounds.end());
+        fd.bounds.erase(std::unique(fd.bounds.begin(), fd.bounds.end()),
+                        fd.bounds.end());
+        fd.bits.assign(fd.bounds.size() * words, 0);
+        fd.agg.assign(fd.bounds.size() * aggWords, 0);
+        for (r = 0; r < rules.size(); ++r) {
+            fields<0, dim>::get(rules[r].first.min_corner(), lo);
+            fields<0, dim>::get(rules[r].first.max_corner(), hi);
+            i = std::lower_bound(fd.bounds.begin(), fd.bounds.end(),
+                                 lo[d] + 1) - fd.bounds.begin();
+            j = std::lower_bound(fd.bounds.begin(), fd.bounds.end(),
+                                 hi[d]) - fd.bounds.begin();
+            for (; i < j; ++i) {
+                fd.bits[i * words + (r >> 6)] |= u64(1) << (r & 63);
+                fd.agg[i * aggWords + (r >> 14)] |= u64(1) << ((r >> 8) & 63);
+            }
+        }
+    }
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::rows
+ * @brief Private function
+ *        Returns the bitmaps (\b r) and the aggregates (\b a) of
+ *        the intervals \b key falls in
+ */
+template <class ADDR, class VALUE>
+inline void
+bv<ADDR, VALUE>::rows (const tuple<ADDR>& key, const u64* r[dim],
+                       const u64* a[dim]) const
+{
+    ADDR k[dim];
+    size_t d;
+
+    fields<0, dim>::get(key, k);
+    for (d = 0; d < dim; ++d) {
+        const field& fd = f[d];
+        size_t i = std::upper_bound(fd.bounds.begin(), fd.bounds.end(),
+                                    k[d]) - fd.bounds.begin() - 1;
+        r[d] = &fd.bits[i * words];
+        a[d] = &fd.agg[i * aggWords];
+    }
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::andFirst
+ * @brief Private function
+ *        ANDs the \b n words of the 6 bitmaps \b r until a
+ *        non-zero word is found
+ *
+ * @param[out] w The first non-zero word
+ *
+ * @retval Index of \b w (\b n if all are zero)
+ */
+template <class ADDR, class VALUE>
+inline size_t
+bv<ADDR, VALUE>::andFirst (const u64* const r[dim], size_t n, u64& w)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        w = r[0][i] & r[1][i] & r[2][i] & r[3][i] & r[4][i] & r[5][i];
+        if (w) {
+            return i;
+        }
+    }
+    return n;
+}
+
+#if defined(RTACL_BV_AVX2)
+/**
+ * @name  bv<ADDR, VALUE>::andFirstAvx2
+ * @brief Private function
+ *        \e andFirst() by AVX2 (4 words at a time; \b n must be a
+ *        multiple of 4)
+ */
+template <class ADDR, class VALUE>
+__attribute__((target("avx2")))
+inline size_t
+bv<ADDR, VALUE>::andFirstAvx2 (const u64* const r[dim], size_t n, u64& w)
+{
+    size_t i, d;
+
+    for (i = 0; i < n; i += 4) {
+        __m256i v = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(r[0] + i));
+        for (d = 1; d < dim; ++d) {
+            v = _mm256_and_si256(v, _mm256_loadu_si256(
+                                     reinterpret_cast<const __m256i*>(
+                                         r[d] + i)));
+        }
+        if (!_mm256_testz_si256(v, v)) {
+            u64 t[4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(t), v);
+            for (d = 0; ; ++d) {
+                if (t[d]) {
+                    w = t[d];
+                    return i + d;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::andBlockAvx2
+ * @brief Private function
+ *        \e andBlock() by AVX2
+ */
+template <class ADDR, class VALUE>
+__attribute__((target("avx2")))
+inline bool
+bv<ADDR, VALUE>::andBlockAvx2 (const u64* const r[dim], size_t k, u64 t[4])
+{
+    size_t d;
+
+    __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(r[0] + k * 4));
+    for (d = 1; d < dim; ++d) {
+        v = _mm256_and_si256(v, _mm256_loadu_si256(
+                                 reinterpret_cast<const __m256i*>(
+                                     r[d] + k * 4)));
+    }
+    if (_mm256_testz_si256(v, v)) {
+        return false;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(t), v);
+    return true;
+}
+#endif
+
+/**
+ * @name  bv<ADDR, VALUE>::andBlock
+ * @brief Private function
+ *        ANDs the 4 words of the block \b k of the 6 bitmaps \b r
+ *        into \b t
+ *
+ * @retval true  \b t is not all zero
+ * @retval false \b t is all zero
+ */
+template <class ADDR, class VALUE>
+inline bool
+bv<ADDR, VALUE>::andBlock (const u64* const r[dim], size_t k, u64 t[4]) const
+{
+    size_t j, o;
+    u64 any = 0;
+
+#if defined(RTACL_BV_AVX2)
+    if (avx2) {
+        return andBlockAvx2(r, k, t);
+    }
+#endif
+    for (j = 0; j < 4; ++j) {
+        o = k * 4 + j;
+        t[j] = r[0][o] & r[1][o] & r[2][o] & r[3][o] & r[4][o] & r[5][o];
+        any |= t[j];
+    }
+    return any != 0;
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::firstLinear
+ * @brief Public function
+ *        Returns the highest priority entry matching \b key by
+ *        ANDing the whole bitmaps (Lucent BV)
+ *
+ * @retval nullptr No entry matches \b key
+ */
+template <class ADDR, class VALUE>
+inline const entry<ADDR, VALUE>*
+bv<ADDR, VALUE>::firstLinear (const tuple<ADDR>& key) const
+{
+    const u64* r[dim];
+    const u64* a[dim];
+    u64 w = 0;
+    size_t i;
+
+    if (rules.empty()) {
+        return nullptr;
+    }
+    rows(key, r, a);
+#if defined(RTACL_BV_AVX2)
+    i = avx2 ? andFirstAvx2(r, words, w) : andFirst(r, words, w);
+#else
+    i = andFirst(r, words, w);
+#endif
+    if (i == words) {
+        return nullptr;
+    }
+    return &rules[(i << 6) + __builtin_ctzll(w)];
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::first
+ * @brief Public function
+ *        Returns the highest priority entry matching \b key by
+ *        ANDing the aggregates first and then the non-empty blocks
+ *        only (ABV)
+ *
+ * @retval nullptr No entry matches \b key
+ */
+template <class ADDR, class VALUE>
+inline const entry<ADDR, VALUE>*
+bv<ADDR, VALUE>::first (const tuple<ADDR>& key) const
+{
+    const u64* r[dim];
+    const u64* a[dim];
+    u64 t[4];
+    size_t i, j;
+
+    if (rules.empty()) {
+        return nullptr;
+    }
+    rows(key, r, a);
+    for (i = 0; i < aggWords; ++i) {
+        u64 g = a[0][i] & a[1][i] & a[2][i] & a[3][i] & a[4][i] & a[5][i];
+        while (g) {
+            size_t k = (i << 6) + __builtin_ctzll(g);
+            if (andBlock(r, k, t)) {
+                for (j = 0; !t[j]; ++j);
+                return &rules[(((k << 2) + j) << 6) + __builtin_ctzll(t[j])];
+            }
+            g &= g - 1;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::find
+ * @brief Public function
+ *        Returns all the entries matching \b key in the order of
+ *        priority
+ */
+template <class ADDR, class VALUE>
+inline result<ADDR, VALUE>
+bv<ADDR, VALUE>::find (const tuple<ADDR>& key) const
+{
+    result<ADDR, VALUE> res;
+    const u64* r[dim];
+    const u64* a[dim];
+    u64 t[4];
+    size_t i, j;
+
+    if (rules.empty()) {
+        return res;
+    }
+    rows(key, r, a);
+    for (i = 0; i < aggWords; ++i) {
+        u64 g = a[0][i] & a[1][i] & a[2][i] & a[3][i] & a[4][i] & a[5][i];
+        while (g) {
+            size_t k = (i << 6) + __builtin_ctzll(g);
+            if (andBlock(r, k, t)) {
+                for (j = 0; j < 4; ++j) {
+                    while (t[j]) {
+                        res.push_back(rules[(((k << 2) + j) << 6) +
+                                            __builtin_ctzll(t[j])]);
+                        t[j] &= t[j] - 1;
+                    }
+                }
+            }
+            g &= g - 1;
+        }
+    }
+    return res;
+}
+
+/**
+ * @name  bv<ADDR, VALUE>::memory
+ * @brief Public function
+ *        Returns the number of the bytes of the bitmaps and the
+ *        interval bounds
+ */
+template <class ADDR, class VALUE>
+inline size_t
+bv<ADDR, VALUE>::memory () const
+{
+    size_t n = 0;
+    size_t d;
+
+    for (d = 0; d < dim; ++d) {
+        n += (f[d].bits.size() + f[d].agg.size()) * sizeof(u64) +
+             f[d].bounds.size() * sizeof(ADDR);
+    }
+    return n;
+}
+
+} //namespace
+#endif// __RTACL_BV_HPP__
@@ -0,0 +1,370 @@
+#ifndef __RTACL_DEFER_HPP__
+#define __RTACL_DEFER_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Deamortized insert
+ *
+ * An insert into the R-tree splits a full node now and then, and
+ * the split may cascade up to the root, so about 10% of the
+ * inserts take several times as long as the median, and the worst
+ * ones 100 times. rtacl::deferDb never inserts into the large
+ * R-tree on the caller's thread. insert() puts the rule into a
+ * small side R-tree (at most cap rules, so its splits are cheap),
+ * and a background drainer thread moves the side tree into an
+ * rtacl::epochDb in one batch while the next side tree takes the
+ * new rules. Lookups walk the R-tree and the side trees (both by
+ * the R-tree index, not by a scan), so a rule matches as soon as
+ * insert() returns, and never twice: a side tree handed over is
+ * skipped once the version of the epochDb copy being read
+ * includes its batch.
+ *
+ * All the calls must come from one thread. insert() waits only
+ * when the drainer falls behind by cap rules (as rtacl::asyncDb
+ * waits on a full ring). The drainer inserts each rule into both
+ * copies of the epochDb, so it sustains about half the insert rate
+ * of rtacl::db; on a single CPU it also takes the CPU from the
+ * caller while it runs.
+ */
+
+#include "rtaclEpoch.hpp"
+
+#include <chrono>
+
+namespace rtacl {
+
+/**
+ * @class rtacl::deferDb
+ * @brief R-tree ACL whose inserts are moved into the R-tree by a
+ *        background thread
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ */
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t>
+class deferDb
+{
+public:
+    typedef typename epochDb<ADDR, VALUE>::dbType dbType;
+private:
+    enum {
+        idle,                   // no side tree is handed over
+        handed,                 // the drainer owns side[hand]
+        landed,                 // side[hand] is in acl
+    };
+
+    epochDb<ADDR, VALUE> acl;
+    std::unique_ptr<dbType> side[2];    // side R-trees
+    std::unique_ptr<dbType> spare;      // next empty side R-tree
+    int cur;                    // side tree taking the inserts
+    int hand;                   // side tree handed over
+    size_t cap;
+    std::atomic<int> flight;
+    std::atomic<u64> target;    // version of acl with side[hand] (0: unknown)
+    std::atomic<u64> nBatches;
+    std::atomic<bool> stop;
+    std::thread drainer;
+public:
+    explicit deferDb(size_t cap = 1024);
+    ~deferDb();
+    void insert(entry<ADDR, VALUE> const& ent);
+    bool remove(entry<ADDR, VALUE> const& ent);
+    result<ADDR, VALUE> find(const tuple<ADDR>& key) const;
+    bool matchesAny(const tuple<ADDR>& key) const;
+    size_t countMatches(const tuple<ADDR>& key) const;
+    size_t size() const;
+    size_t pending() const;
+    size_t capacity () const { return cap; };
+    u64 batches () const { return nBatches.load(); };
+    void flush();
+    dbType& getDb () { return acl.getDb(); };
+private:
+    void poll();
+    template <class FN>
+    void lookup(FN fn) const;
+    void run();
+};
+
+/**
+ * @name  deferDb<ADDR, VALUE>::deferDb
+ * @brief Constructor (starts the drainer thread)
+ *
+ * @param[in] cap The largest number of the rules of a side tree
+ */
+template <class ADDR, class VALUE>
+inline
+deferDb<ADDR, VALUE>::deferDb (size_t cap)
+    : cur(0), hand(1), cap(cap ? cap : 1), flight(idle), target(0),
+      nBatches(0), stop(false)
+{
+    side[0].reset(new dbType);
+    side[1].reset(new dbType);
+    spare.reset(new dbType);
+    drainer = std::thread([this]() { run(); });
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::~deferDb
+ * @brief Destructor (stops the drainer thread)
+ */
+template <class ADDR, class VALUE>
+inline
+deferDb<ADDR, VALUE>::~deferDb ()
+{
+    stop.store(true);
+    drainer.join();
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::poll
+ * @brief Private function
+ *        Takes back the side tree the drainer has moved into the
+ *        R-tree, and hands the current one over if the drainer is
+ *        idle
+ */
+template <class ADDR, class VALUE>
+inline void
+deferDb<ADDR, VALUE>::poll ()
+{
+    if (flight.load() == landed) {
+        side[hand].swap(spare); // the drainer frees it next time
+        target.store(0);
+        flight.store(idle);
+    }
+    if (flight.load() == idle && side[cur]->size()) {
+        hand = cur;
+        cur ^= 1;
+        flight.store(handed);
+    }
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::insert
+ * @brief Public function
+ *        Inserts \b ent into the side tree. Waits only if the side
+ *        tree is full while the drainer is still moving the other
+ *        one.
+ */
+template <class ADDR, class VALUE>
+inline void
+deferDb<ADDR, VALUE>::insert (entry<ADDR, VALUE> const& ent)
+{
+    poll();
+    while (side[cur]->size() >= cap) {
+        std::this_thread::yield();
+        poll();
+    }
+    side[cur]->insert(ent);
+    poll();
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::remove
+ * @brief Public function
+ *        Removes \b ent from the side tree or from the R-tree. The
+ *        latter waits for the side tree being moved, if any, so
+ *        that the drainer and remove() never update the R-tree at
+ *        the same time.
+ *
+ * @retval true  Removed
+ * @retval false Not found
+ */
+template <class ADDR, class VALUE>
+inline bool
+deferDb<ADDR, VALUE>::remove (entry<ADDR, VALUE> const& ent)
+{
+    bool rc;
+
+    if (side[cur]->remove(ent)) {
+        return true;
+    }
+    while (flight.load() == handed) {
+        std::this_thread::yield();
+    }
+    rc = acl.remove(ent);
+    poll();
+    return rc;
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::lookup
+ * @brief Private function
+ *        Calls \b fn(const dbType& d, bool pending) on the active
+ *        copy of the R-tree and on the side trees whose rules are
+ *        not in that copy
+ */
+template <class ADDR, class VALUE>
+template <class FN>
+inline void
+deferDb<ADDR, VALUE>::lookup (FN fn) const
+{
+    acl.read([this, &fn](const dbType& d, u64 version) {
+            fn(d, false);
+            fn(static_cast<const dbType&>(*side[cur]), true);
+            if (flight.load() != idle) {
+                u64 t = target.load();
+                if (t == 0 || version < t) {
+                    fn(static_cast<const dbType&>(*side[hand]), true);
+                }
+            }
+        });
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::find
+ * @brief Public function
+ *        Returns the rules matching \b key in the R-tree and in
+ *        the side trees
+ */
+template <class ADDR, class VALUE>
+inline result<ADDR, VALUE>
+deferDb<ADDR, VALUE>::find (const tuple<ADDR>& key) const
+{
+    result<ADDR, VALUE> res;
+
+    lookup([&key, &res](const dbType& d, bool) {
+            if (res.empty()) {
+                res = d.find(key);
+            } else if (d.size()) {
+                result<ADDR, VALUE> r = d.find(key);
+                res.insert(res.end(), r.begin(), r.end());
+            }
+        });
+    return res;
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::matchesAny
+ * @brief Public function
+ *        Returns whether any rule matches \b key
+ */
+template <class ADDR, class VALUE>
+inline bool
+deferDb<ADDR, VALUE>::matchesAny (const tuple<ADDR>& key) const
+{
+    bool any = false;
+
+    lookup([&key, &any](const dbType& d, bool) {
+            any = any || (d.size() && d.matchesAny(key));
+        });
+    return any;
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::countMatches
+ * @brief Public function
+ *        Returns the number of the rules matching \b key
+ */
+template <class ADDR, class VALUE>
+inline size_t
+deferDb<ADDR, VALUE>::countMatches (const tuple<ADDR>& key) const
+{
+    size_t n = 0;
+
+    lookup([&key, &n](const dbType& d, bool) {
+            n += d.size() ? d.countMatches(key) : 0;
+        });
+    return n;
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::size
+ * @brief Public function
+ *        Returns the number of the rules
+ */
+template <class ADDR, class VALUE>
+inline size_t
+deferDb<ADDR, VALUE>::size () const
+{
+    size_t n = 0;
+
+    lookup([&n](const dbType& d, bool) { n += d.size(); });
+    return n;
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::pending
+ * @brief Public function
+ *        Returns the number of the rules not yet in the R-tree
+ */
+template <class ADDR, class VALUE>
+inline size_t
+deferDb<ADDR, VALUE>::pending () const
+{
+    size_t n = 0;
+
+    lookup([&n](const dbType& d, bool p) { n += p ? d.size() : 0; });
+    return n;
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::flush
+ * @brief Public function
+ *        Waits until all the rules are in the R-tree
+ */
+template <class ADDR, class VALUE>
+inline void
+deferDb<ADDR, VALUE>::flush ()
+{
+    for (poll(); flight.load() != idle || side[cur]->size(); poll()) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @name  deferDb<ADDR, VALUE>::run
+ * @brief Private function
+ *        Drainer thread: moves each side tree handed over into the
+ *        R-tree in one batch
+ */
+template <class ADDR, class VALUE>
+inline void
+deferDb<ADDR, VALUE>::run ()
+{
+    for (;;) {
+        if (flight.load() == handed) {
+            const dbType& b = *side[hand];
+            target.store(acl.version() + 1);
+            acl.update([&b](dbType& d) {
+                    b.forEach([&d](const entry<ADDR, VALUE>& e) {
+                            d.insert(e);
+                        });
+                    return true;
+                });
+            spare.reset(new dbType);
+            ++nBatches;
+            flight.store(landed);
+            continue;
+        }
+        if (stop.load()) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+} //namespace
+#endif// __RTACL_DEFER_HPP__
@@ -0,0 +1,371 @@
+#ifndef __RTACL_EPOCH_HPP__
+#define __RTACL_EPOCH_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Epoch-based reclamation
+ *
+ * rtacl::epoch is an epoch domain. Readers announce the global
+ * epoch in their own slot while they are in a read-side critical
+ * section (rtacl::epoch::guard). synchronize() advances the epoch
+ * and waits until every reader has left the sections entered
+ * before, and retire() defers freeing an object until then.
+ *
+ * rtacl::epochDb keeps two copies of the R-tree ACL. Readers use
+ * the active one without a lock. The writer updates the inactive
+ * copy, makes it active, waits for the readers of the other copy
+ * to move past by synchronize(), and then updates that copy, so
+ * the nodes freed by remove() are never being read. The same way,
+ * repack() rebuilds the copies one at a time while the lookups go
+ * on, and autoRepack() does it on a background thread when the tree
+ * quality has degraded.
+ */
+
+#include "rtacl.hpp"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifndef RTACL_EPOCH_READERS
+#define RTACL_EPOCH_READERS 128 // max number of the reader threads
+#endif
+
+namespace rtacl {
+
+/**
+ * @class rtacl::epoch
+ * @brief Epoch domain
+ */
+class epoch
+{
+private:
+    struct alignas(64) slot {
+        std::atomic<u64> e;     // 0: not in a critical section
+    };
+    /*
+     * Reader index of the calling thread (released at its exit)
+     */
+    class readerId {
+    private:
+        int id;
+        static std::mutex& lock () {
+            static std::mutex m;
+            return m;
+        };
+        static std::vector<int>& freeIds () {
+            static std::vector<int> v;
+            return v;
+        };
+        static int& nextId () {
+            static int n = 0;
+            return n;
+        };
+    public:
+        readerId () {
+            std::lock_guard<std::mutex> l(lock());
+            if (freeIds().empty()) {
+                if (nextId() >= RTACL_EPOCH_READERS) {
+                    throw std::length_error("rtacl::epoch: more than "
+                                            "RTACL_EPOCH_READERS readers");
+                }
+                id = nextId()++;
+            } else {
+                id = freeIds().back();
+                freeIds().pop_back();
+            }
+        };
+        ~readerId () {
+            std::lock_guard<std::mutex> l(lock());
+            freeIds().push_back(id);
+        };
+        int get () const { return id; };
+    };
+
+    std::atomic<u64> global;
+    slot slots[RTACL_EPOCH_READERS];
+    std::mutex rlock;           // retired
+    std::vector<std::function<void()> > retired;
+
+    slot& local () {
+        static thread_local readerId r;
+        return slots[r.get()];
+    };
+public:
+    epoch();
+    ~epoch () { reclaim(); };
+    epoch(const epoch&) = delete;
+    epoch& operator=(const epoch&) = delete;
+
+    void enter () {
+        local().e.store(global.load(std::memory_order_relaxed));
+    };
+    void leave () {
+        local().e.store(0, std::memory_order_release);
+    };
+    void synchronize();
+    void retire (std::function<void()> fn) {
+        std::lock_guard<std::mutex> l(rlock);
+        retired.push_back(std::move(fn));
+    };
+    void reclaim();
+    u64 current () const { return global.load(); };
+
+    /**
+     * @class rtacl::epoch::guard
+     * @brief Read-side critical section (must not be nested)
+     */
+    class guard {
+    private:
+        epoch& d;
+    public:
+        explicit guard (epoch& d) : d(d) { d.enter(); };
+        ~guard () { d.leave(); };
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+    };
+};
+
+/**
+ * @name  epoch::epoch
+ * @brief Constructor
+ */
+inline
+epoch::epoch () : global(1)
+{
+    for (auto& s : slots) {
+        s.e.store(0);
+    }
+}
+
+/**
+ * @name  epoch::synchronize
+ * @brief Public function
+ *        Advances the epoch and waits until all the readers have
+ *        left the critical sections entered in the older epochs
+ */
+inline void
+epoch::synchronize ()
+{
+    u64 e = global.fetch_add(1) + 1;
+
+    for (auto& s : slots) {
+        for (;;) {
+            u64 v = s.e.load();
+            if (v == 0 || v >= e) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * @name  epoch::reclaim
+ * @brief Public function
+ *        Frees the retired objects after a grace period
+ */
+inline void
+epoch::reclaim ()
+{
+    std::vector<std::function<void()> > r;
+    {
+        std::lock_guard<std::mutex> l(rlock);
+        r.swap(retired);
+    }
+    if (r.empty()) {
+        return;
+    }
+    synchronize();
+    for (auto& fn : r) {
+        fn();
+    }
+}
+
+/**
+ * @class rtacl::epochDb
+ * @brief R-tree ACL whose lookups run concurrently with the
+ *        updates (single writer at a time)
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ * @param ALLOC Allocator of the R-tree nodes
+ */
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t,
+          class ALLOC=std::allocator<entry<ADDR, VALUE> > >
+class epochDb
+{
+public:
+    typedef db<ADDR, VALUE, dim, ALLOC> dbType;
+private:
+    std::unique_ptr<dbType> side[2];
+    std::atomic<u64> ver[2];    // number of the updates of each copy
+    std::atomic<int> active;
+    std::mutex wlock;           // serializes writers
+    mutable epoch dom;
+    std::thread repacker;
+    std::atomic<bool> repacking;
+public:
+    explicit epochDb(const ALLOC& alloc = ALLOC());
+    ~epochDb();
+    void insert (entry<ADDR, VALUE> const& ent) {
+        update([&ent](dbType& d) { d.insert(ent); return true; });
+    };
+    bool remove (entry<ADDR, VALUE> const& ent) {
+        return update([&ent](dbType& d) { return d.remove(ent); });
+    };
+    result<ADDR, VALUE> find (const tuple<ADDR>& key) const {
+        epoch::guard g(dom);
+        return side[active.load()]->find(key);
+    };
+    bool matchesAny (const tuple<ADDR>& key) const {
+        epoch::guard g(dom);
+        return side[active.load()]->matchesAny(key);
+    };
+    size_t size () const {
+        epoch::guard g(dom);
+        return side[active.load()]->size();
+    };
+    treeQuality quality () const {
+        epoch::guard g(dom);
+        return side[active.load()]->quality();
+    };
+    u64 version () const {
+        epoch::guard g(dom);
+        return ver[active.load()].load();
+    };
+    template <class FN>
+    void read (FN fn) const {
+        epoch::guard g(dom);
+        int a = active.load();
+        fn(static_cast<const dbType&>(*side[a]), ver[a].load());
+    };
+    void repack () {
+        update([](dbType& d) { d.repack(); return true; });
+    };
+    bool autoRepack(const repackPolicy& policy = repackPolicy());
+    bool isRepacking () const { return repacking.load(); };
+    epoch& getEpoch () const { return dom; };
+    dbType& getDb () { return *side[active.load()]; };
+    template <class OP>
+    bool update(OP op);
+};
+
+/**
+ * @name  epochDb<ADDR, VALUE, ALLOC>::epochDb
+ * @brief Constructor
+ */
+template <class ADDR, class VALUE, class ALLOC>
+inline
+epochDb<ADDR, VALUE, ALLOC>::epochDb (const ALLOC& alloc)
+    : active(0), repacking(false)
+{
+    ver[0].store(0);
+    ver[1].store(0);
+    side[0].reset(new dbType(alloc));
+    side[1].reset(new dbType(alloc));
+}
+
+/**
+ * @name  epochDb<ADDR, VALUE, ALLOC>::~epochDb
+ * @brief Destructor (waits for the background repack)
+ */
+template <class ADDR, class VALUE, class ALLOC>
+inline
+epochDb<ADDR, VALUE, ALLOC>::~epochDb ()
+{
+    if (repacker.joinable()) {
+        repacker.join();
+    }
+}
+
+/**
+ * @name  epochDb<ADDR, VALUE, ALLOC>::autoRepack
+ * @brief Public function
+ *        Starts repacking on a background thread if the tree
+ *        quality passes the thresholds of \b policy. Lookups go on
+ *        during the repack; updates wait for it.
+ *
+ * @retval true  Repack started
+ * @retval false Not needed, or already running
+ */
+template <class ADDR, class VALUE, class ALLOC>
+inline bool
+epochDb<ADDR, VALUE, ALLOC>::autoRepack (const repackPolicy& policy)
+{
+    bool idle = false;
+
+    if (!repacking.compare_exchange_strong(idle, true)) {
+        return false;           // another caller owns the repacker
+    }
+    if (!policy.exceeded(quality())) {
+        repacking.store(false);
+        return false;
+    }
+    if (repacker.joinable()) {
+        repacker.join();        // the last one has finished
+    }
+    repacker = std::thread([this]() {
+            repack();
+            repacking.store(false);
+        });
+    return true;
+}
+
+/**
+ * @name  epochDb<ADDR, VALUE, ALLOC>::update
+ * @brief Public function
+ *        Applies \b op to the inactive copy, switches the copies,
+ *        and applies \b op to the other one after the readers
+ *        have moved past. \b op(dbType&) can make any number of
+ *        changes at once (e.g., a batch), and must make the same
+ *        changes to both copies. The version of a copy (see
+ *        \e read()) is the number of the updates applied to it.
+ *
+ * @retval The return value of \b op
+ */
+template <class ADDR, class VALUE, class ALLOC>
+template <class OP>
+inline bool
+epochDb<ADDR, VALUE, ALLOC>::update (OP op)
+{
+    std::lock_guard<std::mutex> l(wlock);
+    int a = active.load();
+    bool rc = op(*side[a ^ 1]);
+
+    ver[a ^ 1].store(ver[a].load() + 1);
+    active.store(a ^ 1);
+    dom.synchronize();
+    op(*side[a]);
+    ver[a].store(ver[a ^ 1].load());
+    return rc;
+}
+
+} //namespace
+#endif// __RTACL_EPOCH_HPP__
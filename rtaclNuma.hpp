@@ -0,0 +1,483 @@
+#ifndef __RTACL_NUMA_HPP__
+#define __RTACL_NUMA_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * NUMA-aware replicated R-tree ACL
+ *
+ * rtacl::numaDb keeps a read-only snapshot of the ACL in the
+ * memory local to each NUMA node. Lookups use the replica of the
+ * node the calling thread is running on. Updates are made to the
+ * master copy and reach all the replicas at once by commit().
+ *
+ * Memory placement:
+ *   -DRTACL_USE_LIBNUMA: libnuma (link with -lnuma)
+ *   Linux:               set_mempolicy(2) and sched_setaffinity(2)
+ *   Others:              a single replica (no NUMA awareness)
+ * The R-tree nodes of a replica come from an rtacl::arena whose
+ * chunks are bound to the node by mbind(2) (MPOL_BIND), so a
+ * replica is on its node or commit() fails with std::bad_alloc;
+ * a policy or a heap arena touched on another node cannot move it.
+ */
+
+#include "rtacl.hpp"
+#include "rtaclEpoch.hpp"
+#include "rtaclPool.hpp"
+
+#include <sched.h>
+#include <pthread.h>
+
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(RTACL_USE_LIBNUMA)
+#include <numa.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+namespace rtacl {
+
+namespace numa {
+
+/**
+ * @name  parseList
+ * @brief Parses a sysfs list (e.g., "0-3,8-11")
+ *
+ * @param[in]  s   List string
+ * @param[out] ids List of the numbers
+ */
+inline void
+parseList (const std::string& s, std::vector<int>& ids)
+{
+    const char* p = s.c_str();
+    while (*p != '\0' && *p != '\n') {
+        char* end;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (end == p) {
+            return;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+        }
+        for (long i = lo; i <= hi; ++i) {
+            ids.push_back(static_cast<int>(i));
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+}
+
+/**
+ * @class rtacl::numa::topology
+ * @brief NUMA nodes and their CPUs
+ *        Single node (node 0 with all the CPUs) if NUMA is not
+ *        supported.
+ */
+class topology {
+private:
+    std::vector<std::vector<int> > cpus;  // cpus[node]: CPUs of node
+    std::vector<int> cpu2node;
+    bool supported;                       // false: fallback
+public:
+    topology();
+    static const topology& get () {
+        static topology t;
+        return t;
+    };
+    size_t nodes () const { return cpus.size(); };
+    bool available () const { return supported; };
+    int node(int cpu) const;
+    int currentNode() const;
+    bool runOnNode(int node) const;
+    bool bindMemory(int node) const;
+};
+
+/**
+ * @name  topology::topology
+ * @brief Constructor
+ *        Reads the NUMA topology
+ */
+inline
+topology::topology () : supported(false)
+{
+#if defined(RTACL_USE_LIBNUMA)
+    if (numa_available() >= 0) {
+        int max = numa_max_node();
+        int ncpu = numa_num_configured_cpus();
+        cpus.resize(max + 1);
+        cpu2node.resize(ncpu, 0);
+        for (int c = 0; c < ncpu; ++c) {
+            int n = numa_node_of_cpu(c);
+            if (n >= 0 && n <= max) {
+                cpus[n].push_back(c);
+                cpu2node[c] = n;
+            }
+        }
+        supported = true;
+    }
+#elif defined(__linux__)
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string s;
+    std::vector<int> nodes;
+    if (in && std::getline(in, s)) {
+        parseList(s, nodes);
+    }
+    for (int n : nodes) {
+        std::ifstream cl(std::string("/sys/devices/system/node/node") +
+                         std::to_string(n) + "/cpulist");
+        std::vector<int> c;
+        if (cl && std::getline(cl, s)) {
+            parseList(s, c);
+        }
+        if (cpus.size() <= static_cast<size_t>(n)) {
+            cpus.resize(n + 1);
+        }
+        cpus[n] = c;
+        for (int i : c) {
+            if (cpu2node.size() <= static_cast<size_t>(i)) {
+                cpu2node.resize(i + 1, 0);
+            }
+            cpu2node[i] = n;
+        }
+    }
+    supported = !cpus.empty();
+#endif
+    if (!supported) {
+        /*
+         * Fallback: node 0 only
+         */
+        cpus.assign(1, std::vector<int>());
+        long n = sysconf(_SC_NPROCESSORS_CONF);
+        for (long i = 0; i < n; ++i) {
+            cpus[0].push_back(static_cast<int>(i));
+        }
+        cpu2node.assign(n, 0);
+    }
+}
+
+/**
+ * @name  topology::node
+ * @brief Returns the NUMA node of \b cpu
+ */
+inline int
+topology::node (int cpu) const
+{
+    if (cpu < 0 || static_cast<size_t>(cpu) >= cpu2node.size()) {
+        return 0;
+    }
+    return cpu2node[cpu];
+}
+
+/**
+ * @name  topology::currentNode
+ * @brief Returns the NUMA node the calling thread is running on
+ */
+inline int
+topology::currentNode () const
+{
+#if defined(__linux__)
+    if (supported) {
+        return node(sched_getcpu());
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @name  topology::runOnNode
+ * @brief Restricts the calling thread to the CPUs of \b node
+ *
+ * @retval true  Success
+ * @retval false NUMA is not supported or failed
+ */
+inline bool
+topology::runOnNode (int node) const
+{
+    if (!supported || node < 0 || static_cast<size_t>(node) >= nodes()) {
+        return false;
+    }
+#if defined(RTACL_USE_LIBNUMA)
+    return (numa_run_on_node(node) == 0);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus[node]) {
+        CPU_SET(c, &set);
+    }
+    return (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0);
+#else
+    return false;
+#endif
+}
+
+/**
+ * @name  topology::bindMemory
+ * @brief Makes the memory allocated by the calling thread come
+ *        from \b node only (MPOL_BIND)
+ *
+ * @retval true  Success
+ * @retval false NUMA is not supported or failed
+ */
+inline bool
+topology::bindMemory (int node) const
+{
+    if (!supported || node < 0 || static_cast<size_t>(node) >= nodes()) {
+        return false;
+    }
+#if defined(RTACL_USE_LIBNUMA)
+    struct bitmask* mask = numa_allocate_nodemask();
+    numa_bitmask_setbit(mask, node);
+    numa_set_membind(mask);
+    numa_free_nodemask(mask);
+    return true;
+#elif defined(__linux__)
+    enum { maxNodes = 1024 };
+    unsigned long mask[maxNodes / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    if (node >= maxNodes) {
+        return false;
+    }
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    return (syscall(SYS_set_mempolicy, MPOL_BIND,
+                    mask, maxNodes + 1) == 0);
+#else
+    return false;
+#endif
+}
+
+} // namespace numa
+
+/**
+ * @class rtacl::numaDb
+ * @brief NUMA-aware replicated R-tree ACL
+ *        \e insert() and \e remove() update the master copy.
+ *        \e commit() bulk-loads a read-only replica of the master
+ *        copy on each NUMA node (by a thread running on the node
+ *        with its memory policy and an \e rtacl::arena bound to
+ *        the node), then publishes
+ *        all the replicas at once. \e find() is lock-free with
+ *        respect to the writer and uses the replica of the node
+ *        the calling thread is running on. Readers load a raw
+ *        pointer to the replicas inside an epoch section, so a
+ *        lookup writes nothing shared (no reference count); the
+ *        \e shared_ptr owning the replicas is released by the
+ *        writer through \e epoch::retire() after a grace period.
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ */
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t>
+class numaDb
+{
+private:
+    typedef db<ADDR, VALUE> dbType;
+    typedef poolAllocator<entry<ADDR, VALUE> > allocType;
+    typedef db<ADDR, VALUE, dim, allocType> replicaType;
+    struct replica {
+        allocType alloc;        // arena bound to the node
+        std::shared_ptr<const replicaType> acl;
+    };
+    typedef std::vector<replica> replicas;
+
+    dbType master;
+    std::shared_ptr<const replicas> snap;   // owner (writer side)
+    std::atomic<const replicas*> cur;       // read by the readers
+    mutable epoch dom;
+    std::mutex wlock;           // serializes writers
+public:
+    numaDb();
+    void insert (entry<ADDR, VALUE> const& ent) {
+        std::lock_guard<std::mutex> l(wlock);
+        master.insert(ent);
+    };
+    bool remove (entry<ADDR, VALUE> const& ent) {
+        std::lock_guard<std::mutex> l(wlock);
+        return master.remove(ent);
+    };
+    void commit();
+    result<ADDR, VALUE> find(const tuple<ADDR>& key) const;
+    result<ADDR, VALUE> find(const tuple<ADDR>& key, int node) const;
+    size_t size () const {
+        epoch::guard g(dom);
+        return local(0)->size();
+    };
+    size_t nodes() const { return numa::topology::get().nodes(); };
+    size_t misplaced() const;
+    dbType& getMaster () { return master; };
+private:
+    const replicaType* local(int node) const;
+};
+
+/**
+ * @name  numaDb<ADDR, VALUE>::numaDb
+ * @brief Constructor
+ */
+template <class ADDR, class VALUE>
+inline
+numaDb<ADDR, VALUE>::numaDb () : cur(nullptr)
+{
+    commit();
+}
+
+/**
+ * @name  numaDb<ADDR, VALUE>::commit
+ * @brief Public function
+ *        Publishes the master copy to all the NUMA nodes
+ */
+template <class ADDR, class VALUE>
+inline void
+numaDb<ADDR, VALUE>::commit ()
+{
+    std::lock_guard<std::mutex> l(wlock);
+    const numa::topology& topo = numa::topology::get();
+    std::shared_ptr<replicas> r = std::make_shared<replicas>(topo.nodes());
+    result<ADDR, VALUE> ents = master.dump();
+
+    if (!topo.available()) {
+        replica& p = (*r)[0];
+        p.acl = std::make_shared<const replicaType>(ents.begin(), ents.end(),
+                                                    p.alloc);
+    } else {
+        std::vector<std::thread> th;
+        std::vector<std::exception_ptr> err(topo.nodes());
+        for (size_t n = 0; n < topo.nodes(); ++n) {
+            th.push_back(std::thread([&topo, &ents, &r, &err, n]() {
+                        try {
+                            replica& p = (*r)[n];
+                            topo.runOnNode(n);
+                            topo.bindMemory(n);
+                            p.alloc = allocType(0, false, n);
+                            p.acl = std::make_shared<const replicaType>(
+                                ents.begin(), ents.end(), p.alloc);
+                        } catch (...) {
+                            err[n] = std::current_exception();
+                        }
+                    }));
+        }
+        for (auto& t : th) {
+            t.join();
+        }
+        for (auto& e : err) {
+            if (e) {
+                std::rethrow_exception(e);
+            }
+        }
+    }
+    /*
+     * Publish, then release the old replicas after the readers
+     * have moved past
+     */
+    std::shared_ptr<const replicas> old = snap;
+    snap = r;
+    cur.store(snap.get(), std::memory_order_release);
+    dom.retire([old]() mutable { old.reset(); });
+    dom.reclaim();
+}
+
+/**
+ * @name  numaDb<ADDR, VALUE>::local
+ * @brief Private function
+ *        Returns the replica on \b node (valid until the caller
+ *        leaves its epoch section)
+ */
+template <class ADDR, class VALUE>
+inline const typename numaDb<ADDR, VALUE>::replicaType*
+numaDb<ADDR, VALUE>::local (int node) const
+{
+    const replicas* r = cur.load(std::memory_order_acquire);
+    if (node < 0 || static_cast<size_t>(node) >= r->size() ||
+        !(*r)[node].acl) {
+        node = 0;
+    }
+    return (*r)[node].acl.get();
+}
+
+/**
+ * @name  numaDb<ADDR, VALUE>::misplaced
+ * @brief Public function
+ *        Returns the number of the pages of the published replicas
+ *        that are not on their nodes (see \e arena::misplaced())
+ */
+template <class ADDR, class VALUE>
+inline size_t
+numaDb<ADDR, VALUE>::misplaced () const
+{
+    epoch::guard g(dom);
+    const replicas* r = cur.load(std::memory_order_acquire);
+    size_t n = 0;
+
+    for (auto& p : *r) {
+        n += p.alloc.getArena().misplaced();
+    }
+    return n;
+}
+
+/**
+ * @name  numaDb<ADDR, VALUE>::find
+ * @brief Public function
+ *        Tries to find R-tree entries matching \b key in the
+ *        replica local to the calling thread
+ *
+ * @param[in] key ACL search key
+ *
+ * @retval rtacl::result<ADDR, VALUE> Search result
+ */
+template <class ADDR, class VALUE>
+inline result<ADDR, VALUE>
+numaDb<ADDR, VALUE>::find (const tuple<ADDR>& key) const
+{
+    epoch::guard g(dom);
+    return local(numa::topology::get().currentNode())->find(key);
+}
+
+/**
+ * @name  numaDb<ADDR, VALUE>::find
+ * @brief Public function
+ *        Tries to find R-tree entries matching \b key in the
+ *        replica on \b node (e.g., to measure remote access)
+ *
+ * @param[in] key  ACL search key
+ * @param[in] node NUMA node
+ *
+ * @retval rtacl::result<ADDR, VALUE> Search result
+ */
+template <class ADDR, class VALUE>
+inline result<ADDR, VALUE>
+numaDb<ADDR, VALUE>::find (const tuple<ADDR>& key, int node) const
+{
+    epoch::guard g(dom);
+    return local(node)->find(key);
+}
+
+} //namespace
+#endif// __RTACL_NUMA_HPP__
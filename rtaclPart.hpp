@@ -0,0 +1,648 @@
+#ifndef __RTACL_PART_HPP__
+#define __RTACL_PART_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Wildcard-aware partitioned R-tree ACL
+ *
+ * rtacl::partDb groups the rules by the set of the fields that are
+ * not wildcarded (e.g., {src IP, dst IP} for the rules with any
+ * port, protocol, and DSCP) and keeps each group in its own R-tree
+ * that indexes only those fields. The wildcarded fields no longer
+ * make the boxes huge slabs overlapping all the others, so each
+ * tree has less MBR overlap. A lookup queries the partitions whose
+ * bounds contain the key and merges the results by priority.
+ *
+ * rtacl::tierDb stores the rules in tiers by the size of their
+ * address ranges so that a few broad rules (e.g., 0.0.0.0/0 as the
+ * destination) do not enlarge the MBRs above millions of host
+ * rules. A lookup checks the small tier of the broad rules first.
+ */
+
+#include "rtacl.hpp"
+
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace rtacl {
+
+/**
+ * @class rtacl::partDb
+ * @brief Wildcard-aware partitioned R-tree ACL
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ * @param PRIO  Priority order of \b VALUE: PRIO()(a, b) is true if
+ *              \b a takes precedence over \b b (no default: the
+ *              payload says nothing about the priority by itself)
+ */
+template <class ADDR, class VALUE, class PRIO>
+class partDb
+{
+private:
+    /*
+     * R-tree of K fields and the bounds of the rules inserted
+     * (not shrunk by the removes)
+     */
+    template <size_t K>
+    struct slice {
+        db<ADDR, VALUE, K> rules;
+        range<ADDR, K> bounds;
+    };
+    /*
+     * Partitions of K fields: bit i of the key is set if the
+     * i-th field is not wildcarded
+     */
+    template <size_t K>
+    using part = std::map<u32, slice<K> >;
+    template <size_t K>
+    using dimTag = std::integral_constant<size_t, K>;
+
+    std::tuple<part<1>, part<2>, part<3>,
+               part<4>, part<5>, part<6> > parts;
+    result<ADDR, VALUE> wild;   // all the fields are wildcarded
+    db<ADDR, VALUE> keyDb;      // makeMin(), makeMax(), makeKey()
+    size_t n;
+public:
+    partDb() : n(0) {};
+    void insert(entry<ADDR, VALUE> const& ent);
+    bool remove(entry<ADDR, VALUE> const& ent);
+    result<ADDR, VALUE> find(const tuple<ADDR>& key) const;
+    result<ADDR, VALUE> classifyPacket (const u8* l3hdr,
+                                        size_t len) const {
+        tuple<ADDR> key;
+        if (!keyDb.makeKey(l3hdr, len, key)) {
+            return result<ADDR, VALUE>();
+        }
+        return find(key);
+    };
+    size_t size () const { return n; };
+    size_t partitions() const;
+    static u32 fieldMask(const range<ADDR>& r);
+
+    template <class... ARGS>
+    void makeMin (ARGS&&... args) {
+        keyDb.makeMin(std::forward<ARGS>(args)...);
+    };
+    template <class... ARGS>
+    void makeMax (ARGS&&... args) {
+        keyDb.makeMax(std::forward<ARGS>(args)...);
+    };
+    template <class... ARGS>
+    void makeKey (ARGS&&... args) {
+        keyDb.makeKey(std::forward<ARGS>(args)...);
+    };
+private:
+    template <size_t K>
+    static void project(u32 mask, const tuple<ADDR>& t,
+                        tuple<ADDR, K>& p);
+    template <size_t K>
+    static void lift(u32 mask, const range<ADDR, K>& p, range<ADDR>& r);
+    template <size_t K>
+    void insertPart(u32 mask, entry<ADDR, VALUE> const& ent, dimTag<K>);
+    void insertPart (u32, entry<ADDR, VALUE> const&, dimTag<dim + 1>) {};
+    template <size_t K>
+    bool removePart(u32 mask, entry<ADDR, VALUE> const& ent, dimTag<K>);
+    bool removePart (u32, entry<ADDR, VALUE> const&, dimTag<dim + 1>) {
+        return false;
+    };
+    template <size_t K>
+    void findParts(const tuple<ADDR>& key, result<ADDR, VALUE>& r,
+                   dimTag<K>) const;
+    void findParts (const tuple<ADDR>&, result<ADDR, VALUE>&,
+                    dimTag<dim + 1>) const {};
+};
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::fieldMask
+ * @brief Public function
+ *        Returns the set of the fields of \b r that are not
+ *        wildcarded (bit i: the i-th field)
+ *
+ * @param[in] r Range of 6-tuple
+ */
+template <class ADDR, class VALUE, class PRIO>
+inline u32
+partDb<ADDR, VALUE, PRIO>::fieldMask (const range<ADDR>& r)
+{
+    const s32 omin = offsetMin;
+    const s32 omax = offsetMax;
+    ADDR lo[dim];
+    ADDR hi[dim];
+    u32 mask = 0;
+    size_t i;
+
+    fields<0, dim>::get(r.min_corner(), lo);
+    fields<0, dim>::get(r.max_corner(), hi);
+    for (i = 0; i < dim; ++i) {
+        if (lo[i] > omin || hi[i] < fieldMax<ADDR>(i) + omax) {
+            mask |= 1U << i;
+        }
+    }
+    return mask;
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::project
+ * @brief Private function
+ *        Picks up the fields in \b mask from \b t
+ *
+ * @param K Number of the bits set in \b mask
+ */
+template <class ADDR, class VALUE, class PRIO>
+template <size_t K>
+inline void
+partDb<ADDR, VALUE, PRIO>::project (u32 mask, const tuple<ADDR>& t,
+                                    tuple<ADDR, K>& p)
+{
+    ADDR a[dim];
+    ADDR b[K] = {};
+    size_t i, j;
+
+    fields<0, dim>::get(t, a);
+    for (i = 0, j = 0; i < dim; ++i) {
+        if (mask & (1U << i)) {
+            b[j++] = a[i];
+        }
+    }
+    fields<0, K>::set(p, b);
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::lift
+ * @brief Private function
+ *        Restores the 6-tuple range from a range of the fields in
+ *        \b mask (the other fields are wildcards)
+ *
+ * @param K Number of the bits set in \b mask
+ */
+template <class ADDR, class VALUE, class PRIO>
+template <size_t K>
+inline void
+partDb<ADDR, VALUE, PRIO>::lift (u32 mask, const range<ADDR, K>& p,
+                                 range<ADDR>& r)
+{
+    const s32 omin = offsetMin;
+    const s32 omax = offsetMax;
+    ADDR plo[K];
+    ADDR phi[K];
+    ADDR lo[dim];
+    ADDR hi[dim];
+    size_t i, j;
+
+    fields<0, K>::get(p.min_corner(), plo);
+    fields<0, K>::get(p.max_corner(), phi);
+    for (i = 0, j = 0; i < dim; ++i) {
+        if (mask & (1U << i)) {
+            lo[i] = plo[j];
+            hi[i] = phi[j++];
+        } else {
+            lo[i] = omin;
+            hi[i] = fieldMax<ADDR>(i) + omax;
+        }
+    }
+    fields<0, dim>::set(r.min_corner(), lo);
+    fields<0, dim>::set(r.max_corner(), hi);
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::insert
+ * @brief Public function
+ *        Inserts \b ent into the partition of its non-wildcard fields
+ */
+template <class ADDR, class VALUE, class PRIO>
+inline void
+partDb<ADDR, VALUE, PRIO>::insert (entry<ADDR, VALUE> const& ent)
+{
+    u32 mask = fieldMask(ent.first);
+
+    if (mask == 0) {
+        wild.push_back(ent);
+    } else {
+        insertPart(mask, ent, dimTag<1>());
+    }
+    ++n;
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::insertPart
+ * @brief Private function
+ *        Inserts \b ent into the partition \b mask if it has \b K
+ *        fields, otherwise tries \b K + 1
+ */
+template <class ADDR, class VALUE, class PRIO>
+template <size_t K>
+inline void
+partDb<ADDR, VALUE, PRIO>::insertPart (u32 mask,
+                                       entry<ADDR, VALUE> const& ent,
+                                       dimTag<K>)
+{
+    if (static_cast<size_t>(__builtin_popcount(mask)) != K) {
+        insertPart(mask, ent, dimTag<K + 1>());
+        return;
+    }
+    entry<ADDR, VALUE, K> e;
+    project(mask, ent.first.min_corner(), e.first.min_corner());
+    project(mask, ent.first.max_corner(), e.first.max_corner());
+    e.second = ent.second;
+    slice<K>& s = std::get<K - 1>(parts)[mask];
+    if (s.rules.size() == 0) {
+        s.bounds = e.first;
+    } else {
+        bg::expand(s.bounds, e.first);
+    }
+    s.rules.insert(e);
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::remove
+ * @brief Public function
+ *        Removes \b ent
+ *
+ * @retval true  \b ent was removed
+ * @retval false \b ent was not found
+ */
+template <class ADDR, class VALUE, class PRIO>
+inline bool
+partDb<ADDR, VALUE, PRIO>::remove (entry<ADDR, VALUE> const& ent)
+{
+    u32 mask = fieldMask(ent.first);
+    bool rc;
+
+    if (mask == 0) {
+        auto it = std::find_if(wild.begin(), wild.end(),
+                               [&ent](const entry<ADDR, VALUE>& e) {
+                                   return (bg::equals(e.first, ent.first) &&
+                                           e.second == ent.second);
+                               });
+        rc = (it != wild.end());
+        if (rc) {
+            wild.erase(it);
+        }
+    } else {
+        rc = removePart(mask, ent, dimTag<1>());
+    }
+    if (rc) {
+        --n;
+    }
+    return rc;
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::removePart
+ * @brief Private function
+ *        Removes \b ent from the partition \b mask (deleted when
+ *        it gets empty)
+ */
+template <class ADDR, class VALUE, class PRIO>
+template <size_t K>
+inline bool
+partDb<ADDR, VALUE, PRIO>::removePart (u32 mask,
+                                       entry<ADDR, VALUE> const& ent,
+                                       dimTag<K>)
+{
+    if (static_cast<size_t>(__builtin_popcount(mask)) != K) {
+        return removePart(mask, ent, dimTag<K + 1>());
+    }
+    part<K>& p = std::get<K - 1>(parts);
+    auto it = p.find(mask);
+    if (it == p.end()) {
+        return false;
+    }
+    entry<ADDR, VALUE, K> e;
+    project(mask, ent.first.min_corner(), e.first.min_corner());
+    project(mask, ent.first.max_corner(), e.first.max_corner());
+    e.second = ent.second;
+    if (!it->second.rules.remove(e)) {
+        return false;
+    }
+    if (it->second.rules.size() == 0) {
+        p.erase(it);
+    }
+    return true;
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::find
+ * @brief Public function
+ *        Searches the partitions for \b key
+ *
+ * @param[in] key 6-tuple to be searched
+ *
+ * @retval rtacl::result<ADDR, VALUE> The matched entries in the
+ *         order of \b PRIO (the first one has the highest priority)
+ */
+template <class ADDR, class VALUE, class PRIO>
+inline result<ADDR, VALUE>
+partDb<ADDR, VALUE, PRIO>::find (const tuple<ADDR>& key) const
+{
+    result<ADDR, VALUE> r(wild);
+
+    findParts(key, r, dimTag<1>());
+    if (r.size() < 2) {
+        return r;
+    }
+    std::stable_sort(r.begin(), r.end(),
+                     [](const entry<ADDR, VALUE>& a,
+                        const entry<ADDR, VALUE>& b) {
+                         return PRIO()(a.second, b.second);
+                     });
+    return r;
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::findParts
+ * @brief Private function
+ *        Searches the partitions of \b K, ..., 6 fields whose
+ *        bounds contain \b key
+ */
+template <class ADDR, class VALUE, class PRIO>
+template <size_t K>
+inline void
+partDb<ADDR, VALUE, PRIO>::findParts (const tuple<ADDR>& key,
+                                      result<ADDR, VALUE>& r,
+                                      dimTag<K>) const
+{
+    tuple<ADDR, K> k;
+
+    for (auto& p : std::get<K - 1>(parts)) {
+        const u32 mask = p.first;
+        project(mask, key, k);
+        if (!bg::covered_by(k, p.second.bounds)) {
+            continue;
+        }
+        p.second.rules.query(k, boost::make_function_output_iterator(
+                           [&](const entry<ADDR, VALUE, K>& m) {
+                               entry<ADDR, VALUE> e;
+                               lift(mask, m.first, e.first);
+                               e.second = m.second;
+                               r.push_back(e);
+                           }));
+    }
+    findParts(key, r, dimTag<K + 1>());
+}
+
+/**
+ * @name  partDb<ADDR, VALUE, PRIO>::partitions
+ * @brief Public function
+ *        Returns the number of the partitions (R-trees, plus one
+ *        if there are rules with all the fields wildcarded)
+ */
+template <class ADDR, class VALUE, class PRIO>
+inline size_t
+partDb<ADDR, VALUE, PRIO>::partitions () const
+{
+    return (std::get<0>(parts).size() + std::get<1>(parts).size() +
+            std::get<2>(parts).size() + std::get<3>(parts).size() +
+            std::get<4>(parts).size() + std::get<5>(parts).size() +
+            (wild.empty() ? 0 : 1));
+}
+
+/**
+ * @name  addrBits
+ * @brief Returns log2 of the number of the addresses (or values)
+ *        in the range (\b min, \b max) stored with the offsets
+ */
+inline u32
+addrBits (const rtacl::ipv4a min, const rtacl::ipv4a max)
+{
+    u64 width = max - min - 1;
+    return 63 - __builtin_clzll(width);
+}
+
+inline u32
+addrBits (const rtacl::ipv6a& min, const rtacl::ipv6a& max)
+{
+    rtacl::ipv6a width = max - min - 1;
+    return boost::multiprecision::msb(width);
+}
+
+/**
+ * @class rtacl::tierDb
+ * @brief R-tree ACL stratified by the size of the address ranges
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ */
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t>
+class tierDb
+{
+private:
+    std::vector<u32> bounds;    // lower bound of breadth() per tier
+    std::vector<std::unique_ptr<db<ADDR, VALUE> > > tiers;
+public:
+    explicit tierDb(const std::vector<u32>& bounds = defaultBounds());
+    void insert (entry<ADDR, VALUE> const& ent) {
+        tiers[tierOf(ent.first)]->insert(ent);
+    };
+    bool remove (entry<ADDR, VALUE> const& ent) {
+        return tiers[tierOf(ent.first)]->remove(ent);
+    };
+    result<ADDR, VALUE> find(const tuple<ADDR>& key) const;
+    result<ADDR, VALUE> classifyPacket (const u8* l3hdr,
+                                        size_t len) const {
+        tuple<ADDR> key;
+        if (!tiers[0]->makeKey(l3hdr, len, key)) {
+            return result<ADDR, VALUE>();
+        }
+        return find(key);
+    };
+    bool matchesAny(const tuple<ADDR>& key) const;
+    size_t countMatches(const tuple<ADDR>& key) const;
+    size_t size() const;
+    size_t nTiers () const { return tiers.size(); };
+    size_t tierSize (size_t i) const { return tiers[i]->size(); };
+    size_t tierOf(const range<ADDR>& r) const;
+    static u32 breadth(const range<ADDR>& r);
+    static std::vector<u32> defaultBounds();
+
+    template <class... ARGS>
+    void makeMin (ARGS&&... args) {
+        tiers[0]->makeMin(std::forward<ARGS>(args)...);
+    };
+    template <class... ARGS>
+    void makeMax (ARGS&&... args) {
+        tiers[0]->makeMax(std::forward<ARGS>(args)...);
+    };
+    template <class... ARGS>
+    void makeKey (ARGS&&... args) {
+        tiers[0]->makeKey(std::forward<ARGS>(args)...);
+    };
+};
+
+/**
+ * @name  tierDb<ADDR, VALUE>::tierDb
+ * @brief Constructor
+ *
+ * @param[in] bounds The i-th tier keeps the rules whose breadth()
+ *                   is \b bounds[i] or more (descending order);
+ *                   the last tier keeps the rest
+ */
+template <class ADDR, class VALUE>
+inline
+tierDb<ADDR, VALUE>::tierDb (const std::vector<u32>& bounds)
+    : bounds(bounds)
+{
+    size_t i;
+
+    assert(std::is_sorted(bounds.rbegin(), bounds.rend()));
+    for (i = 0; i <= bounds.size(); ++i) {
+        tiers.emplace_back(new db<ADDR, VALUE>);
+    }
+}
+
+/**
+ * @name  tierDb<ADDR, VALUE>::defaultBounds
+ * @brief Public function
+ *        Returns the default tiers: the rules covering an address
+ *        space as large as the whole source (or destination)
+ *        space, half of it in bits, and the rest
+ *        (e.g., IPv4: 32 and 16 bits)
+ */
+template <class ADDR, class VALUE>
+inline std::vector<u32>
+tierDb<ADDR, VALUE>::defaultBounds ()
+{
+    u32 bits = addrBits(ADDR(-1), fieldMax<ADDR>(0) + 1);
+    return std::vector<u32>{ bits, bits / 2 };
+}
+
+/**
+ * @name  tierDb<ADDR, VALUE>::breadth
+ * @brief Public function
+ *        Returns log2 of the number of the (source, destination)
+ *        address pairs covered by \b r
+ *        (e.g., 10.0.0.0/8 to 0.0.0.0/0: 24 + 32 = 56)
+ */
+template <class ADDR, class VALUE>
+inline u32
+tierDb<ADDR, VALUE>::breadth (const range<ADDR>& r)
+{
+    return (addrBits(bg::get<0>(r.min_corner()),
+                     bg::get<0>(r.max_corner())) +
+            addrBits(bg::get<1>(r.min_corner()),
+                     bg::get<1>(r.max_corner())));
+}
+
+/**
+ * @name  tierDb<ADDR, VALUE>::tierOf
+ * @brief Public function
+ *        Returns the tier of \b r (0: the broadest)
+ */
+template <class ADDR, class VALUE>
+inline size_t
+tierDb<ADDR, VALUE>::tierOf (const range<ADDR>& r) const
+{
+    u32 b = breadth(r);
+    size_t i;
+
+    for (i = 0; i < bounds.size(); ++i) {
+        if (b >= bounds[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * @name  tierDb<ADDR, VALUE>::find
+ * @brief Public function
+ *        Searches all the tiers for \b key, the broadest first
+ *
+ * @retval rtacl::result<ADDR, VALUE> The matched entries of the
+ *         broader tiers come first
+ */
+template <class ADDR, class VALUE>
+inline result<ADDR, VALUE>
+tierDb<ADDR, VALUE>::find (const tuple<ADDR>& key) const
+{
+    result<ADDR, VALUE> r;
+
+    for (auto& t : tiers) {
+        t->query(key, std::back_inserter(r));
+    }
+    return r;
+}
+
+/**
+ * @name  tierDb<ADDR, VALUE>::matchesAny
+ * @brief Public function
+ *        Returns true if an entry matches \b key
+ *        (stops at the first tier having a match)
+ */
+template <class ADDR, class VALUE>
+inline bool
+tierDb<ADDR, VALUE>::matchesAny (const tuple<ADDR>& key) const
+{
+    for (auto& t : tiers) {
+        if (t->matchesAny(key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @name  tierDb<ADDR, VALUE>::countMatches
+ * @brief Public function
+ *        Returns the number of the entries matching \b key
+ */
+template <class ADDR, class VALUE>
+inline size_t
+tierDb<ADDR, VALUE>::countMatches (const tuple<ADDR>& key) const
+{
+    size_t n = 0;
+
+    for (auto& t : tiers) {
+        n += t->countMatches(key);
+    }
+    return n;
+}
+
+/**
+ * @name  tierDb<ADDR, VALUE>::size
+ * @brief Public function
+ *        Returns the number of the entries in all the tiers
+ */
+template <class ADDR, class VALUE>
+inline size_t
+tierDb<ADDR, VALUE>::size () const
+{
+    size_t n = 0;
+
+    for (auto& t : tiers) {
+        n += t->size();
+    }
+    return n;
+}
+
+} //namespace
+#endif// __RTACL_PART_HPP__
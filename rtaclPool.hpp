@@ -0,0 +1,384 @@
+#ifndef __RTACL_POOL_HPP__
+#define __RTACL_POOL_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Node pool allocator for rtacl::db
+ *
+ * rtacl::poolAllocator carves the R-tree nodes out of large chunks
+ * (arena) obtained by mmap(2) so that the nodes of an ACL are
+ * packed in a few pages instead of being scattered across the
+ * heap. Freed nodes are kept in per-size free lists and reused.
+ * The chunks can be backed by 2MB huge pages (MAP_HUGETLB, or
+ * transparent huge pages via madvise(2) if no huge pages are
+ * reserved) to reduce TLB misses. An arena made for a NUMA node
+ * binds its chunks to the node by mbind(2) with MPOL_BIND before
+ * they are touched, so the nodes of an ACL are on that node or the
+ * allocation fails (Linux only); misplaced() checks the pages by
+ * move_pages(2).
+ *
+ *   rtacl::poolAllocator<rtacl::entry<rtacl::ipv4a> > a(0, true);
+ *   rtacl::db<rtacl::ipv4a, uintptr_t, rtacl::dim,
+ *             rtacl::poolAllocator<rtacl::entry<rtacl::ipv4a> > > acl(a);
+ */
+
+#include "rtacl.hpp"
+
+#include <sys/mman.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <unistd.h>
+#endif
+
+namespace rtacl {
+
+/**
+ * @class rtacl::arena
+ * @brief Memory chunks and per-size free lists
+ *        Not thread-safe (as the updates of \e rtacl::db.)
+ */
+class arena {
+public:
+    enum {
+        hugePageSize = 2 * 1024 * 1024,
+        align        = 16,              // granularity of the sizes
+        maxSmall     = 16 * 1024,       // larger blocks: operator new
+    };
+private:
+    struct freeBlock {
+        freeBlock* next;
+    };
+    std::vector<std::pair<void*, size_t> > chunks;
+    std::vector<freeBlock*> freeLists;  // freeLists[bytes / align]
+    u8* cur;                            // unused part of the last chunk
+    size_t left;
+    size_t chunkSize;
+    bool huge;                          // use huge pages
+    size_t hugeChunks;                  // chunks backed by MAP_HUGETLB
+    int node;                           // NUMA node (-1: any)
+public:
+    explicit arena(size_t chunkSize = hugePageSize, bool hugePages = false,
+                   int node = -1);
+    ~arena();
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+    void* allocate(size_t bytes);
+    void deallocate(void* p, size_t bytes);
+    size_t reserved () const { return chunks.size() * chunkSize; };
+    size_t hugeTlbChunks () const { return hugeChunks; };
+    int numaNode () const { return node; };
+    size_t misplaced() const;
+private:
+    static size_t roundUp (size_t n, size_t a) {
+        return (n + a - 1) / a * a;
+    };
+    void newChunk();
+    bool bind(void* p, size_t len) const;
+};
+
+/**
+ * @name  arena::arena
+ * @brief Constructor
+ *
+ * @param[in] chunkSize Size of a chunk (rounded up to 2MB if
+ *                      \b hugePages is true, 0: 2MB)
+ * @param[in] hugePages Back the chunks by huge pages
+ * @param[in] node      NUMA node to bind the chunks to (-1: any);
+ *                      the blocks larger than \e maxSmall are
+ *                      mapped and bound one by one
+ */
+inline
+arena::arena (size_t chunkSize, bool hugePages, int node)
+    : freeLists(maxSmall / align + 1, nullptr),
+      cur(nullptr), left(0), huge(hugePages), hugeChunks(0), node(node)
+{
+    if (chunkSize == 0) {
+        chunkSize = hugePageSize;
+    }
+    this->chunkSize = roundUp(chunkSize, huge ? hugePageSize : 4096);
+}
+
+/**
+ * @name  arena::~arena
+ * @brief Destructor
+ *        Returns all the chunks to the system
+ */
+inline
+arena::~arena ()
+{
+    for (auto& c : chunks) {
+        munmap(c.first, c.second);
+    }
+}
+
+/**
+ * @name  arena::newChunk
+ * @brief Private function
+ *        Maps a new chunk. With huge pages, MAP_HUGETLB is tried
+ *        first, then a 2MB aligned mapping with MADV_HUGEPAGE. The
+ *        chunk is bound to \b node before it is touched.
+ */
+inline void
+arena::newChunk ()
+{
+    void* p = MAP_FAILED;
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (huge) {
+#ifdef MAP_HUGETLB
+        p = mmap(nullptr, chunkSize, prot, flags | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            ++hugeChunks;
+        }
+#endif
+        if (p == MAP_FAILED) {
+            /*
+             * Align to 2MB so that THP can back the whole chunk
+             */
+            size_t len = chunkSize + hugePageSize;
+            u8* q = static_cast<u8*>(mmap(nullptr, len, prot, flags, -1, 0));
+            if (q == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            u8* a = reinterpret_cast<u8*>(
+                roundUp(reinterpret_cast<uintptr_t>(q), hugePageSize));
+            if (a > q) {
+                munmap(q, a - q);
+            }
+            if (q + len > a + chunkSize) {
+                munmap(a + chunkSize, (q + len) - (a + chunkSize));
+            }
+            p = a;
+#ifdef MADV_HUGEPAGE
+            madvise(p, chunkSize, MADV_HUGEPAGE);
+#endif
+        }
+    } else {
+        p = mmap(nullptr, chunkSize, prot, flags, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+    }
+    if (!bind(p, chunkSize)) {
+        munmap(p, chunkSize);
+        throw std::bad_alloc();
+    }
+    chunks.push_back(std::make_pair(p, chunkSize));
+    cur = static_cast<u8*>(p);
+    left = chunkSize;
+}
+
+/**
+ * @name  arena::allocate
+ * @brief Public function
+ *        Allocates \b bytes bytes from the free list of the size,
+ *        or from the current chunk
+ *
+ * @param[in] bytes Number of bytes
+ *
+ * @retval void* Allocated memory (aligned to 16 bytes)
+ */
+inline void*
+arena::allocate (size_t bytes)
+{
+    bytes = roundUp(bytes ? bytes : 1, align);
+    if (bytes > maxSmall || bytes > chunkSize) {
+        if (node < 0) {
+            return ::operator new(bytes);
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        if (!bind(p, bytes)) {
+            munmap(p, bytes);
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    freeBlock*& head = freeLists[bytes / align];
+    if (head) {
+        freeBlock* b = head;
+        head = b->next;
+        return b;
+    }
+    if (left < bytes) {
+        /*
+         * The rest of the current chunk goes to the free lists
+         */
+        while (left >= align) {
+            size_t n = std::min(left, static_cast<size_t>(maxSmall));
+            n -= n % align;
+            deallocate(cur, n);
+            cur += n;
+            left -= n;
+        }
+        newChunk();
+    }
+    void* p = cur;
+    cur += bytes;
+    left -= bytes;
+    return p;
+}
+
+/**
+ * @name  arena::deallocate
+ * @brief Public function
+ *        Puts the memory back to the free list of the size
+ *
+ * @param[in] p     Memory returned by \e allocate()
+ * @param[in] bytes Number of bytes given to \e allocate()
+ */
+inline void
+arena::deallocate (void* p, size_t bytes)
+{
+    bytes = roundUp(bytes ? bytes : 1, align);
+    if (bytes > maxSmall || bytes > chunkSize) {
+        if (node < 0) {
+            ::operator delete(p);
+        } else {
+            munmap(p, bytes);
+        }
+        return;
+    }
+    freeBlock* b = static_cast<freeBlock*>(p);
+    b->next = freeLists[bytes / align];
+    freeLists[bytes / align] = b;
+}
+
+/**
+ * @name  arena::bind
+ * @brief Private function
+ *        Binds [\b p, \b p + \b len) to \b node (MPOL_BIND)
+ *
+ * @retval true  Bound, or \b node is -1
+ * @retval false mbind(2) failed or is not supported
+ */
+inline bool
+arena::bind (void* p, size_t len) const
+{
+    if (node < 0) {
+        return true;
+    }
+#if defined(__linux__)
+    enum { maxNodes = 1024 };
+    unsigned long mask[maxNodes / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    if (node >= maxNodes) {
+        return false;
+    }
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    return (syscall(SYS_mbind, p, len, MPOL_BIND, mask,
+                    maxNodes + 1, 0) == 0);
+#else
+    return false;
+#endif
+}
+
+/**
+ * @name  arena::misplaced
+ * @brief Public function
+ *        Returns the number of the pages of the chunks that are not
+ *        on \b node (0 if \b node is -1). The pages not touched
+ *        yet are not counted.
+ */
+inline size_t
+arena::misplaced () const
+{
+    size_t n = 0;
+
+    if (node < 0) {
+        return 0;
+    }
+#if defined(__linux__)
+    enum { batch = 256 };
+    const size_t pg = sysconf(_SC_PAGESIZE);
+    void* pages[batch];
+    int status[batch];
+    for (auto& c : chunks) {
+        for (size_t off = 0; off < c.second; ) {
+            size_t k;
+            for (k = 0; k < batch && off < c.second; ++k, off += pg) {
+                pages[k] = static_cast<u8*>(c.first) + off;
+            }
+            if (syscall(SYS_move_pages, 0, k, pages, nullptr, status,
+                        0) != 0) {
+                return n + k;   // cannot tell: count as misplaced
+            }
+            for (size_t i = 0; i < k; ++i) {
+                n += (status[i] >= 0 && status[i] != node);
+            }
+        }
+    }
+#endif
+    return n;
+}
+
+/**
+ * @class rtacl::poolAllocator
+ * @brief Allocator using \e rtacl::arena
+ *        Copies (including the ones rebound to the other types by
+ *        the R-tree) share the same arena.
+ *
+ * @param T Value type
+ */
+template <class T>
+class poolAllocator {
+private:
+    template <class U> friend class poolAllocator;
+    std::shared_ptr<arena> pool;
+public:
+    typedef T value_type;
+
+    explicit poolAllocator (size_t chunkSize = 0, bool hugePages = false,
+                            int node = -1)
+        : pool(std::make_shared<arena>(chunkSize, hugePages, node)) {};
+    template <class U>
+    poolAllocator (const poolAllocator<U>& a) : pool(a.pool) {};
+    T* allocate (size_t n) {
+        return static_cast<T*>(pool->allocate(n * sizeof(T)));
+    };
+    void deallocate (T* p, size_t n) {
+        pool->deallocate(p, n * sizeof(T));
+    };
+    const arena& getArena () const { return *pool; };
+    template <class U>
+    bool operator== (const poolAllocator<U>& a) const {
+        return pool == a.pool;
+    };
+    template <class U>
+    bool operator!= (const poolAllocator<U>& a) const {
+        return pool != a.pool;
+    };
+};
+
+} //namespace
+#endif// __RTACL_POOL_HPP__
@@ -0,0 +1,533 @@
+#ifndef __RTACL_RFC_HPP__
+#define __RTACL_RFC_HPP__
+
+/*
+ * Copyright (c) 2017 Yoichi Hariguchi
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the
+ * Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall
+ * be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+ * KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Recursive Flow Classification (RFC) engine
+ *
+ * rtacl::rfc precomputes the ACL into lookup tables for the ACLs
+ * that are read-mostly. Each 16-bit (or 8-bit) chunk of the
+ * 6-tuple is mapped to an equivalence class (the set of the rules
+ * the chunk value can match) by a direct table, and the classes are
+ * combined pairwise through cross-product tables until one class,
+ * i.e., the list of the matching rules, remains. A lookup takes a
+ * fixed number of table reads regardless of the overlap of the
+ * rules: up to 8 + 7 for IPv4 and 20 + 19 for IPv6. A chunk that
+ * no rule tells apart (e.g., the lower 64 bits of the addresses if
+ * all the prefixes are /64 or shorter) is folded into another one
+ * and not read. The tables can be large; build() fails if they
+ * exceed the given limit.
+ */
+
+#include "rtacl.hpp"
+
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace rtacl {
+
+/**
+ * @class rtacl::rfc
+ * @brief RFC engine built from R-tree ACL entries
+ *
+ * @param ADDR  \e rtacl::ipv4a (\e s64) or \e rtacl::ipv6a (\e s256)
+ * @param VALUE Payload type (see \e rtacl::entry)
+ */
+template <class ADDR=rtacl::ipv4a, class VALUE=uintptr_t>
+class rfc
+{
+private:
+    /*
+     * Chunks: src IP (16-bit each), dst IP (16-bit each),
+     *         src port, dst port, proto (8-bit), dscp (8-bit)
+     */
+    static const size_t nAddr =
+        std::is_same<ADDR, rtacl::ipv6a>::value ? 8 : 2;
+    static const size_t nChunks = 2 * nAddr + 4;
+
+    typedef std::vector<u64> bitmap;
+    struct bitmapHash {
+        size_t operator() (const bitmap& b) const {
+            u64 h = 14695981039346656037ULL;
+            for (u64 w : b) {
+                h = (h ^ w) * 1099511628211ULL;
+            }
+            return h;
+        };
+    };
+    typedef std::unordered_map<bitmap, u32, bitmapHash> classMap;
+    struct subRule {
+        u32 lo[nChunks];
+        u32 hi[nChunks];
+        u32 rule;
+    };
+    struct phase {
+        u32 a;                  // node of the row
+        u32 b;                  // node of the column
+        u32 nB;                 // number of the classes of b
+        std::vector<u32> table;
+    };
+
+    std::vector<entry<ADDR, VALUE> > rules;
+    std::vector<u32> chunkTable[nChunks];
+    std::vector<u32> live;      // chunks read by a lookup
+    std::vector<phase> phases;
+    std::vector<u32> matchBegin; // per final class
+    std::vector<u32> matchList;  // rule indices
+    size_t nSub;
+public:
+    rfc() : nSub(0) {};
+    template <class IT>
+    bool build(IT first, IT last, size_t maxEntries = 1 << 28);
+    const entry<ADDR, VALUE>* first(const tuple<ADDR>& key) const;
+    result<ADDR, VALUE> find(const tuple<ADDR>& key) const;
+    size_t size () const { return rules.size(); };
+    size_t subRules () const { return nSub; };
+    size_t reads () const { return live.size() + phases.size(); };
+    size_t memory() const;
+private:
+    static size_t chunkBits (size_t c) {
+        return (c < 2 * nAddr + 2) ? 16 : 8;
+    };
+    static u32 chunkOf (const ADDR& a, size_t shift) {
+        return static_cast<u32>((a >> shift) & 0xffff);
+    };
+    static void split(const ADDR& lo, const ADDR& hi, size_t k,
+                      u32 (&plo)[nAddr], u32 (&phi)[nAddr],
+                      std::vector<std::pair<std::vector<u32>,
+                                            std::vector<u32> > >& out);
+    static u32 classOf(classMap& m, std::vector<bitmap>& cls,
+                       const bitmap& b);
+    void clear();
+    u32 classify(const tuple<ADDR>& key) const;
+};
+
+/**
+ * @name  rfc<ADDR, VALUE>::split
+ * @brief Private function
+ *        Splits the address range [\b lo, \b hi] of the lower
+ *        (\e nAddr - \b k) chunks into the pieces each of which is
+ *        a cross product of the chunk ranges (a prefix is a piece)
+ */
+template <class ADDR, class VALUE>
+inline void
+rfc<ADDR, VALUE>::split (const ADDR& lo, const ADDR& hi, size_t k,
+                         u32 (&plo)[nAddr], u32 (&phi)[nAddr],
+                         std::vector<std::pair<std::vector<u32>,
+                                               std::vector<u32> > >& out)
+{
+    if (k == nAddr) {
+        out.push_back(std::make_pair(std::vector<u32>(plo, plo + nAddr),
+                                     std::vector<u32>(phi, phi + nAddr)));
+        return;
+    }
+    size_t shift = 16 * (nAddr - 1 - k);
+    ADDR rest = (ADDR(1) << shift) - 1;
+    u32 lt = chunkOf(lo, shift);
+    u32 ht = chunkOf(hi, shift);
+    ADDR rl = lo & rest;
+    ADDR rh = hi & rest;
+    size_t i;
+
+    if (lt == ht) {
+        plo[k] = phi[k] = lt;
+        split(rl, rh, k + 1, plo, phi, out);
+        return;
+    }
+    u32 mlo = lt;
+    u32 mhi = ht;
+    if (rl != 0) {
+        plo[k] = phi[k] = lt;
+        split(rl, rest, k + 1, plo, phi, out);
+        ++mlo;
+    }
+    if (rh != rest) {
+        --mhi;
+    }
+    if (mlo <= mhi) {
+        plo[k] = mlo;
+        phi[k] = mhi;
+        for (i = k + 1; i < nAddr; ++i) {
+            plo[i] = 0;
+            phi[i] = 0xffff;
+        }
+        out.push_back(std::make_pair(std::vector<u32>(plo, plo + nAddr),
+                                     std::vector<u32>(phi, phi + nAddr)));
+    }
+    if (rh != rest) {
+        plo[k] = phi[k] = ht;
+        split(0, rh, k + 1, plo, phi, out);
+    }
+}
+
+/**
+ * @name  rfc<ADDR, VALUE>::classOf
+ * @brief Private function
+ *        Returns the equivalence class of the rule set \b b
+ *        (a new class is made if not found)
+ */
+template <class ADDR, class VALUE>
+inline u32
+rfc<ADDR, VALUE>::classOf (classMap& m, std::vector<bitmap>& cls,
+                           const bitmap& b)
+{
+    auto it = m.find(b);
+    if (it != m.end()) {
+        return it->second;
+    }
+    u32 id = cls.size();
+    m.emplace(b, id);
+    cls.push_back(b);
+    return id;
+}
+
+/**
+ * @name  rfc<ADDR, VALUE>::clear
+ * @brief Private function
+ *        Deletes all the tables
+ */
+template <class ADDR, class VALUE>
+inline void
+rfc<ADDR, VALUE>::clear ()
+{
+    size_t c;
+
+    rules.clear();
+    for (c = 0; c < nChunks; ++c) {
+        chunkTable[c].clear();
+    }
+    live.clear();
+    phases.clear();
+    matchBegin.clear();
+    matchList.clear();
+    nSub = 0;
+}
+
+/**
+ * @name  rfc<ADDR, VALUE>::build
+ * @brief Public function
+ *        Builds the tables from the R-tree ACL entries
+ *        [\b first, \b last) in the order of priority (the first
+ *        one has the highest priority)
+ *
+ * @param[in] maxEntries The largest number of the entries of the
+ *                       cross-product tables in total
+ *
+ * @retval true  Success
+ * @retval false The tables would exceed \b maxEntries (the engine
+ *               is left empty)
+ */
+template <class ADDR, class VALUE>
+template <class IT>
+inline bool
+rfc<ADDR, VALUE>::build (IT first, IT last, size_t maxEntries)
+{
+    std::vector<subRule> subs;
+    std::vector<std::pair<std::vector<u32>, std::vector<u32> > > sp, dp;
+    u32 plo[nAddr];
+    u32 phi[nAddr];
+    ADDR lo[dim];
+    ADDR hi[dim];
+    size_t c, i, j, r;
+
+    clear();
+    rules.assign(first, last);
+
+    /*
+     * Sub-rules: cross products of the chunk ranges
+     */
+    for (r = 0; r < rules.size(); ++r) {
+        fields<0, dim>::get(rules[r].first.min_corner(), lo);
+        fields<0, dim>::get(rules[r].first.max_corner(), hi);
+        for (i = 0; i < dim; ++i) {
+            lo[i] += 1;
+            hi[i] -= 1;
+        }
+        sp.clear();
+        dp.clear();
+        split(lo[0], hi[0], 0, plo, phi, sp);
+        split(lo[1], hi[1], 0, plo, phi, dp);
+        subRule s;
+        s.rule = r;
+        for (i = 0; i < 4; ++i) {
+            s.lo[2 * nAddr + i] = static_cast<u32>(lo[i + 2]);
+            s.hi[2 * nAddr + i] = static_cast<u32>(hi[i + 2]);
+        }
+        for (auto& a : sp) {
+            for (auto& b : dp) {
+                for (i = 0; i < nAddr; ++i) {
+                    s.lo[i] = a.first[i];
+                    s.hi[i] = a.second[i];
+                    s.lo[nAddr + i] = b.first[i];
+                    s.hi[nAddr + i] = b.second[i];
+                }
+                subs.push_back(s);
+            }
+        }
+    }
+    nSub = subs.size();
+    size_t words = (nSub + 63) / 64;
+
+    /*
+     * Phase 0: the equivalence classes of each chunk
+     */
+    std::vector<std::vector<bitmap> > cls(nChunks);
+    for (c = 0; c < nChunks; ++c) {
+        size_t n = size_t(1) << chunkBits(c);
+        std::vector<std::pair<u32, u32> > ev; // (position, sub-rule)
+        for (i = 0; i < nSub; ++i) {
+            ev.push_back(std::make_pair(subs[i].lo[c], i));
+            if (subs[i].hi[c] + 1 < n) {
+                ev.push_back(std::make_pair(subs[i].hi[c] + 1, i));
+            }
+        }
+        std::sort(ev.begin(), ev.end());
+        classMap m;
+        bitmap cur(words, 0);
+        chunkTable[c].resize(n);
+        size_t pos = 0;
+        i = 0;
+        while (pos < n) {
+            for (; i < ev.size() && ev[i].first == pos; ++i) {
+                cur[ev[i].second >> 6] ^= u64(1) << (ev[i].second & 63);
+            }
+            size_t next = (i < ev.size()) ? ev[i].first : n;
+            u32 id = classOf(m, cls[c], cur);
+            std::fill(chunkTable[c].begin() + pos,
+                      chunkTable[c].begin() + next, id);
+            pos = next;
+        }
+    }
+
+    /*
+     * A chunk of one class tells no keys apart: its rule set is
+     * ANDed into the classes of the first chunk read, and the chunk
+     * is not read
+     */
+    bitmap fold(words, ~u64(0));
+    bool folded = false;
+    for (c = 0; c < nChunks; ++c) {
+        if (cls[c].size() > 1) {
+            live.push_back(c);
+            continue;
+        }
+        for (i = 0; i < words; ++i) {
+            fold[i] &= cls[c][0][i];
+        }
+        folded = true;
+    }
+    if (live.empty()) {
+        live.push_back(0);
+    }
+    if (folded) {
+        const u32 c0 = live[0];
+        std::vector<bitmap> old;
+        std::vector<u32> remap;
+        classMap m;
+        old.swap(cls[c0]);
+        for (auto& b : old) {
+            for (i = 0; i < words; ++i) {
+                b[i] &= fold[i];
+            }
+            remap.push_back(classOf(m, cls[c0], b));
+        }
+        for (auto& id : chunkTable[c0]) {
+            id = remap[id];
+        }
+    }
+    for (c = 0; c < nChunks; ++c) {
+        if (std::find(live.begin(), live.end(), c) == live.end()) {
+            chunkTable[c].clear();
+            cls[c].clear();
+        }
+    }
+
+    /*
+     * Phase 1, 2, ...: combine the adjacent nodes pairwise
+     */
+    std::vector<u32> level(live);
+    size_t total = 0;
+    bitmap bm(words);
+    while (level.size() > 1) {
+        std::vector<u32> next;
+        for (i = 0; i + 1 < level.size(); i += 2) {
+            phase p;
+            p.a = level[i];
+            p.b = level[i + 1];
+            const std::vector<bitmap>& ca = cls[p.a];
+            const std::vector<bitmap>& cb = cls[p.b];
+            p.nB = cb.size();
+            total += ca.size() * cb.size();
+            if (total > maxEntries) {
+                clear();
+                return false;
+            }
+            p.table.resize(ca.size() * cb.size());
+            classMap m;
+            std::vector<bitmap> out;
+            for (r = 0; r < ca.size(); ++r) {
+                for (j = 0; j < cb.size(); ++j) {
+                    size_t w;
+                    for (w = 0; w < words; ++w) {
+                        bm[w] = ca[r][w] & cb[j][w];
+                    }
+                    p.table[r * p.nB + j] = classOf(m, out, bm);
+                }
+            }
+            cls[p.a].clear();
+            cls[p.b].clear();
+            next.push_back(cls.size());
+            cls.push_back(std::move(out));
+            phases.push_back(std::move(p));
+        }
+        if (level.size() & 1) {
+            next.push_back(level.back());
+        }
+        level.swap(next);
+    }
+
+    /*
+     * The rules (in the order of priority) of each final class
+     */
+    const std::vector<bitmap>& fin = cls[level[0]];
+    for (i = 0; i < fin.size(); ++i) {
+        matchBegin.push_back(matchList.size());
+        std::vector<u32> m;
+        for (j = 0; j < nSub; ++j) {
+            if (fin[i][j >> 6] & (u64(1) << (j & 63))) {
+                m.push_back(subs[j].rule);
+            }
+        }
+        std::sort(m.begin(), m.end());
+        m.erase(std::unique(m.begin(), m.end()), m.end());
+        matchList.insert(matchList.end(), m.begin(), m.end());
+    }
+    matchBegin.push_back(matchList.size());
+    return true;
+}
+
+/**
+ * @name  rfc<ADDR, VALUE>::classify
+ * @brief Private function
+ *        Returns the final equivalence class of \b key
+ */
+template <class ADDR, class VALUE>
+inline u32
+rfc<ADDR, VALUE>::classify (const tuple<ADDR>& key) const
+{
+    u32 id[2 * nChunks];
+    u32 v[nChunks];
+    ADDR f[dim];
+    size_t i;
+
+    fields<0, dim>::get(key, f);
+    for (i = 0; i < nAddr; ++i) {
+        size_t shift = 16 * (nAddr - 1 - i);
+        v[i] = chunkOf(f[0], shift);
+        v[nAddr + i] = chunkOf(f[1], shift);
+    }
+    for (i = 2; i < dim; ++i) {
+        size_t c = 2 * nAddr + i - 2;
+        v[c] = static_cast<u32>(f[i]) & ((1U << chunkBits(c)) - 1);
+    }
+    for (u32 c : live) {
+        id[c] = chunkTable[c][v[c]];
+    }
+    for (i = 0; i < phases.size(); ++i) {
+        const phase& p = phases[i];
+        id[nChunks + i] = p.table[id[p.a] * p.nB + id[p.b]];
+    }
+    return phases.empty() ? id[live[0]] : id[nChunks + phases.size() - 1];
+}
+
+/**
+ * @name  rfc<ADDR, VALUE>::first
+ * @brief Public function
+ *        Returns the highest priority entry matching \b key
+ *
+ * @retval nullptr No entry matches \b key (or not built)
+ */
+template <class ADDR, class VALUE>
+inline const entry<ADDR, VALUE>*
+rfc<ADDR, VALUE>::first (const tuple<ADDR>& key) const
+{
+    if (live.empty()) {
+        return nullptr;
+    }
+    u32 c = classify(key);
+    if (matchBegin[c] == matchBegin[c + 1]) {
+        return nullptr;
+    }
+    return &rules[matchList[matchBegin[c]]];
+}
+
+/**
+ * @name  rfc<ADDR, VALUE>::find
+ * @brief Public function
+ *        Returns all the entries matching \b key in the order of
+ *        priority
+ */
+template <class ADDR, class VALUE>
+inline result<ADDR, VALUE>
+rfc<ADDR, VALUE>::find (const tuple<ADDR>& key) const
+{
+    result<ADDR, VALUE> r;
+
+    if (live.empty()) {
+        return r;
+    }
+    u32 c = classify(key);
+    for (u32 i = matchBegin[c]; i < matchBegin[c + 1]; ++i) {
+        r.push_back(rules[matchList[i]]);
+    }
+    return r;
+}
+
+/**
+ * @name  rfc<ADDR, VALUE>::memory
+ * @brief Public function
+ *        Returns the number of the bytes of the tables
+ */
+template <class ADDR, class VALUE>
+inline size_t
+rfc<ADDR, VALUE>::memory () const
+{
+    size_t n = (matchBegin.size() + matchList.size()) * sizeof(u32);
+    size_t c;
+
+    for (c = 0; c < nChunks; ++c) {
+        n += chunkTable[c].size() * sizeof(u32);
+    }
+    for (auto& p : phases) {
+        n += p.table.size() * sizeof(u32);
+    }
+    return n;
+}
+
+} //namespace
+#endif// __RTACL_RFC_HPP__
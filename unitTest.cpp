@@ -1,4 +1,16 @@
+#include <deque>
+#include <random>
+#include <set>
+
 #include "rtacl.hpp"
+#include "rtaclAsync.hpp"
+#include "rtaclBv.hpp"
+#include "rtaclDefer.hpp"
+#include "rtaclEpoch.hpp"
+#include "rtaclNuma.hpp"
+#include "rtaclPart.hpp"
+#include "rtaclPool.hpp"
+#include "rtaclRfc.hpp"
 
 using bfmt = boost::format;
 
@@ -586,6 +598,2272 @@ v4rawTest ()
     }
 }
 
+/**
+ * @name  pktTest
+ * @brief R-tree ACL functional test (raw packet headers)
+ */
+static void
+pktTest ()
+{
+    /*
+     * IPv4/TCP: 10.1.1.1:1234 -> 10.2.2.2:80, DSCP 46 (EF)
+     */
+    u8 v4[40] = {
+        0x45, 46 << 2, 0x00, 0x28, 0x00, 0x00, 0x40, 0x00,
+        0x40, IPPROTO_TCP, 0x00, 0x00,
+        10, 1, 1, 1,
+        10, 2, 2, 2,
+        0x04, 0xd2, 0x00, 0x50,
+    };
+    rtacl::db<rtacl::ipv4a> acl4;
+    rtacl::entry<rtacl::ipv4a> e4;
+    acl4.makeMin(0x0a010100, 0x0a020200, 0, 80, 6, 0,
+                 e4.first.min_corner());
+    acl4.makeMax(0x0a0101ff, 0x0a0202ff, 0xffff, 80, 6, 0xff,
+                 e4.first.max_corner());
+    e4.second = 1;
+    acl4.insert(e4);
+
+    rtacl::tuple<rtacl::ipv4a> k4;
+    bool rc = acl4.makeKey(v4, sizeof(v4), k4);
+    assert(rc);
+    std::cout << (bfmt("IPv4 key: %s\n") % rtacl::tuple2str(k4)).str();
+    assert(k4.get<2>() == 1234 && k4.get<3>() == 80 && k4.get<5>() == 46);
+    rtacl::result<rtacl::ipv4a> r4 = acl4.classifyPacket(v4, sizeof(v4));
+    std::cout << (r4.size() == 1 ? "match (correct)\n" : "Error: no match\n");
+    assert(r4.size() == 1);
+    /*
+     * Truncated L4 header and non-first fragment
+     */
+    rc = acl4.makeKey(v4, 22, k4);
+    assert(!rc);
+    v4[6] = 0x00;
+    v4[7] = 0x10;               // fragment offset: 128 bytes
+    rc = acl4.makeKey(v4, sizeof(struct ip), k4);
+    assert(rc && k4.get<2>() == 0 && k4.get<3>() == 0);
+
+    /*
+     * IPv6/UDP with hop-by-hop options and a first fragment header:
+     * 2001:db8::1:53 -> 2001:db8::2:5353
+     */
+    u8 v6[72];
+    memset(v6, 0, sizeof(v6));
+    v6[0] = 0x60;
+    v6[6] = IPPROTO_HOPOPTS;
+    v6[7] = 64;
+    v6[8]  = 0x20; v6[9]  = 0x01; v6[10] = 0x0d; v6[11] = 0xb8;
+    v6[23] = 0x01;
+    v6[24] = 0x20; v6[25] = 0x01; v6[26] = 0x0d; v6[27] = 0xb8;
+    v6[39] = 0x02;
+    v6[40] = IPPROTO_FRAGMENT;  // hop-by-hop: 8 bytes
+    v6[48] = IPPROTO_UDP;       // fragment: offset 0, M flag
+    v6[51] = 0x01;
+    v6[56] = 0x00; v6[57] = 53;
+    v6[58] = 0x14; v6[59] = 0xe9;
+    rtacl::db<rtacl::ipv6a> acl6;
+    rtacl::entry<rtacl::ipv6a> e6;
+    rtacl::ipv6a net = rtacl::ipv6a(0x20010db8) << 96;
+    acl6.makeMin(net, net, 53, 0, 17, 0, e6.first.min_corner());
+    acl6.makeMax(net + 0xffff, net + 0xffff, 53, 0xffff, 17, 0xff,
+                 e6.first.max_corner());
+    e6.second = 2;
+    acl6.insert(e6);
+
+    rtacl::tuple<rtacl::ipv6a> k6;
+    rc = acl6.makeKey(v6, sizeof(v6), k6);
+    assert(rc);
+    std::cout << (bfmt("IPv6 key: %s\n") % rtacl::tuple2str(k6)).str();
+    assert(k6.get<2>() == 53 && k6.get<3>() == 5353 &&
+           k6.get<4>() == 17);
+    rtacl::result<rtacl::ipv6a> r6 = acl6.classifyPacket(v6, sizeof(v6));
+    std::cout << (r6.size() == 1 ? "match (correct)\n" : "Error: no match\n");
+    assert(r6.size() == 1);
+    /*
+     * Non-first fragment: no ports
+     */
+    v6[50] = 0x00;
+    v6[51] = 0x81;              // offset: 16 * 8 bytes, M flag
+    rc = acl6.makeKey(v6, 56, k6);
+    assert(rc && k6.get<2>() == 0 && k6.get<3>() == 0 &&
+           k6.get<4>() == 17);
+    r6 = acl6.classifyPacket(v6, 56);
+    std::cout << (r6.size() == 0 ?
+                  "no match (correct)\n" : "Error: matched\n");
+    assert(r6.size() == 0);
+    /*
+     * Wrong address family
+     */
+    rc = acl6.makeKey(v4, sizeof(v4), k6);
+    assert(!rc);
+}
+
+/**
+ * @name  in6Test
+ * @brief IPv6 address conversion test
+ */
+static void
+in6Test ()
+{
+    sockaddr_in6 sin6;
+    memset(&sin6, 0, sizeof(sin6));
+    size_t i, j;
+    for (i = 0; i < 1000; ++i) {
+        u8* a = sin6.sin6_addr.s6_addr;
+        s256 ref6 = 0;
+        u128 ref = 0;
+        for (j = 0; j < sizeof(sin6.sin6_addr.s6_addr); ++j) {
+            a[j] = (i == 0) ? 0 : (i == 1) ? 0xff : rand();
+            ref6 = (ref6 << 8) | a[j];
+            ref  = (ref << 8) | a[j];
+        }
+        s256 v6 = rtacl::sin6a2int<s256>(sin6);
+        u128 v  = rtacl::sin6a2int<u128>(sin6);
+        if (v6 != ref6 || v != ref) {
+            std::cout << (bfmt("Error: %s != %s\n")
+                          % rtacl::ipv6a2s(v6)
+                          % rtacl::ipv6a2s(ref6)).str();
+        }
+        assert(v6 == ref6 && v == ref);
+        sockaddr_in6 r = rtacl::int2sin6(v6);
+        assert(memcmp(&r.sin6_addr, &sin6.sin6_addr, sizeof(in6_addr)) == 0);
+    }
+    std::cout << (bfmt("%ld IPv6 addresses converted (correct)\n") % i).str();
+}
+
+/**
+ * @name  dualTest
+ * @brief Dual-stack R-tree ACL functional test
+ */
+static void
+dualTest ()
+{
+    rtacl::dualDb acl;
+    rtacl::entry<rtacl::ipv4a> e4;
+    rtacl::entry<rtacl::ipv6a> e6;
+    rtacl::entry<rtacl::ipv6a> m6;
+    bool rc;
+
+    /*
+     * 10.0.0.0/8 -> *:80/tcp
+     * 2001:db8::/32 -> *:80/tcp
+     * ::ffff:192.168.0.0/112 -> *:443/tcp (IPv4-mapped)
+     */
+    rc = rtacl::str2range("10.0.0.0/8, *, *, 80, 6, *", e4.first);
+    assert(rc);
+    e4.second = 4;
+    rc = rtacl::str2range("2001:db8::/32, *, *, 80, 6, *", e6.first);
+    assert(rc);
+    e6.second = 6;
+    rc = rtacl::str2range("::ffff:192.168.0.0/112, ::ffff:0.0.0.0/96, "
+                          "*, 443, 6, *", m6.first);
+    assert(rc);
+    m6.second = 46;
+    acl.insert(e4);
+    acl.insert(e6);
+    acl.insert(m6);
+    assert(acl.size() == 3);
+    assert(acl.getDb4().size() == 2 && acl.getDb6().size() == 1);
+
+    /*
+     * Mixed batch: IPv4 match, IPv6 match, IPv4 unmatch, malformed
+     */
+    u8 v4[24] = {
+        0x45, 0, 0, 24, 0, 0, 0, 0, 64, 6, 0, 0,
+        10, 1, 2, 3,  192, 168, 1, 1,  0x04, 0xd2, 0, 80,
+    };
+    u8 v4n[24];
+    memcpy(v4n, v4, sizeof(v4n));
+    v4n[12] = 11;
+    u8 v6[44];
+    memset(v6, 0, sizeof(v6));
+    v6[0] = 0x60;
+    v6[6] = 6;
+    v6[8] = 0x20; v6[9] = 0x01; v6[10] = 0x0d; v6[11] = 0xb8;
+    v6[23] = 1;
+    v6[39] = 2;
+    v6[43] = 80;
+    const u8* pkts[] = { v4, v6, v4n, v6 };
+    const size_t lens[] = { sizeof(v4), sizeof(v6), sizeof(v4n), 20 };
+    rtacl::dualResult r[4];
+    acl.classifyBatch(pkts, lens, elementsof(r), r);
+    assert(r[0].af == AF_INET && r[0].v4.size() == 1 &&
+           r[0].v4[0].second == 4);
+    assert(r[1].af == AF_INET6 && r[1].v6.size() == 1 &&
+           r[1].v6[0].second == 6);
+    assert(r[2].af == AF_INET && r[2].empty());
+    assert(r[3].af == AF_UNSPEC && r[3].empty());
+    std::cout << "batch: IPv4 match, IPv6 match, IPv4 unmatch, "
+                 "malformed (correct)\n";
+
+    /*
+     * IPv4-mapped sockaddr_in6 is looked up in the IPv4 tree
+     */
+    sockaddr_in6 s6;
+    sockaddr_in6 d6;
+    memset(&s6, 0, sizeof(s6));
+    memset(&d6, 0, sizeof(d6));
+    s6.sin6_family = d6.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "::ffff:192.168.3.4", &s6.sin6_addr);
+    inet_pton(AF_INET6, "::ffff:8.8.8.8", &d6.sin6_addr);
+    s6.sin6_port = htons(1234);
+    d6.sin6_port = htons(443);
+    rtacl::dualResult r1;
+    acl.find(reinterpret_cast<sockaddr*>(&s6),
+             reinterpret_cast<sockaddr*>(&d6), 6, 0, r1);
+    assert(r1.af == AF_INET && r1.v4.size() == 1 && r1.v4[0].second == 46);
+    std::cout << (bfmt("IPv4-mapped: %s (correct)\n")
+                  % rtacl::range2str(r1.v4[0].first)).str();
+
+    rc = acl.remove(m6);
+    assert(rc && acl.size() == 2);
+    acl.find(reinterpret_cast<sockaddr*>(&s6),
+             reinterpret_cast<sockaddr*>(&d6), 6, 0, r1);
+    assert(r1.af == AF_INET && r1.empty());
+    std::cout << "IPv4-mapped entry removed (correct)\n";
+
+    /*
+     * IPv6 rules covering the mapped space partly:
+     * * -> *:443/tcp and ::/64 -> ::/64 any (not in the IPv4 tree)
+     */
+    rtacl::entry<rtacl::ipv6a> a6, p6;
+    rc = rtacl::str2range("*, *, *, 443, 6, *", a6.first);
+    assert(rc);
+    a6.second = 60;
+    rc = rtacl::str2range("::/64, ::/64, *, *, *, *", p6.first);
+    assert(rc);
+    p6.second = 64;
+    acl.insert(a6);
+    acl.insert(p6);
+    assert(acl.getDb4().size() == 1 && acl.getDb6().size() == 3);
+    acl.find(reinterpret_cast<sockaddr*>(&s6),
+             reinterpret_cast<sockaddr*>(&d6), 6, 0, r1);
+    assert(r1.af == AF_INET && r1.v4.empty() && r1.v6.size() == 2);
+
+    /*
+     * The same flow as a packet, alone and in a batch
+     */
+    u8 m[44];
+    memset(m, 0, sizeof(m));
+    m[0] = 0x60;
+    m[6] = 6;
+    memcpy(m + 8, &s6.sin6_addr, 16);
+    memcpy(m + 24, &d6.sin6_addr, 16);
+    m[40] = 0x04; m[41] = 0xd2;
+    m[42] = 443 >> 8;
+    m[43] = 443 & 0xff;
+    acl.classifyPacket(m, sizeof(m), r1);
+    assert(r1.af == AF_INET && r1.v4.empty() && r1.v6.size() == 2);
+    u8 m4[sizeof(m)];
+    memcpy(m4, m, sizeof(m));
+    m4[20] = 10;                            // ::ffff:10.168.3.4
+    m4[42] = 0;
+    m4[43] = 80;
+    const u8* mp[] = { m, m4, v6 };
+    const size_t ml[] = { sizeof(m), sizeof(m4), sizeof(v6) };
+    acl.classifyBatch(mp, ml, 3, r);
+    assert(r[0].af == AF_INET && r[0].v4.empty() && r[0].v6.size() == 2);
+    assert(r[1].af == AF_INET && r[1].v4.size() == 1 &&
+           r[1].v4[0].second == 4 && r[1].v6.size() == 1 &&
+           r[1].v6[0].second == 64);
+    assert(r[2].af == AF_INET6 && r[2].v6.size() == 1);
+
+    /*
+     * The same flow matches the same rules whether it arrives as
+     * IPv4 (sockaddr_in, packet) or as mapped IPv6 (sockaddr_in6,
+     * packet), also with a broad IPv6 rule ::/0 -> ::/0
+     */
+    rtacl::entry<rtacl::ipv6a> w6;
+    rc = rtacl::str2range("::/0, ::/0, *, *, 6, *", w6.first);
+    assert(rc);
+    w6.second = 70;
+    acl.insert(w6);
+    auto payloads = [](const rtacl::dualResult& dr) {
+        std::vector<uintptr_t> v;
+        for (auto& e : dr.v4) {
+            v.push_back(e.second);
+        }
+        for (auto& e : dr.v6) {
+            v.push_back(e.second);
+        }
+        std::sort(v.begin(), v.end());
+        return v;
+    };
+    sockaddr_in s4;
+    sockaddr_in d4;
+    memset(&s4, 0, sizeof(s4));
+    memset(&d4, 0, sizeof(d4));
+    s4.sin_family = d4.sin_family = AF_INET;
+    s4.sin_port = htons(1234);
+    const u8* fm[] = { m4, m };
+    const char* fs[] = { "10.168.3.4", "192.168.3.4" };
+    const u16 fp[] = { 80, 443 };
+    const std::vector<uintptr_t> fx[] = {
+        { 4, 64, 70 }, { 60, 64, 70 }
+    };
+    for (size_t f = 0; f < elementsof(fm); ++f) {
+        rtacl::dualResult rf[5];
+        u8 p4[24];
+        memcpy(p4, v4, sizeof(p4));
+        memcpy(p4 + 12, fm[f] + 20, 4);
+        memcpy(p4 + 16, fm[f] + 36, 4);
+        p4[22] = fp[f] >> 8;
+        p4[23] = fp[f] & 0xff;
+        inet_pton(AF_INET, fs[f], &s4.sin_addr);
+        inet_pton(AF_INET, "8.8.8.8", &d4.sin_addr);
+        d4.sin_port = htons(fp[f]);
+        memcpy(&s6.sin6_addr, fm[f] + 8, 16);
+        d6.sin6_port = htons(fp[f]);
+        acl.find(reinterpret_cast<sockaddr*>(&s4),
+                 reinterpret_cast<sockaddr*>(&d4), 6, 0, rf[0]);
+        acl.find(reinterpret_cast<sockaddr*>(&s6),
+                 reinterpret_cast<sockaddr*>(&d6), 6, 0, rf[1]);
+        acl.classifyPacket(p4, sizeof(p4), rf[2]);
+        const u8* fb[] = { p4, fm[f] };
+        const size_t fl[] = { sizeof(p4), sizeof(m) };
+        acl.classifyBatch(fb, fl, 2, rf + 3);
+        assert(payloads(rf[0]) == fx[f]);
+        for (size_t j = 1; j < elementsof(rf); ++j) {
+            assert(rf[j].af == AF_INET && payloads(rf[j]) == fx[f]);
+        }
+    }
+    rc = acl.remove(w6);
+    assert(rc);
+    std::cout << "IPv4 and IPv4-mapped forms of a flow match the same "
+                 "rules (correct)\n";
+
+    rc = acl.remove(a6) && acl.remove(p6);
+    assert(rc && acl.size() == 2);
+    acl.classifyPacket(m4, sizeof(m4), r1);
+    assert(r1.af == AF_INET && r1.v4.size() == 1 && r1.v6.empty());
+    std::cout << "IPv4-mapped flow matches partly overlapping IPv6 "
+                 "rules by find(), classifyPacket() and "
+                 "classifyBatch() (correct)\n";
+}
+
+/**
+ * @name  queryTest
+ * @brief Tests the lazy search (query iterator)
+ */
+static void
+queryTest ()
+{
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::entry<rtacl::ipv4a> e;
+    rtacl::tuple<rtacl::ipv4a> key;
+    size_t i, n;
+
+    /*
+     * 10.0.0.0/8 ... 10.0.0.0/31: 24 nested rules
+     */
+    for (i = 8; i < 32; ++i) {
+        u32 mask = ~((1U << (32 - i)) - 1);
+        acl.makeMin(0x0a000000 & mask, 0, 0, 0, 6, 0, e.first.min_corner());
+        acl.makeMax(0x0a000000 | ~mask, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                    e.first.max_corner());
+        e.second = i;
+        acl.insert(e);
+    }
+    acl.makeKey(0x0a000000, 0xc0a80101, 1234, 80, 6, 0, key);
+    assert(acl.find(key).size() == 24);
+
+    n = 0;
+    for (auto& m : acl.matches(key)) {
+        assert(m.second >= 8 && m.second < 32);
+        ++n;
+    }
+    assert(n == 24);
+
+    /*
+     * Stop after 3 matches
+     */
+    n = 0;
+    for (auto it = acl.qbegin(key); it != acl.qend(); ++it) {
+        if (++n == 3) {
+            break;
+        }
+    }
+    assert(n == 3);
+
+    assert(acl.matchesAny(key) && acl.countMatches(key) == 24);
+    acl.makeKey(0x0a000100, 0xc0a80101, 1234, 80, 6, 0, key);
+    assert(acl.matchesAny(key) && acl.countMatches(key) == 16);
+
+    acl.makeKey(0x0b000000, 0xc0a80101, 1234, 80, 6, 0, key);
+    assert(acl.qbegin(key) == acl.qend());
+    assert(!acl.matchesAny(key) && acl.countMatches(key) == 0);
+    std::cout << "24 nested matches, stopped after 3, no match (correct)\n";
+    std::cout << "matchesAny(), countMatches() (correct)\n";
+}
+
+/**
+ * @name  counterTest
+ * @brief Tests the per-rule hit counters
+ */
+static void
+counterTest ()
+{
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::entry<rtacl::ipv4a> e;
+    rtacl::tuple<rtacl::ipv4a> key;
+    bool rc;
+
+    /*
+     * 1: 10.0.0.0/8 -> any:80/tcp, 2: any TCP
+     */
+    rc = rtacl::str2range("10.0.0.0/8, *, *, 80, 6, *", e.first);
+    assert(rc);
+    e.second = 1;
+    acl.insert(e);
+    rc = rtacl::str2range("*, *, *, *, 6, *", e.first);
+    assert(rc);
+    e.second = 2;
+    acl.insert(e);
+
+    acl.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, key);
+    acl.find(key, 100);
+    assert(acl.stats(1).packets == 0);  // disabled
+    acl.enableCounters(true);
+    acl.find(key, 100);
+    acl.find(key);                      // not counted
+    std::thread th([&]() {
+            rtacl::tuple<rtacl::ipv4a> k;
+            acl.makeKey(0x0b010203, 0xc0a80101, 1234, 80, 6, 0, k);
+            for (int i = 0; i < 10; ++i) {
+                acl.find(key, 1000);
+                acl.find(k, 10);
+            }
+        });
+    th.join();
+    rtacl::ruleStats st = acl.stats(1);
+    assert(st.packets == 11 && st.bytes == 10100);
+    st = acl.stats(2);
+    assert(st.packets == 21 && st.bytes == 10200);
+    std::map<uintptr_t, rtacl::ruleStats> m = acl.dumpCounters();
+    assert(m.size() == 2 && m[1].packets == 11 && m[2].packets == 21);
+    std::cout << (bfmt("rule 1: %u packets %u bytes, "
+                       "rule 2: %u packets %u bytes (correct)\n")
+                  % m[1].packets % m[1].bytes
+                  % m[2].packets % m[2].bytes).str();
+
+    acl.clearCounters();
+    assert(acl.stats(1).packets == 0 && acl.stats(2).bytes == 0);
+    std::cout << "counters cleared (correct)\n";
+}
+
+/*
+ * Inline payload: resolved without dereferencing a pointer
+ */
+struct inlineRule {
+    u32 id;
+    u16 priority;
+    u8  action;
+    bool operator== (const inlineRule& r) const {
+        return id == r.id && priority == r.priority && action == r.action;
+    };
+};
+
+static uintptr_t
+ruleHandle (const inlineRule& r)
+{
+    return r.id;
+}
+
+/**
+ * @name  payloadTest
+ * @brief Tests \e rtacl::db with an inline payload type
+ */
+static void
+payloadTest ()
+{
+    rtacl::db<rtacl::ipv4a, inlineRule> acl;
+    rtacl::entry<rtacl::ipv4a, inlineRule> e;
+    rtacl::tuple<rtacl::ipv4a> key;
+    bool rc;
+
+    rc = rtacl::str2range("10.0.0.0/8, *, *, 80, 6, *", e.first);
+    assert(rc);
+    e.second = { 1, 10, 'P' };
+    acl.insert(e);
+    rc = rtacl::str2range("10.1.0.0/16, *, *, *, 6, *", e.first);
+    assert(rc);
+    e.second = { 2, 20, 'D' };
+    acl.insert(e);
+
+    acl.enableCounters(true);
+    acl.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, key);
+    rtacl::result<rtacl::ipv4a, inlineRule> r = acl.find(key, 64);
+    assert(r.size() == 2);
+    const inlineRule* best = &r[0].second;
+    for (auto& m : r) {
+        if (m.second.priority > best->priority) {
+            best = &m.second;
+        }
+    }
+    assert(best->id == 2 && best->action == 'D');
+    assert(acl.stats(1).packets == 1 && acl.stats(2).bytes == 64);
+
+    rc = acl.remove(e);
+    assert(rc && acl.size() == 1);
+    r = acl.find(key);
+    assert(r.size() == 1 && r[0].second.id == 1 && r[0].second.action == 'P');
+    std::cout << "inline payload: priority, action, counters, remove "
+                 "(correct)\n";
+}
+
+/**
+ * @name  poolTest
+ * @brief Tests \e rtacl::db with \e rtacl::poolAllocator
+ */
+static void
+poolTest ()
+{
+    typedef rtacl::poolAllocator<rtacl::entry<rtacl::ipv4a> > alloc;
+    for (bool huge : { false, true }) {
+        alloc a(0, huge);
+        rtacl::db<rtacl::ipv4a, uintptr_t, rtacl::dim, alloc> acl(a);
+        rtacl::entry<rtacl::ipv4a> e;
+        rtacl::tuple<rtacl::ipv4a> key;
+        size_t i;
+
+        for (i = 0; i < 10000; ++i) {
+            acl.makeMin(0x0a000000 + i * 0x100, 0, 0, 0, 6, 0,
+                        e.first.min_corner());
+            acl.makeMax(0x0a000000 + i * 0x100 + 0xff, 0xffffffff,
+                        0xffff, 0xffff, 6, 0xff, e.first.max_corner());
+            e.second = i;
+            acl.insert(e);
+        }
+        assert(acl.size() == 10000);
+        assert(a.getArena().reserved() > 0);
+        acl.makeKey(0x0a000000 + 1234 * 0x100 + 5, 0xc0a80101, 1234, 80,
+                    6, 0, key);
+        rtacl::result<rtacl::ipv4a> r = acl.find(key);
+        assert(r.size() == 1 && r[0].second == 1234);
+
+        /*
+         * Freed nodes are reused
+         */
+        for (i = 0; i < 5000; ++i) {
+            acl.makeMin(0x0a000000 + i * 0x100, 0, 0, 0, 6, 0,
+                        e.first.min_corner());
+            acl.makeMax(0x0a000000 + i * 0x100 + 0xff, 0xffffffff,
+                        0xffff, 0xffff, 6, 0xff, e.first.max_corner());
+            e.second = i;
+            bool rc = acl.remove(e);
+            assert(rc);
+        }
+        size_t reserved = a.getArena().reserved();
+        for (i = 0; i < 5000; ++i) {
+            acl.makeMin(0x0a000000 + i * 0x100, 0, 0, 0, 6, 0,
+                        e.first.min_corner());
+            acl.makeMax(0x0a000000 + i * 0x100 + 0xff, 0xffffffff,
+                        0xffff, 0xffff, 6, 0xff, e.first.max_corner());
+            e.second = i;
+            acl.insert(e);
+        }
+        assert(acl.size() == 10000);
+        assert(acl.find(key).size() == 1);
+        std::cout << (bfmt("%s: %u bytes reserved (%u after re-insert), "
+                           "%u MAP_HUGETLB chunk(s) (correct)\n")
+                      % (huge ? "huge pages" : "4KB pages")
+                      % reserved % a.getArena().reserved()
+                      % a.getArena().hugeTlbChunks()).str();
+    }
+}
+
+/**
+ * @name  memTest
+ * @brief Tests \e rtacl::db::memoryUsage() with
+ *        \e rtacl::countingAllocator
+ */
+static void
+memTest ()
+{
+    typedef rtacl::countingAllocator<rtacl::entry<rtacl::ipv4a> > alloc;
+    alloc a;
+    rtacl::db<rtacl::ipv4a, uintptr_t, rtacl::dim, alloc> acl(a);
+    rtacl::entry<rtacl::ipv4a> e;
+    rtacl::memUsage m;
+    size_t i;
+
+    m = acl.memoryUsage();
+    assert(m.rules == 0 && m.total == 0 && m.measured);
+    for (i = 0; i < 1000; ++i) {
+        acl.makeMin(0x0a000000 + i * 0x100, 0, 0, 0, 6, 0,
+                    e.first.min_corner());
+        acl.makeMax(0x0a000000 + i * 0x100 + 0xff, 0xffffffff,
+                    0xffff, 0xffff, 6, 0xff, e.first.max_corner());
+        e.second = i;
+        acl.insert(e);
+    }
+    m = acl.memoryUsage();
+    assert(m.rules == 1000 && m.measured);
+    assert(a.stats().allocs == m.internalNodes + m.leaves);
+    assert(m.total >= (m.internalNodes + m.leaves) * m.nodeSize);
+    assert(m.total == m.internalBytes + m.leafBytes + m.payloadBytes +
+           m.slackBytes);
+    assert(m.leafBytes == 1000 * sizeof(rtacl::range<rtacl::ipv4a>));
+    std::cout << m.str() << " (correct)\n";
+
+    rtacl::db<rtacl::ipv4a> est;
+    est.insert(e);
+    m = est.memoryUsage();
+    assert(m.rules == 1 && !m.measured && m.total == m.nodeSize);
+    std::cout << "std::allocator: estimated (correct)\n";
+}
+
+/**
+ * @name  numaTest
+ * @brief Tests rtacl::numaDb (replicas are updated by commit())
+ */
+static void
+numaTest ()
+{
+    rtacl::numaDb<rtacl::ipv4a> acl;
+    rtacl::entry<rtacl::ipv4a> e;
+    rtacl::tuple<rtacl::ipv4a> key;
+    rtacl::result<rtacl::ipv4a> r;
+    size_t n;
+    bool rc;
+
+    rc = rtacl::str2range("10.0.0.0/8, *, *, 80, 6, *", e.first);
+    assert(rc);
+    e.second = 1;
+    acl.getMaster().makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, key);
+
+    /*
+     * Not visible until commit()
+     */
+    acl.insert(e);
+    r = acl.find(key);
+    assert(r.empty() && acl.size() == 0);
+    acl.commit();
+    r = acl.find(key);
+    assert(r.size() == 1 && r[0].second == 1);
+    for (n = 0; n < acl.nodes(); ++n) {
+        r = acl.find(key, n);
+        assert(r.size() == 1 && r[0].second == 1);
+    }
+    std::cout << (bfmt("%u replica(s): %s (correct)\n")
+                  % acl.nodes() % rtacl::range2str(r[0].first)).str();
+    assert(acl.misplaced() == 0);
+
+    /*
+     * An arena bound to a node places every page it hands out there
+     */
+    if (rtacl::numa::topology::get().available()) {
+        rtacl::arena a(0, false, 0);
+        for (n = 0; n < 10000; ++n) {
+            memset(a.allocate(256), 0xa5, 256);
+        }
+        memset(a.allocate(64 * 1024), 0x5a, 64 * 1024);
+        assert(a.reserved() > 0 && a.misplaced() == 0);
+        std::cout << (bfmt("%u bytes bound to node 0, none misplaced "
+                           "(correct)\n") % a.reserved()).str();
+    }
+
+    rc = acl.remove(e);
+    assert(rc);
+    r = acl.find(key);
+    assert(r.size() == 1);
+    acl.commit();
+    for (n = 0; n < acl.nodes(); ++n) {
+        r = acl.find(key, n);
+        assert(r.empty());
+    }
+    std::cout << "entry removed from all the replicas (correct)\n";
+}
+
+/**
+ * @name  dimTest
+ * @brief Tests \e rtacl::db with fewer fields (2-D and 5-D)
+ */
+static void
+dimTest ()
+{
+    rtacl::db<rtacl::ipv4a, uintptr_t, rtacl::dimSrcDst> acl2;
+    rtacl::db<rtacl::ipv4a, uintptr_t, rtacl::dim5Tuple> acl5;
+    rtacl::db<rtacl::ipv4a> acl6;
+    rtacl::entry<rtacl::ipv4a, uintptr_t, rtacl::dimSrcDst> e2;
+    rtacl::entry<rtacl::ipv4a, uintptr_t, rtacl::dim5Tuple> e5;
+    rtacl::entry<rtacl::ipv4a> e6;
+    rtacl::tuple<rtacl::ipv4a, rtacl::dimSrcDst> k2;
+    rtacl::tuple<rtacl::ipv4a, rtacl::dim5Tuple> k5;
+    rtacl::result<rtacl::ipv4a, uintptr_t, rtacl::dimSrcDst> r2;
+    rtacl::result<rtacl::ipv4a, uintptr_t, rtacl::dim5Tuple> r5;
+    bool rc;
+
+    rc = rtacl::str2range("10.0.0.0/8, 192.168.0.0/16", e2.first);
+    assert(rc);
+    rc = rtacl::str2range("10.0.0.0/8, 192.168.0.0/16, *", e2.first);
+    assert(!rc);
+    e2.second = 2;
+    acl2.insert(e2);
+    std::cout << rtacl::range2str(e2.first) << "\n";
+
+    rc = rtacl::str2range("10.0.0.0/8, *, *, 80, 6", e5.first);
+    assert(rc);
+    e5.second = 5;
+    acl5.insert(e5);
+    std::cout << rtacl::range2str(e5.first) << "\n";
+
+    /*
+     * The trailing fields are ignored
+     */
+    acl2.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, k2);
+    r2 = acl2.find(k2);
+    assert(r2.size() == 1 && r2[0].second == 2);
+    std::cout << rtacl::tuple2str(k2) << ": found (correct)\n";
+    acl2.makeKey(0x0a010203, 0xc0a90101, 1234, 80, 6, 0, k2);
+    r2 = acl2.find(k2);
+    assert(r2.empty());
+
+    const rtacl::ipv4a f[] = { 0x0a010203, 0xc0a80101, 1234, 80, 6 };
+    acl5.makeKey(f, k5);
+    r5 = acl5.find(k5);
+    assert(r5.size() == 1 && r5[0].second == 5);
+    std::cout << rtacl::tuple2str(k5) << ": found (correct)\n";
+    acl5.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 17, 0, k5);
+    r5 = acl5.find(k5);
+    assert(r5.empty());
+
+    /*
+     * Packet path: the key has the first N fields only
+     */
+    u8 pkt[40] = {
+        0x45, 0x00, 0x00, 0x28, 0x00, 0x00, 0x40, 0x00,
+        0x40, IPPROTO_TCP, 0x00, 0x00,
+        10, 1, 2, 3,
+        192, 168, 1, 1,
+        0x04, 0xd2, 0x00, 0x50,
+    };
+    r5 = acl5.classifyPacket(pkt, sizeof(pkt));
+    assert(r5.size() == 1 && r5[0].second == 5);
+    r2 = acl2.classifyPacket(pkt, sizeof(pkt));
+    assert(r2.size() == 1 && r2[0].second == 2);
+    std::cout << "packet: found (correct)\n";
+
+    rc = rtacl::str2range("10.0.0.0/8, *, *, 80, 6, *", e6.first);
+    assert(rc);
+    acl6.insert(e6);
+    size_t n2 = acl2.memoryUsage().nodeSize;
+    size_t n5 = acl5.memoryUsage().nodeSize;
+    size_t n6 = acl6.memoryUsage().nodeSize;
+    assert(n2 < n5 && n5 < n6);
+    std::cout << (bfmt("node size: 2-D %u, 5-D %u, 6-D %u (correct)\n")
+                  % n2 % n5 % n6).str();
+}
+
+/**
+ * @name  partTest
+ * @brief Tests \e rtacl::partDb (partitioned by the wildcards)
+ */
+static void
+partTest ()
+{
+    static const struct {
+        const char* rule;
+        uintptr_t   prio;
+    } rules[] = {
+        { "10.0.0.0/8, *, *, *, *, *", 3 },
+        { "10.1.0.0/16, 192.168.0.0/16, *, 80, 6, *", 1 },
+        { "*, *, *, *, *, *", 9 },
+        { "*, *, *, 443, 6, *", 2 },
+    };
+    rtacl::partDb<rtacl::ipv4a, uintptr_t, std::less<uintptr_t> > acl;
+    rtacl::entry<rtacl::ipv4a> e[elementsof(rules)];
+    rtacl::tuple<rtacl::ipv4a> key;
+    rtacl::result<rtacl::ipv4a> r;
+    size_t i;
+    bool rc;
+
+    for (i = 0; i < elementsof(rules); ++i) {
+        rc = rtacl::str2range(rules[i].rule, e[i].first);
+        assert(rc);
+        e[i].second = rules[i].prio;
+        acl.insert(e[i]);
+    }
+    assert(acl.fieldMask(e[0].first) == 0x01);
+    assert(acl.fieldMask(e[1].first) == 0x1b);
+    assert(acl.fieldMask(e[2].first) == 0);
+    assert(acl.size() == 4 && acl.partitions() == 4);
+    std::cout << (bfmt("%u rules, %u partitions (correct)\n")
+                  % acl.size() % acl.partitions()).str();
+
+    /*
+     * Merged in the order of priority
+     */
+    acl.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, key);
+    r = acl.find(key);
+    assert(r.size() == 3);
+    assert(r[0].second == 1 && r[1].second == 3 && r[2].second == 9);
+    assert(rtacl::bg::equals(r[0].first, e[1].first));
+    assert(rtacl::bg::equals(r[1].first, e[0].first));
+    for (auto& m : r) {
+        std::cout << (bfmt("%u: %s\n") % m.second
+                      % rtacl::range2str(m.first)).str();
+    }
+    acl.makeKey(0x0b010203, 0xc0a80101, 1234, 443, 6, 0, key);
+    r = acl.find(key);
+    assert(r.size() == 2 && r[0].second == 2 && r[1].second == 9);
+    std::cout << "port 443: 2 matches (correct)\n";
+    acl.makeKey(0x0c000001, 0x01010101, 1234, 80, 17, 0, key);
+    r = acl.find(key);
+    assert(r.size() == 1 && r[0].second == 9);
+    std::cout << "out of the partition bounds: 1 match (correct)\n";
+
+    rc = acl.remove(e[1]);
+    assert(rc && acl.size() == 3 && acl.partitions() == 3);
+    rc = acl.remove(e[1]);
+    assert(!rc);
+    rc = acl.remove(e[2]);
+    assert(rc && acl.partitions() == 2);
+    acl.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, key);
+    r = acl.find(key);
+    assert(r.size() == 1 && r[0].second == 3);
+    std::cout << "removed (correct)\n";
+}
+
+/**
+ * @name  tierTest
+ * @brief Tests \e rtacl::tierDb (tiers by the address range size)
+ */
+static void
+tierTest ()
+{
+    static const struct {
+        const char* rule;
+        size_t      tier;
+    } rules[] = {
+        { "10.1.2.3, 192.168.1.1, *, 80, 6, *", 2 },    // 0 bits
+        { "10.1.0.0/16, 192.168.1.0/24, *, *, *, *", 1 }, // 24 bits
+        { "10.0.0.0/8, *, *, *, *, *", 0 },             // 56 bits
+        { "*, *, *, 80, 6, *", 0 },                     // 64 bits
+    };
+    rtacl::tierDb<rtacl::ipv4a> acl;
+    rtacl::entry<rtacl::ipv4a> e[elementsof(rules)];
+    rtacl::tuple<rtacl::ipv4a> key;
+    rtacl::result<rtacl::ipv4a> r;
+    size_t i;
+    bool rc;
+
+    assert(acl.nTiers() == 3);
+    for (i = 0; i < elementsof(rules); ++i) {
+        rc = rtacl::str2range(rules[i].rule, e[i].first);
+        assert(rc);
+        e[i].second = i;
+        assert(acl.tierOf(e[i].first) == rules[i].tier);
+        acl.insert(e[i]);
+    }
+    assert(acl.breadth(e[2].first) == 56);
+    assert(acl.tierSize(0) == 2 && acl.tierSize(1) == 1 &&
+           acl.tierSize(2) == 1 && acl.size() == 4);
+    std::cout << (bfmt("tiers: %u, %u, %u (correct)\n") % acl.tierSize(0)
+                  % acl.tierSize(1) % acl.tierSize(2)).str();
+
+    /*
+     * The broad rules come first
+     */
+    acl.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, key);
+    r = acl.find(key);
+    assert(r.size() == 4 && r[2].second == 1 && r[3].second == 0);
+    assert(acl.matchesAny(key) && acl.countMatches(key) == 4);
+    std::cout << "4 matches (correct)\n";
+    acl.makeKey(0x0b010203, 0xc0a80101, 1234, 443, 6, 0, key);
+    assert(!acl.matchesAny(key) && acl.find(key).empty());
+    std::cout << "no match (correct)\n";
+
+    rc = acl.remove(e[0]);
+    assert(rc && acl.tierSize(2) == 0);
+    rc = acl.remove(e[0]);
+    assert(!rc);
+    acl.makeKey(0x0a010203, 0xc0a80101, 1234, 80, 6, 0, key);
+    assert(acl.countMatches(key) == 3);
+    std::cout << "removed (correct)\n";
+}
+
+/**
+ * @name  rfcTest
+ * @brief Tests \e rtacl::rfc against \e rtacl::db
+ */
+static void
+rfcTest ()
+{
+    static const char* rules[] = {
+        "10.0.0.0/8, *, *, 80, 6, *",
+        "10.1.2.3-10.3.4.5, 192.168.0.0/16, 1000-2000, *, *, *",
+        "*, *, *, *, 17, 10-20",
+        "10.1.0.0/16, 192.168.1.1, *, 443, 6, *",
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > e(elementsof(rules));
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::rfc<rtacl::ipv4a> engine;
+    rtacl::tuple<rtacl::ipv4a> key;
+    size_t i, bad = 0;
+    bool rc;
+
+    for (i = 0; i < e.size(); ++i) {
+        rc = rtacl::str2range(rules[i], e[i].first);
+        assert(rc);
+        e[i].second = i;
+        acl.insert(e[i]);
+    }
+    rc = engine.build(e.begin(), e.end(), 10);
+    assert(!rc && engine.size() == 0);
+    rc = engine.build(e.begin(), e.end());
+    assert(rc && engine.size() == e.size() && engine.reads() == 15);
+    std::cout << (bfmt("%u rules, %u sub-rules, %u table reads, "
+                       "%u bytes\n")
+                  % engine.size() % engine.subRules() % engine.reads()
+                  % engine.memory()).str();
+
+    /*
+     * Same matches as db in the order of priority
+     */
+    u32 seed = 1;
+    for (i = 0; i < 100000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        u32 r = seed >> 8;
+        acl.makeKey(0x0a000000 | (r & 0x03ffffff),
+                    (r & 1) ? 0xc0a80000 | (r & 0x1ff) : r << 4,
+                    r % 3000, (r & 2) ? 80 : 443, (r & 4) ? 6 : 17,
+                    r & 31, key);
+        rtacl::result<rtacl::ipv4a> r1 = acl.find(key);
+        rtacl::result<rtacl::ipv4a> r2 = engine.find(key);
+        std::vector<uintptr_t> v1, v2;
+        for (auto& m : r1) {
+            v1.push_back(m.second);
+        }
+        for (auto& m : r2) {
+            v2.push_back(m.second);
+        }
+        std::sort(v1.begin(), v1.end());
+        const rtacl::entry<rtacl::ipv4a>* p = engine.first(key);
+        if (v1 != v2 || (p == nullptr) != v1.empty() ||
+            (p && p->second != v1[0])) {
+            ++bad;
+        }
+    }
+    std::cout << (bad ? (bfmt("Error: %u mismatches\n") % bad).str() :
+                  "same as db (correct)\n");
+    assert(bad == 0);
+
+    /*
+     * IPv6 prefixes of /64 or shorter and no source port or DSCP:
+     * those chunks are folded, and the lookup reads fewer tables
+     */
+    static const char* rules6[] = {
+        "2001:db8::/32, *, *, 80, 6, *",
+        "2001:db8:1::/48, 2001:db8:ff::/48, *, 443, 6, *",
+        "*, 2001:db8:2:3::/64, *, *, 17, *",
+    };
+    std::vector<rtacl::entry<rtacl::ipv6a> > e6(elementsof(rules6));
+    rtacl::db<rtacl::ipv6a> acl6;
+    rtacl::rfc<rtacl::ipv6a> engine6;
+    rtacl::tuple<rtacl::ipv6a> key6;
+    for (i = 0; i < e6.size(); ++i) {
+        rc = rtacl::str2range(rules6[i], e6[i].first);
+        assert(rc);
+        e6[i].second = i;
+        acl6.insert(e6[i]);
+    }
+    rc = engine6.build(e6.begin(), e6.end());
+    assert(rc && engine6.reads() < 20 + 19);
+    std::cout << (bfmt("IPv6: %u rules, %u table reads (of 39)\n")
+                  % engine6.size() % engine6.reads()).str();
+    const rtacl::ipv6a net = rtacl::ipv6a(0x20010db8) << 96;
+    size_t hits = 0;
+    for (i = 0; i < 100000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        u32 r = seed >> 8;
+        rtacl::ipv6a sa = net + (rtacl::ipv6a(r & 0x3) << 80) + r;
+        rtacl::ipv6a da = (r & 1) ?
+            net + (rtacl::ipv6a(0xff) << 80) + (r >> 4) :
+            net + (rtacl::ipv6a(0x20003) << 64) + (r >> 4);
+        acl6.makeKey((r & 8) ? sa : sa + (rtacl::ipv6a(1) << 112), da,
+                     r % 3000, (r & 2) ? 80 : 443, (r & 4) ? 6 : 17,
+                     r & 31, key6);
+        rtacl::result<rtacl::ipv6a> r1 = acl6.find(key6);
+        rtacl::result<rtacl::ipv6a> r2 = engine6.find(key6);
+        std::vector<uintptr_t> v1, v2;
+        for (auto& m : r1) {
+            v1.push_back(m.second);
+        }
+        for (auto& m : r2) {
+            v2.push_back(m.second);
+        }
+        std::sort(v1.begin(), v1.end());
+        if (v1 != v2) {
+            ++bad;
+        }
+        hits += v1.size();
+    }
+    std::cout << (bad ? (bfmt("Error: %u IPv6 mismatches\n") % bad).str() :
+                  (bfmt("IPv6 %u matches, same as db (correct)\n")
+                   % hits).str());
+    assert(bad == 0 && hits > 0);
+}
+
+/**
+ * @name  bvTest
+ * @brief Tests \e rtacl::bv against \e rtacl::db
+ */
+static void
+bvTest ()
+{
+    enum {
+        nRules = 300,
+    };
+    std::vector<rtacl::entry<rtacl::ipv4a> > e(nRules);
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::bv<rtacl::ipv4a> engine;
+    rtacl::tuple<rtacl::ipv4a> key;
+    size_t i, bad = 0;
+    bool simd;
+
+    /*
+     * Rules of mixed sizes (some wildcarding all the fields but
+     * the source IP)
+     */
+    u32 seed = 1;
+    for (i = 0; i < e.size(); ++i) {
+        seed = seed * 1103515245 + 12345;
+        u32 r = seed >> 8;
+        ipv4a sa = 0x0a000000 | (r & 0x000fff00);
+        ipv4a sp = (r % 3) ? 0 : 1024;
+        acl.makeMin(sa, (r & 1) ? 0 : 0xc0a80000, sp, (r & 2) ? 0 : 80,
+                    (r & 4) ? 0 : 6, 0, e[i].first.min_corner());
+        acl.makeMax(sa + ((r & 8) ? 0xff : 0x3fff),
+                    (r & 1) ? 0xffffffff : 0xc0a8ffff, 0xffff,
+                    (r & 2) ? 0xffff : 80, (r & 4) ? 0xff : 6, 0xff,
+                    e[i].first.max_corner());
+        e[i].second = i;
+        acl.insert(e[i]);
+    }
+    engine.build(e.begin(), e.end());
+    assert(engine.size() == nRules);
+
+    for (simd = false; ; simd = true) {
+        engine.enableSimd(simd);
+        for (i = 0; i < 100000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            u32 r = seed >> 8;
+            acl.makeKey(0x0a000000 | (r & 0x000fffff),
+                        (r & 1) ? 0xc0a80000 | (r & 0xffff) : r << 4,
+                        r & 0x7ff, (r & 2) ? 80 : 443, (r & 4) ? 6 : 17,
+                        0, key);
+            rtacl::result<rtacl::ipv4a> r1 = acl.find(key);
+            rtacl::result<rtacl::ipv4a> r2 = engine.find(key);
+            std::vector<uintptr_t> v1, v2;
+            for (auto& m : r1) {
+                v1.push_back(m.second);
+            }
+            for (auto& m : r2) {
+                v2.push_back(m.second);
+            }
+            std::sort(v1.begin(), v1.end());
+            const rtacl::entry<rtacl::ipv4a>* p = engine.first(key);
+            const rtacl::entry<rtacl::ipv4a>* q = engine.firstLinear(key);
+            if (v1 != v2 || p != q || (p == nullptr) != v1.empty() ||
+                (p && p->second != v1[0])) {
+                ++bad;
+            }
+        }
+        if (simd) {
+            break;
+        }
+    }
+    std::cout << (bad ? (bfmt("Error: %u mismatches\n") % bad).str() :
+                  (bfmt("%u rules, %u bytes: same as db (correct)\n")
+                   % engine.size() % engine.memory()).str());
+    assert(bad == 0);
+}
+
+/**
+ * @class poisonAllocator
+ * @brief Allocator filling the freed memory with 0xdd and keeping
+ *        it in a quarantine for a while so that a use-after-free
+ *        reads garbage instead of a reused node
+ */
+template <class T>
+struct poisonAllocator {
+    typedef T value_type;
+    enum {
+        quarantine = 4096,
+    };
+
+    poisonAllocator () {};
+    template <class U>
+    poisonAllocator (const poisonAllocator<U>&) {};
+    T* allocate (size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    };
+    void deallocate (T* p, size_t n) {
+        static std::mutex m;
+        static std::deque<void*> q;
+        memset(static_cast<void*>(p), 0xdd, n * sizeof(T));
+        std::lock_guard<std::mutex> l(m);
+        q.push_back(p);
+        if (q.size() > quarantine) {
+            ::operator delete(q.front());
+            q.pop_front();
+        }
+    };
+    template <class U>
+    bool operator== (const poisonAllocator<U>&) const { return true; };
+    template <class U>
+    bool operator!= (const poisonAllocator<U>&) const { return false; };
+};
+
+/**
+ * @name  epochTest
+ * @brief Stress test of \e rtacl::epochDb: lookups concurrent with
+ *        removes and inserts (freed nodes are poisoned)
+ */
+static void
+epochTest ()
+{
+    enum {
+        nRules   = 1000,
+        nReaders = 2,
+        nRounds  = 2,
+        churn    = 100000,
+    };
+    typedef poisonAllocator<rtacl::entry<rtacl::ipv4a> > alloc;
+    rtacl::epochDb<rtacl::ipv4a, uintptr_t, alloc> acl;
+    std::vector<rtacl::entry<rtacl::ipv4a> > stable(nRules), moving(nRules);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> errors(0), lookups(0);
+    size_t i, j;
+
+    /*
+     * Stable: 10.i.i.0/24 to any (never removed)
+     * Moving: 10.i.i.0/24 to any port 80 (removed and inserted)
+     */
+    for (i = 0; i < nRules; ++i) {
+        ipv4a sa = 0x0a000000 + (i << 8);
+        acl.getDb().makeMin(sa, 0, 0, 0, 6, 0, stable[i].first.min_corner());
+        acl.getDb().makeMax(sa + 0xff, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                            stable[i].first.max_corner());
+        stable[i].second = i;
+        moving[i] = stable[i];
+        acl.getDb().makeMin(sa, 0, 0, 80, 6, 0, moving[i].first.min_corner());
+        acl.getDb().makeMax(sa + 0xff, 0xffffffff, 0xffff, 80, 6, 0xff,
+                            moving[i].first.max_corner());
+        moving[i].second = churn + i;
+        acl.insert(stable[i]);
+        acl.insert(moving[i]);
+    }
+    assert(acl.version() == 2 * nRules);
+    acl.read([](const rtacl::epochDb<rtacl::ipv4a, uintptr_t,
+                                     alloc>::dbType& d, u64 v) {
+            assert(d.size() == 2 * nRules && v == 2 * nRules);
+        });
+
+    std::vector<std::thread> readers;
+    for (j = 0; j < nReaders; ++j) {
+        readers.push_back(std::thread([&, j]() {
+                    rtacl::db<rtacl::ipv4a> k;
+                    rtacl::tuple<rtacl::ipv4a> key;
+                    size_t n = j;
+                    while (!stop.load()) {
+                        size_t r = n++ % nRules;
+                        k.makeKey(0x0a000000 + (r << 8) + 1, 0x12345678,
+                                  1234, (n & 1) ? 80 : 443, 6, 0, key);
+                        rtacl::result<rtacl::ipv4a> res = acl.find(key);
+                        bool found = false;
+                        for (auto& m : res) {
+                            if (m.second == r) {
+                                found = true;
+                            } else if (m.second != churn + r ||
+                                       !(n & 1)) {
+                                ++errors;
+                            }
+                        }
+                        if (!found || res.size() > 2) {
+                            ++errors;
+                        }
+                        ++lookups;
+                        if ((n & 63) == 0) {
+                            std::this_thread::yield(); // let the writer run
+                        }
+                    }
+                }));
+    }
+    for (j = 0; j < nRounds; ++j) {
+        for (i = 0; i < nRules; ++i) {
+            bool rc = acl.remove(moving[i]);
+            if (!rc) {
+                ++errors;
+            }
+        }
+        for (i = 0; i < nRules; ++i) {
+            acl.insert(moving[i]);
+        }
+    }
+    stop.store(true);
+    for (auto& t : readers) {
+        t.join();
+    }
+    assert(acl.size() == 2 * nRules);
+    std::cout << (errors ?
+                  (bfmt("Error: %u errors\n") % errors.load()).str() :
+                  (bfmt("%u lookups during %u removes and inserts: "
+                        "no errors (correct)\n")
+                   % lookups.load() % (2 * nRounds * nRules)).str());
+    assert(errors == 0);
+
+    /*
+     * One more reader than the slots: it fails instead of
+     * overwriting the memory. The slots are released at the exits.
+     */
+    rtacl::epoch dom;
+    std::atomic<size_t> entered(0), refused(0);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> many;
+    for (j = 0; j <= RTACL_EPOCH_READERS; ++j) {
+        many.push_back(std::thread([&]() {
+                    try {
+                        rtacl::epoch::guard g(dom);
+                        ++entered;
+                        while (!done.load()) {
+                            std::this_thread::yield();
+                        }
+                    } catch (const std::length_error&) {
+                        ++refused;
+                    }
+                }));
+    }
+    while (entered + refused <= RTACL_EPOCH_READERS) {
+        std::this_thread::yield();
+    }
+    done.store(true);
+    for (auto& t : many) {
+        t.join();
+    }
+    bool reused = false;
+    std::thread([&]() {
+            rtacl::epoch::guard g(dom);
+            reused = true;
+        }).join();
+    std::cout << ((refused == 0 || !reused) ?
+                  (bfmt("Error: %u readers entered, %u refused\n")
+                   % entered.load() % refused.load()).str() :
+                  (bfmt("%u readers entered, %u refused, "
+                        "slots reused (correct)\n")
+                   % entered.load() % refused.load()).str());
+    assert(refused > 0 && entered <= RTACL_EPOCH_READERS && reused);
+}
+
+/**
+ * @name  asyncTest
+ * @brief Test of \e rtacl::asyncDb: coalescing, concurrent producers,
+ *        and the sequence numbers
+ */
+static void
+asyncTest ()
+{
+    enum {
+        nRules     = 2000,
+        nProducers = 2,
+    };
+    typedef rtacl::asyncDb<rtacl::ipv4a> adb;
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    size_t i;
+
+    for (i = 0; i < nRules; ++i) {
+        ipv4a sa = 0x0a000000 + (i << 8);
+        rtacl::db<rtacl::ipv4a> k;
+        k.makeMin(sa, 0, 0, 0, 6, 0, rules[i].first.min_corner());
+        k.makeMax(sa + 0xff, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                  rules[i].first.max_corner());
+        rules[i].second = i;
+    }
+
+    /*
+     * Coalescing: ins 0, ins 1, del 0, del 2, ins 0 -> ins 1, del 2, ins 0
+     */
+    std::vector<adb::update> b = {
+        adb::update(true, rules[0]), adb::update(true, rules[1]),
+        adb::update(false, rules[0]), adb::update(false, rules[2]),
+        adb::update(true, rules[0]),
+    };
+    size_t n = adb::coalesce(b);
+    assert(n == 2 && b.size() == 3);
+    assert(b[0].first && b[0].second.second == 1);
+    assert(!b[1].first && b[1].second.second == 2);
+    assert(b[2].first && b[2].second.second == 0);
+    std::cout << "coalesce: 5 updates -> 3 (correct)\n";
+
+    /*
+     * Each producer inserts its half of the rules, and removes the
+     * odd ones at once
+     */
+    adb acl(256, 64);
+    std::vector<std::thread> producers;
+    std::vector<u64> last(nProducers);
+    for (size_t p = 0; p < nProducers; ++p) {
+        producers.push_back(std::thread([&, p]() {
+                    for (size_t r = p; r < nRules; r += nProducers) {
+                        last[p] = acl.insert(rules[r]);
+                        if (r & 1) {
+                            last[p] = acl.remove(rules[r]);
+                        }
+                    }
+                }));
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    for (auto s : last) {
+        acl.wait(s);
+    }
+    assert(acl.size() == nRules / 2);
+    for (i = 0; i < nRules; ++i) {
+        rtacl::tuple<rtacl::ipv4a> key;
+        acl.getDb().makeKey(0x0a000000 + (i << 8) + 1, 1, 1, 1, 6, 0, key);
+        assert(acl.matchesAny(key) == !(i & 1));
+    }
+    std::cout << bfmt("%u inserts and %u removes from %u threads: "
+                      "%u rules, %u batches, %u coalesced (correct)\n")
+        % nRules % (nRules / 2) % nProducers % acl.size()
+        % acl.batches() % acl.coalesced();
+
+    u64 s = acl.remove(rules[0]);
+    acl.flush();
+    assert(acl.done(s) && acl.size() == nRules / 2 - 1);
+    std::cout << bfmt("seq %u done after flush (correct)\n") % s;
+}
+
+/**
+ * @name  ttlTest
+ * @brief Test of \e rtacl::timerWheel and of the time-bounded rules
+ *        of \e rtacl::db
+ */
+static void
+ttlTest ()
+{
+    enum {
+        nTimers = 20000,
+        nRules  = 1000,
+    };
+    /*
+     * Timer wheel: each timer fires once, at the first advance()
+     * reaching its expiry (some are beyond 2^32 ticks)
+     */
+    rtacl::timerWheel<size_t> w(1000);
+    std::vector<u64> when(nTimers), fired(nTimers, 0);
+    u64 r = 12345, now = 1000;
+    size_t i, errors = 0;
+
+    for (i = 0; i < nTimers; ++i) {
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        when[i] = now + ((r >> 33) >> ((r & 3) * 10));
+        if (i % 100 == 0) {
+            when[i] = now + (u64(1) << 33) + (r >> 40);
+        }
+        w.add(when[i], i);
+    }
+    while (w.size()) {
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        now += (r >> 33) >> ((r & 3) * 10);
+        w.advance(now, [&](u64 e, size_t t) {
+                if (e != when[t] || e > now || fired[t]++) {
+                    ++errors;
+                }
+            });
+        for (i = 0; i < nTimers; i += 97) {
+            if (!fired[i] && when[i] <= now) {
+                ++errors;
+            }
+        }
+    }
+    assert(errors == 0);
+    std::cout << bfmt("timer wheel: %u timers up to %u ticks: "
+                      "no errors (correct)\n") % nTimers % (now - 1000);
+
+    /*
+     * db: rule i expires at 100 + i % 10
+     */
+    rtacl::db<rtacl::ipv4a> acl;
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules + 1);
+    for (i = 0; i <= nRules; ++i) {
+        ipv4a sa = 0x0a000000 + (i << 8);
+        acl.makeMin(sa, 0, 0, 0, 6, 0, rules[i].first.min_corner());
+        acl.makeMax(sa + 0xff, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                    rules[i].first.max_corner());
+        rules[i].second = i;
+        if (i < nRules) {
+            acl.insert(rules[i], 100 + i % 10);
+        }
+    }
+    acl.insert(rules[nRules]);                   // never expires
+    acl.insert(rules[1], 200);                   // refreshed
+    acl.remove(rules[2]);                        // cancelled
+    acl.insert(rules[2]);
+    assert(acl.size() == nRules + 1 && acl.timedRules() == nRules - 1);
+    assert(acl.tick(99) == 0);
+    size_t n = acl.tick(105, 1000);
+    assert(n == 6 * nRules / 10 - 2 && acl.expiryBacklog() == 0);
+    n = acl.tick(110, 100);
+    assert(n == 100 && acl.expiryBacklog() == 4 * nRules / 10 - 100);
+    while (acl.expiryBacklog()) {
+        n += acl.tick(110, 100);
+    }
+    assert(n == 4 * nRules / 10);
+    assert(acl.size() == 3 && acl.timedRules() == 1);
+    rtacl::tuple<rtacl::ipv4a> key;
+    acl.makeKey(0x0a000101, 1, 1, 1, 6, 0, key);
+    assert(acl.matchesAny(key));
+    assert(acl.tick(200) == 1 && acl.size() == 2 && acl.timedRules() == 0);
+    std::cout << bfmt("%u timed rules expired in batches of 100: "
+                      "refreshed, cancelled, and untimed rules kept "
+                      "(correct)\n") % nRules;
+
+    /*
+     * Same payload, different ranges: separate timers
+     */
+    rtacl::db<rtacl::ipv4a> acl2;
+    rtacl::entry<rtacl::ipv4a> a = rules[10], b = rules[20];
+    a.second = b.second = 7;
+    acl2.insert(a, 300);
+    acl2.insert(b, 400);
+    assert(acl2.size() == 2 && acl2.timedRules() == 2);
+    acl2.insert(b, 500);                         // refreshed (later)
+    assert(acl2.size() == 2 && acl2.timedRules() == 2);
+    assert(acl2.tick(300) == 1 && acl2.size() == 1);
+    assert(!acl2.remove(a) && acl2.timedRules() == 1);
+    assert(acl2.tick(499) == 0 && acl2.size() == 1);
+    assert(acl2.tick(500) == 1 && acl2.size() == 0 && acl2.timedRules() == 0);
+    /*
+     * Refreshes to earlier times and re-inserts after removals
+     */
+    for (i = 0; i < nRules; ++i) {
+        acl2.insert(a, 100000 - i);
+        acl2.insert(b, 600 + i);
+        if (i % 2) {
+            assert(acl2.remove(b));
+        }
+    }
+    assert(acl2.size() == 1 && acl2.timedRules() == 1);
+    assert(acl2.tick(100000 - nRules) == 0);
+    assert(acl2.tick(100000 - nRules + 1) == 1 && acl2.size() == 0);
+    assert(acl2.tick(200000) == 0 && acl2.timedRules() == 0);
+    std::cout << "same payload in 2 ranges: separate timers, "
+        "refreshed to earlier and later, cancelled (correct)\n";
+}
+
+/**
+ * @name  deferTest
+ * @brief Test of \e rtacl::deferDb: rules match once and only once
+ *        while they are in a side tree, being moved by the drainer
+ *        thread, and in the R-tree
+ */
+static void
+deferTest ()
+{
+    enum {
+        nRules = 1000,
+        cap    = 16,
+    };
+    rtacl::deferDb<rtacl::ipv4a> acl(cap);
+    rtacl::db<rtacl::ipv4a> ref;
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    size_t i, errors = 0;
+
+    /*
+     * Rule i: 10.0.(i/2).0/24 to any, to port 80 for odd i
+     */
+    for (i = 0; i < nRules; ++i) {
+        ipv4a sa = 0x0a000000 + ((i / 2) << 8);
+        ipv4a dp = (i & 1) ? 80 : 0;
+        ipv4a dpMax = (i & 1) ? 80 : 0xffff;
+        ref.makeMin(sa, 0, 0, dp, 6, 0, rules[i].first.min_corner());
+        ref.makeMax(sa + 0xff, 0xffffffff, 0xffff, dpMax, 6, 0xff,
+                    rules[i].first.max_corner());
+        rules[i].second = i;
+    }
+    auto check = [&]() {
+        for (size_t j = 0; j < nRules / 2; ++j) {
+            rtacl::tuple<rtacl::ipv4a> key;
+            ref.makeKey(0x0a000001 + (j << 8), 1, 1, 80, 6, 0, key);
+            rtacl::result<rtacl::ipv4a> r1 = acl.find(key);
+            rtacl::result<rtacl::ipv4a> r2 = ref.find(key);
+            std::set<uintptr_t> s1, s2;
+            for (auto& e : r1) {
+                s1.insert(e.second);
+            }
+            for (auto& e : r2) {
+                s2.insert(e.second);
+            }
+            if (s1 != s2 || r1.size() != r2.size() ||
+                acl.countMatches(key) != r2.size() ||
+                acl.matchesAny(key) != !r2.empty()) {
+                ++errors;
+            }
+        }
+    };
+    for (i = 0; i < nRules; ++i) {
+        acl.insert(rules[i]);
+        ref.insert(rules[i]);
+        if (acl.pending() > 2 * cap || acl.size() != i + 1) {
+            ++errors;
+        }
+        if (i % 100 == 0) {
+            check();            // the drainer may be moving a batch
+        }
+    }
+    assert(acl.size() == nRules);
+    check();
+    /*
+     * Remove every third rule, from the buffer or from the R-tree
+     */
+    for (i = 0; i < nRules; i += 3) {
+        bool rc = acl.remove(rules[i]);
+        if (!rc) {
+            ++errors;
+        }
+        ref.remove(rules[i]);
+    }
+    check();
+    acl.flush();
+    assert(acl.pending() == 0 && acl.size() == ref.size());
+    assert(acl.getDb().size() == ref.size());
+    check();
+    assert(errors == 0);
+    std::cout << bfmt("%u rules through %u-rule side trees in %u batches: "
+                      "same matches as rtacl::db (correct)\n")
+        % nRules % cap % acl.batches();
+}
+
+/**
+ * @name  explainTest
+ * @brief Test of \e rtacl::db::explain() and \e rtacl::costStats
+ */
+static void
+explainTest ()
+{
+    enum {
+        nRules = 5000,
+    };
+    rtacl::db<rtacl::ipv4a> acl;
+    rtacl::entry<rtacl::ipv4a> e;
+    rtacl::costStats st;
+    size_t i, errors = 0;
+
+    /*
+     * 10.(i/256).(i%256).0/24 to any port 80, and 10.0.0.0/8 to any
+     */
+    for (i = 0; i < nRules; ++i) {
+        ipv4a sa = 0x0a000000 + (i << 8);
+        acl.makeMin(sa, 0, 0, 80, 6, 0, e.first.min_corner());
+        acl.makeMax(sa + 0xff, 0xffffffff, 0xffff, 80, 6, 0xff,
+                    e.first.max_corner());
+        e.second = i;
+        acl.insert(e);
+    }
+    acl.makeMin(0x0a000000, 0, 0, 0, 0, 0, e.first.min_corner());
+    acl.makeMax(0x0affffff, 0xffffffff, 0xffff, 0xffff, 0xff, 0xff,
+                e.first.max_corner());
+    acl.insert(e);
+    rtacl::tuple<rtacl::ipv4a> key;
+    acl.makeKey(0x0a000001, 1, 1, 80, 6, 0, key);
+    u32 levels = acl.explain(key).levels;     // leaves are at the same depth
+
+    for (i = 0; i < nRules; i += 7) {
+        acl.makeKey(0x0a000001 + (i << 8), 1, 1, (i & 1) ? 80 : 443, 6, 0,
+                    key);
+        rtacl::queryCost c = acl.explain(key);
+        if (c.matches != acl.countMatches(key) || c.nodes[0] != 1 ||
+            c.levels != levels || c.nodes[levels - 1] != c.leaves ||
+            c.tested < c.matches || c.visited() > c.boxes + 1) {
+            ++errors;
+        }
+        st.add(c);
+    }
+    std::cout << acl.explain(key).str() << "\n";
+    assert(errors == 0 && st.count() == (nRules + 6) / 7);
+    assert(st.average(rtacl::costStats::matches) > 1.4 &&
+           st.average(rtacl::costStats::matches) < 1.6);
+    std::cout << bfmt("%u lookups: %.2f nodes, %.2f entries tested, "
+                      "%.2f matches/lookup (correct)\n")
+        % st.count() % st.average(rtacl::costStats::nodes)
+        % st.average(rtacl::costStats::tested)
+        % st.average(rtacl::costStats::matches);
+
+    /*
+     * Per-thread shards add up to the same statistics
+     */
+    rtacl::costShards shards;
+    std::vector<std::thread> threads;
+    for (i = 0; i < 4; ++i) {
+        threads.push_back(std::thread([&]() {
+                    rtacl::tuple<rtacl::ipv4a> k;
+                    for (size_t r = 0; r < nRules; r += 7) {
+                        acl.makeKey(0x0a000001 + (r << 8), 1, 1,
+                                    (r & 1) ? 80 : 443, 6, 0, k);
+                        shards.add(acl.explain(k));
+                    }
+                }));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    rtacl::costStats all = shards.merged();
+    assert(all.count() == 4 * st.count() &&
+           all.average(rtacl::costStats::matches) ==
+           st.average(rtacl::costStats::matches) &&
+           all.average(rtacl::costStats::nodes) ==
+           st.average(rtacl::costStats::nodes));
+    std::cout << bfmt("4 threads: %u lookups merged (correct)\n")
+        % all.count();
+#ifdef RTACL_EXPLAIN
+    acl.makeKey(0x0a000001, 1, 1, 80, 6, 0, key);
+    acl.clearCosts();
+    assert(acl.find(key).size() == 2 && acl.costs().count() == 1);
+    std::cout << "find() recorded (correct)\n";
+#endif
+}
+
+/**
+ * @name  repackTest
+ * @brief Test of the tree quality metrics and of the repack of
+ *        \e rtacl::db and \e rtacl::epochDb (with lookups running)
+ */
+static void
+repackTest ()
+{
+    enum {
+        nRules = 6000,
+    };
+    rtacl::epochDb<rtacl::ipv4a> acl;
+    std::vector<rtacl::entry<rtacl::ipv4a> > rules(nRules);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> errors(0), lookups(0);
+    size_t i;
+
+    /*
+     * Rule i: 10.(i/256).(i%256).0/24 to any; 2/3 of them are removed
+     */
+    for (i = 0; i < nRules; ++i) {
+        ipv4a sa = 0x0a000000 + (i << 8);
+        acl.getDb().makeMin(sa, 0, 0, 0, 6, 0, rules[i].first.min_corner());
+        acl.getDb().makeMax(sa + 0xff, 0xffffffff, 0xffff, 0xffff, 6, 0xff,
+                            rules[i].first.max_corner());
+        rules[i].second = i;
+        acl.insert(rules[i]);
+    }
+    for (i = 0; i < nRules; ++i) {
+        if (i % 3) {
+            acl.remove(rules[i]);
+        }
+    }
+    rtacl::treeQuality q0 = acl.quality();
+    std::cout << q0.str() << "\n";
+    assert(q0.entries == nRules / 3 && q0.levels >= 2 &&
+           q0.nodes + q0.leaves > 1 && q0.fill < 0.6);
+
+    /*
+     * db::repack() keeps the entries
+     */
+    rtacl::db<rtacl::ipv4a> copy(acl.getDb());
+    copy.repack();
+    rtacl::treeQuality q1 = copy.quality();
+    assert(q1.entries == q0.entries && q1.leaves < q0.leaves &&
+           q1.fill > 0.9);
+    assert(copy.dump().size() == nRules / 3);
+
+    std::thread reader([&]() {
+            rtacl::db<rtacl::ipv4a> k;
+            rtacl::tuple<rtacl::ipv4a> key;
+            size_t n = 0;
+            while (!stop.load()) {
+                size_t r = n++ % nRules;
+                k.makeKey(0x0a000001 + (r << 8), 1, 1, 1, 6, 0, key);
+                if (acl.matchesAny(key) != (r % 3 == 0)) {
+                    ++errors;
+                }
+                ++lookups;
+                if ((n & 63) == 0) {
+                    std::this_thread::yield(); // let the repack run
+                }
+            }
+        });
+    /*
+     * The dead space alone triggers it, and only one of the
+     * concurrent callers starts the repack
+     */
+    rtacl::repackPolicy dead;
+    dead.minFill = 0;
+    dead.maxDeadSpace = 0.05;
+    assert(q0.nodes > 0 && dead.exceeded(q0) && !dead.exceeded(q1));
+    std::atomic<size_t> starts(0);
+    std::vector<std::thread> callers;
+    for (i = 0; i < 4; ++i) {
+        callers.push_back(std::thread([&]() {
+                    if (acl.autoRepack(dead)) {
+                        ++starts;
+                    }
+                }));
+    }
+    for (auto& t : callers) {
+        t.join();
+    }
+    bool started = (starts == 1);
+    assert(started);
+    while (acl.isRepacking()) {
+        std::this_thread::yield();
+    }
+    stop.store(true);
+    reader.join();
+    rtacl::treeQuality q2 = acl.quality();
+    std::cout << q2.str() << "\n";
+    assert(errors == 0 && q2.entries == q0.entries && q2.fill > 0.9);
+    assert(!acl.autoRepack(rtacl::repackPolicy()));     // healthy now
+    std::cout << bfmt("fill %.2f -> %.2f with %u lookups during the "
+                      "repack: no errors (correct)\n")
+        % q0.fill % q2.fill % lookups.load();
+}
+
+/**
+ * @name  regionTest
+ * @brief Test of \e rtacl::db::intersecting() and
+ *        \e rtacl::db::within() against a linear scan
+ */
+static void
+regionTest ()
+{
+    enum {
+        nRules = 2000,
+        chunk  = 7,
+    };
+    struct rule {
+        rtacl::ipv4a lo[rtacl::dim];
+        rtacl::ipv4a hi[rtacl::dim];
+    };
+    rtacl::db<rtacl::ipv4a> acl;
+    std::vector<rule> rules(nRules);
+    std::mt19937 mt(7);
+    size_t i, d, errors = 0;
+
+    /*
+     * Rule i: 10.(i/8).x.0/24 or 10.(i/8).0.0/16 to port 80, 443, or
+     * 1024-65535, TCP
+     */
+    for (i = 0; i < nRules; ++i) {
+        rule& r = rules[i];
+        rtacl::entry<rtacl::ipv4a> e;
+        ipv4a sa = 0x0a000000 + ((i / 8) << 16);
+        ipv4a dp[] = { 80, 443, 1024 };
+        r.lo[0] = sa + ((mt() & 1) ? (mt() & 0xff00) : 0);
+        r.hi[0] = (r.lo[0] == sa) ? sa + 0xffff : r.lo[0] + 0xff;
+        r.lo[1] = 0;
+        r.hi[1] = 0xffffffff;
+        r.lo[2] = 0;
+        r.hi[2] = 0xffff;
+        r.lo[3] = dp[i % 3];
+        r.hi[3] = (i % 3 == 2) ? 0xffff : r.lo[3];
+        r.lo[4] = r.hi[4] = 6;
+        r.lo[5] = 0;
+        r.hi[5] = 0xff;
+        acl.makeMin(r.lo, e.first.min_corner());
+        acl.makeMax(r.hi, e.first.max_corner());
+        e.second = i;
+        acl.insert(e);
+    }
+
+    const rule regions[] = {
+        // 10.0.0.0/8 to port 443
+        { { 0x0a000000, 0, 0, 443, 0, 0 },
+          { 0x0affffff, 0xffffffff, 0xffff, 443, 0xff, 0xff } },
+        // 10.5.0.0/16 to any (10.4/16 and 10.6/16 are adjacent)
+        { { 0x0a050000, 0, 0, 0, 0, 0 },
+          { 0x0a05ffff, 0xffffffff, 0xffff, 0xffff, 0xff, 0xff } },
+        // 10.7.1.0/24 to ports 81-442 (adjacent to 80 and 443)
+        { { 0x0a070100, 0, 0, 81, 0, 0 },
+          { 0x0a0701ff, 0xffffffff, 0xffff, 442, 0xff, 0xff } },
+        // 10.5.0.0/24 to any (inside the /16 rules)
+        { { 0x0a050000, 0, 0, 0, 0, 0 },
+          { 0x0a0500ff, 0xffffffff, 0xffff, 0xffff, 0xff, 0xff } },
+        // 10.0.0.0/12 to ports 0-1023, TCP
+        { { 0x0a000000, 0, 0, 0, 6, 0 },
+          { 0x0a0fffff, 0xffffffff, 0xffff, 1023, 6, 0xff } },
+    };
+    for (auto& g : regions) {
+        rtacl::range<rtacl::ipv4a> region;
+        std::set<uintptr_t> s1, s2, w1, w2;
+        acl.makeMin(g.lo, region.min_corner());
+        acl.makeMax(g.hi, region.max_corner());
+        for (i = 0; i < nRules; ++i) {
+            bool meet = true, in = true;
+            for (d = 0; d < rtacl::dim; ++d) {
+                meet = meet && rules[i].lo[d] <= g.hi[d] &&
+                    g.lo[d] <= rules[i].hi[d];
+                in = in && g.lo[d] <= rules[i].lo[d] &&
+                    rules[i].hi[d] <= g.hi[d];
+            }
+            if (meet) {
+                s1.insert(i);
+            }
+            if (in) {
+                w1.insert(i);
+            }
+        }
+        size_t n = acl.intersecting(
+            region, [&](const rtacl::result<rtacl::ipv4a>& r) {
+                if (r.empty() || r.size() > chunk) {
+                    ++errors;
+                }
+                for (auto& e : r) {
+                    s2.insert(e.second);
+                }
+                return true;
+            }, chunk);
+        size_t m = acl.within(
+            region, [&](const rtacl::result<rtacl::ipv4a>& r) {
+                for (auto& e : r) {
+                    w2.insert(e.second);
+                }
+                return true;
+            }, chunk);
+        if (s1 != s2 || w1 != w2 || n != s1.size() || m != w1.size()) {
+            ++errors;
+        }
+        std::cout << bfmt("%s: %u intersecting, %u within\n")
+            % rtacl::range2str(region) % n % m;
+    }
+    /*
+     * Stop after 2 chunks
+     */
+    const rtacl::ipv4a lo[rtacl::dim] = { 0, 0, 0, 0, 0, 0 };
+    const rtacl::ipv4a hi[rtacl::dim] = {
+        0xffffffff, 0xffffffff, 0xffff, 0xffff, 0xff, 0xff
+    };
+    rtacl::range<rtacl::ipv4a> all;
+    acl.makeMin(lo, all.min_corner());
+    acl.makeMax(hi, all.max_corner());
+    size_t calls = 0;
+    size_t n = acl.intersecting(all, [&](const rtacl::result<rtacl::ipv4a>&) {
+            return ++calls < 2;
+        }, chunk);
+    assert(errors == 0 && calls == 2 && n == 2 * chunk);
+    std::cout << "same as linear scan, stopped after 2 chunks (correct)\n";
+}
+
+
+/**
+ * @name  visitTest
+ * @brief Test of \e rtacl::db::forEach(), \e rtacl::db::forEachParallel()
+ *        and the entry iterator
+ */
+static void
+visitTest ()
+{
+    enum {
+        nRules = 3000,
+    };
+    rtacl::db<rtacl::ipv4a> acl;
+    std::mt19937 mt(11);
+    size_t i, d, errors = 0;
+
+    /*
+     * Empty and single-entry trees
+     */
+    auto count = [](const rtacl::entry<rtacl::ipv4a>&) {};
+    if (acl.forEach(count) != 0 || acl.forEachParallel(count, 4) != 0 ||
+        acl.begin() != acl.end()) {
+        ++errors;
+    }
+    for (i = 0; i < nRules; ++i) {
+        rtacl::ipv4a lo[rtacl::dim], hi[rtacl::dim];
+        rtacl::entry<rtacl::ipv4a> e;
+        for (d = 0; d < rtacl::dim; ++d) {
+            lo[d] = mt() & 0xff;
+            hi[d] = lo[d] + (mt() & 0x3f);
+        }
+        acl.makeMin(lo, e.first.min_corner());
+        acl.makeMax(hi, e.first.max_corner());
+        e.second = i;
+        acl.insert(e);
+        if (i == 0 && (acl.forEach(count) != 1 ||
+                       acl.forEachParallel(count, 4) != 1)) {
+            ++errors;
+        }
+    }
+
+    /*
+     * Every entry exactly once, in place, by every way of traversal
+     */
+    std::vector<size_t> seen(nRules, 0);
+    size_t n = acl.forEach([&](const rtacl::entry<rtacl::ipv4a>& e) {
+            ++seen[e.second];
+        });
+    for (auto& e : acl) {
+        ++seen[e.second];
+    }
+    for (size_t t : { 1, 3, 8 }) {
+        std::mutex m;
+        size_t p = acl.forEachParallel(
+            [&](const rtacl::entry<rtacl::ipv4a>& e) {
+                std::lock_guard<std::mutex> lock(m);
+                ++seen[e.second];
+            }, t);
+        if (p != nRules) {
+            ++errors;
+        }
+    }
+    for (i = 0; i < nRules; ++i) {
+        if (seen[i] != 5) {
+            ++errors;
+        }
+    }
+    rtacl::result<rtacl::ipv4a> r = acl.dump();
+    if (n != nRules || r.size() != nRules) {
+        ++errors;
+    }
+    assert(errors == 0);
+    std::cout << bfmt("%u entries visited by forEach, iterator, "
+                      "forEachParallel(1, 3, 8) and dump (correct)\n") % n;
+}
+
+/**
+ * @name  textTest
+ * @brief Test of \e rtacl::range2buf(), \e rtacl::tuple2buf() and
+ *        \e rtacl::db::exportText() against \e inet_ntop() and
+ *        \e boost::format
+ */
+static void
+textTest ()
+{
+    enum {
+        nAddrs = 20000,
+        nRules = 500,
+    };
+    std::mt19937_64 mt(13);
+    size_t i, errors = 0;
+    char buf[rtacl::textMax];
+    char ref[64];
+
+    /*
+     * IPv6 addresses with zero runs of every length and position,
+     * and the IPv4-mapped and -compatible forms
+     */
+    for (i = 0; i < nAddrs; ++i) {
+        u8 a[16];
+        u64 r = mt();
+        for (size_t w = 0; w < 8; ++w) {
+            u16 v = (r >> (w * 3)) & 3 ? static_cast<u16>(mt()) : 0;
+            if (((r >> 40) & 3) == 0) {
+                v = (w < 5) ? 0 : (w == 5) ? ((r & 1) ? 0xffff : 0) : v;
+            }
+            if (((r >> 42) & 7) == 0 && v) {
+                v &= 0xf;
+            }
+            a[w * 2] = static_cast<u8>(v >> 8);
+            a[w * 2 + 1] = static_cast<u8>(v);
+        }
+        inet_ntop(AF_INET6, a, ref, sizeof(ref));
+        *rtacl::ipv6toBuf(buf, a) = '\0';
+        std::string s6 = rtacl::ipv6a2s(rtacl::in6a2int<rtacl::ipv6a>(a));
+        if (strcmp(buf, ref) != 0 || s6 != ref) {
+            std::cout << bfmt("%s != %s\n") % buf % ref;
+            ++errors;
+        }
+        u32 a4 = static_cast<u32>(r >> (i % 33));
+        u32 n4 = htonl(a4);
+        inet_ntop(AF_INET, &n4, ref, sizeof(ref));
+        if (rtacl::ipv4a2s(a4) != ref) {
+            ++errors;
+        }
+    }
+    for (u64 v : { 0ULL, 9ULL, 10ULL, 99ULL, 100ULL, 65535ULL,
+                   4294967295ULL, 18446744073709551615ULL }) {
+        *rtacl::u64toBuf(buf, v) = '\0';
+        if (std::to_string(v) != buf) {
+            ++errors;
+        }
+    }
+
+    /*
+     * Ranges and tuples
+     */
+    rtacl::db<rtacl::ipv4a> acl4;
+    rtacl::db<rtacl::ipv6a> acl6;
+    std::map<uintptr_t, std::string> lines;
+    for (i = 0; i < nRules; ++i) {
+        rtacl::ipv4a lo4[rtacl::dim], hi4[rtacl::dim];
+        rtacl::ipv6a lo6[rtacl::dim], hi6[rtacl::dim];
+        rtacl::entry<rtacl::ipv4a> e4;
+        rtacl::entry<rtacl::ipv6a> e6;
+        const u64 max[rtacl::dim] = {
+            0xffffffff, 0xffffffff, 0xffff, 0xffff, 0xff, 0xff
+        };
+        for (size_t d = 0; d < rtacl::dim; ++d) {
+            u64 x = mt() % (max[d] + 1), y = mt() % (max[d] + 1);
+            lo4[d] = std::min(x, y);
+            hi4[d] = std::max(x, y);
+            if (d < 2) {
+                rtacl::u64x2toInt(mt() & ((i & 1) ? 0 : ~0ULL), mt(), lo6[d]);
+                rtacl::u64x2toInt(~0ULL, mt(), hi6[d]);
+            } else {
+                lo6[d] = lo4[d];
+                hi6[d] = hi4[d];
+            }
+        }
+        acl4.makeMin(lo4, e4.first.min_corner());
+        acl4.makeMax(hi4, e4.first.max_corner());
+        acl6.makeMin(lo6, e6.first.min_corner());
+        acl6.makeMax(hi6, e6.first.max_corner());
+        e4.second = i;
+        e6.second = i;
+        acl4.insert(e4);
+        acl6.insert(e6);
+
+        std::string r4 =
+            (bfmt("%s-%s, %s-%s, %d-%d, %d-%d, %d-%d, %d-%d")
+             % rtacl::ipv4a2s(lo4[0]) % rtacl::ipv4a2s(hi4[0])
+             % rtacl::ipv4a2s(lo4[1]) % rtacl::ipv4a2s(hi4[1])
+             % lo4[2] % hi4[2] % lo4[3] % hi4[3]
+             % lo4[4] % hi4[4] % lo4[5] % hi4[5]).str();
+        std::string r6 =
+            (bfmt("%s-%s, %s-%s, %d-%d, %d-%d, %d-%d, %d-%d")
+             % rtacl::ipv6a2s(lo6[0]) % rtacl::ipv6a2s(hi6[0])
+             % rtacl::ipv6a2s(lo6[1]) % rtacl::ipv6a2s(hi6[1])
+             % lo4[2] % hi4[2] % lo4[3] % hi4[3]
+             % lo4[4] % hi4[4] % lo4[5] % hi4[5]).str();
+        std::string t4 =
+            (bfmt("%s, %s, %d, %d, %d, %d")
+             % rtacl::ipv4a2s(lo4[0]) % rtacl::ipv4a2s(lo4[1])
+             % lo4[2] % lo4[3] % lo4[4] % lo4[5]).str();
+        rtacl::tuple<rtacl::ipv4a> k4;
+        acl4.makeKey(lo4, k4);
+        if (rtacl::range2str(e4.first) != r4 ||
+            rtacl::range2str(e6.first) != r6 ||
+            rtacl::tuple2str(k4) != t4 ||
+            rtacl::range2buf(buf, e4.first) != buf + r4.size()) {
+            ++errors;
+        }
+        lines[i] = r6;
+    }
+
+    /*
+     * exportText() to a file and a file descriptor
+     */
+    FILE* fp = tmpfile();
+    assert(fp != NULL);
+    if (!acl6.exportText(fp) || fflush(fp) != 0 ||
+        !acl4.exportText(fileno(fp))) {
+        ++errors;
+    }
+    rewind(fp);
+    size_t n6 = 0, n4 = 0;
+    char line[rtacl::textMax + 32];
+    while (fgets(line, sizeof(line), fp)) {
+        char* c = strrchr(line, ':');
+        uintptr_t h = strtoul(c + 2, NULL, 10);
+        *c = '\0';
+        if (n6 < nRules) {
+            errors += (lines[h] != line);
+            ++n6;
+        } else {
+            ++n4;
+        }
+    }
+    fclose(fp);
+    if (n6 != nRules || n4 != nRules) {
+        ++errors;
+    }
+    assert(errors == 0);
+    std::cout << bfmt("%u IPv6 and IPv4 addresses, %u ranges and tuples, "
+                      "%u exported lines: same as inet_ntop() and "
+                      "boost::format (correct)\n")
+        % nAddrs % nRules % (n6 + n4);
+}
+
+/**
+ * @name  parseTest
+ * @brief Test of \e rtacl::str2numRange(), \e rtacl::str2addrRange()
+ *        and \e rtacl::str2range() with valid, malformed, and
+ *        boundary input
+ */
+static void
+parseTest ()
+{
+    static const struct {
+        const char* s;
+        u32 max;
+        bool ok;
+        ipv4a lo, hi;
+    } nums[] = {
+        { "*",           0xffff, true,  0,      0xffff },
+        { "80",          0xffff, true,  80,     80 },
+        { "0x50",        0xffff, true,  80,     80 },
+        { "1024-65535",  0xffff, true,  1024,   0xffff },
+        { "0-0",         0xffff, true,  0,      0 },
+        { "65535",       0xffff, true,  0xffff, 0xffff },
+        { "65536",       0xffff, false, 0,      0 },
+        { "255",         0xff,   true,  0xff,   0xff },
+        { "256",         0xff,   false, 0,      0 },
+        { "0-256",       0xff,   false, 0,      0 },
+        { "80-79",       0xffff, false, 0,      0 },
+        { "-1",          0xffff, false, 0,      0 },
+        { "18446744073709551616", 0xffff, false, 0, 0 },
+        { "",            0xffff, false, 0,      0 },
+        { "80-",         0xffff, false, 0,      0 },
+        { "-80",         0xffff, false, 0,      0 },
+        { "80x",         0xffff, false, 0,      0 },
+        { "08",          0xffff, false, 0,      0 },
+        { "1-2-3",       0xffff, false, 0,      0 },
+        { "**",          0xffff, false, 0,      0 },
+    };
+    static const struct {
+        const char* s;
+        bool ok;
+        ipv4a lo, hi;
+    } v4[] = {
+        { "*",                         true,  0,          0xffffffff },
+        { "0.0.0.0/0",                 true,  0,          0xffffffff },
+        { "10.1.2.3/8",                true,  0x0a000000, 0x0affffff },
+        { "10.1.2.3/32",               true,  0x0a010203, 0x0a010203 },
+        { "255.255.255.255",           true,  0xffffffff, 0xffffffff },
+        { "255.255.255.255/31",        true,  0xfffffffe, 0xffffffff },
+        { "0.0.0.0",                   true,  0,          0 },
+        { "10.0.0.1-10.0.0.9",         true,  0x0a000001, 0x0a000009 },
+        { "10.0.0.9-10.0.0.1",         false, 0,          0 },
+        { "10.0.0.0/33",               false, 0,          0 },
+        { "10.0.0.0/",                 false, 0,          0 },
+        { "10.0.0.0/8/9",              false, 0,          0 },
+        { "10.0.0.0/-1",               false, 0,          0 },
+        { "10.0.0.256",                false, 0,          0 },
+        { "10.0.0",                    false, 0,          0 },
+        { "10.0.0.1-",                 false, 0,          0 },
+        { "-10.0.0.1",                 false, 0,          0 },
+        { "::1",                       false, 0,          0 },
+        { "",                          false, 0,          0 },
+    };
+    static const struct {
+        const char* s;
+        bool ok;
+        const char* lo;
+        const char* hi;
+    } v6[] = {
+        { "*", true, "0x0", "0xffffffffffffffffffffffffffffffff" },
+        { "::/0", true, "0x0", "0xffffffffffffffffffffffffffffffff" },
+        { "::", true, "0x0", "0x0" },
+        { "::1/128", true, "0x1", "0x1" },
+        { "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", true,
+          "0xffffffffffffffffffffffffffffffff",
+          "0xffffffffffffffffffffffffffffffff" },
+        { "2001:db8::1/32", true,
+          "0x20010db8000000000000000000000000",
+          "0x20010db8ffffffffffffffffffffffff" },
+        { "2001:db8::/64", true,
+          "0x20010db8000000000000000000000000",
+          "0x20010db800000000ffffffffffffffff" },
+        { "::ffff:10.0.0.0/104", true,
+          "0x00000000000000000000ffff0a000000",
+          "0x00000000000000000000ffff0affffff" },
+        { "::1-::ff", true, "0x1", "0xff" },
+        { "::ff-::1", false, "0x0", "0x0" },
+        { "::/129", false, "0x0", "0x0" },
+        { "2001:db8::/", false, "0x0", "0x0" },
+        { "2001:db8::/-1", false, "0x0", "0x0" },
+        { "2001:db8:::1", false, "0x0", "0x0" },
+        { "gggg::", false, "0x0", "0x0" },
+        { "::1-", false, "0x0", "0x0" },
+        { "10.0.0.1", false, "0x0", "0x0" },
+        { "", false, "0x0", "0x0" },
+    };
+    static const struct {
+        const char* s;
+        bool ok;
+        const char* text;
+    } ranges[] = {
+        { "10.1.2.3/8, *, 1024-65535, 0x50, 6, 63", true,
+          "10.0.0.0-10.255.255.255, 0.0.0.0-255.255.255.255, "
+          "1024-65535, 80-80, 6-6, 63-63" },
+        { " 10.0.0.1 ,\t192.168.0.0/16,*,*,*,*\r\n", true,
+          "10.0.0.1-10.0.0.1, 192.168.0.0-192.168.255.255, 0-65535, "
+          "0-65535, 0-255, 0-255" },
+        { "*, *, *, *, *, *", true,
+          "0.0.0.0-255.255.255.255, 0.0.0.0-255.255.255.255, "
+          "0-65535, 0-65535, 0-255, 0-255" },
+        { "*, *, *, *, *", false, nullptr },
+        { "*, *, *, *, *, *, *", false, nullptr },
+        { "*, *, *, *, *, *,", false, nullptr },
+        { "*, *, 65536, *, *, *", false, nullptr },
+        { "*, *, *, 80-79, *, *", false, nullptr },
+        { "*, *, *, *, 256, *", false, nullptr },
+        { "*, *, *, *, *, 0x100", false, nullptr },
+        { "*, , *, *, *, *", false, nullptr },
+        { "::1, *, *, *, *, *", false, nullptr },
+        { "", false, nullptr },
+    };
+    rtacl::ipv4a lo4, hi4;
+    rtacl::ipv6a lo6, hi6;
+    rtacl::range<rtacl::ipv4a> r4, q4;
+    rtacl::range<rtacl::ipv6a> r6, q6;
+    size_t i;
+    bool rc;
+
+    for (i = 0; i < elementsof(nums); ++i) {
+        lo4 = hi4 = 0;
+        rc = rtacl::str2numRange(nums[i].s, nums[i].max, lo4, hi4);
+        assert(rc == nums[i].ok);
+        assert(!rc || (lo4 == nums[i].lo && hi4 == nums[i].hi));
+    }
+    std::cout << bfmt("%u numerical ranges (correct)\n") % elementsof(nums);
+
+    for (i = 0; i < elementsof(v4); ++i) {
+        lo4 = hi4 = 0;
+        rc = rtacl::str2addrRange(v4[i].s, lo4, hi4);
+        assert(rc == v4[i].ok);
+        assert(!rc || (lo4 == v4[i].lo && hi4 == v4[i].hi));
+    }
+    std::cout << bfmt("%u IPv4 address ranges (correct)\n") % elementsof(v4);
+
+    for (i = 0; i < elementsof(v6); ++i) {
+        lo6 = hi6 = 0;
+        rc = rtacl::str2addrRange(v6[i].s, lo6, hi6);
+        assert(rc == v6[i].ok);
+        assert(!rc || (lo6 == rtacl::ipv6a(v6[i].lo) &&
+                       hi6 == rtacl::ipv6a(v6[i].hi)));
+    }
+    std::cout << bfmt("%u IPv6 address ranges (correct)\n") % elementsof(v6);
+
+    for (i = 0; i < elementsof(ranges); ++i) {
+        rc = rtacl::str2range(ranges[i].s, r4);
+        assert(rc == ranges[i].ok);
+        if (rc) {
+            assert(rtacl::range2str(r4) == ranges[i].text);
+            rc = rtacl::str2range(rtacl::range2str(r4), q4);
+            assert(rc && rtacl::bg::equals(r4, q4));
+        }
+    }
+    std::cout << bfmt("%u IPv4 6-tuple ranges (correct)\n")
+        % elementsof(ranges);
+
+    /*
+     * The offsets of the R-tree boxes (lo - 1, hi + 1) are applied
+     * to the boundary values too
+     */
+    rc = rtacl::str2range("::/0, ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff, "
+                          "65535, 0, 255, 0", r6);
+    assert(rc);
+    assert(r6.min_corner().get<0>() == -1);
+    assert(r6.max_corner().get<0>() == (rtacl::ipv6a(1) << 128));
+    assert(r6.min_corner().get<1>() == (rtacl::ipv6a(1) << 128) - 2);
+    assert(r6.max_corner().get<2>() == 0x10000);
+    assert(r6.min_corner().get<3>() == -1 && r6.max_corner().get<3>() == 1);
+    assert(r6.max_corner().get<4>() == 0x100);
+    rc = rtacl::str2range(rtacl::range2str(r6), q6);
+    assert(rc && rtacl::bg::equals(r6, q6));
+    rc = rtacl::str2range("10.0.0.0/8, *, *, *, *, *", r6);
+    assert(!rc);
+    rc = rtacl::str2range("::/0, *, *, *, *", r6);
+    assert(!rc);
+    std::cout << rtacl::range2str(r6) << ": IPv6 boundaries (correct)\n";
+}
 
 int
 main (int argc, char *argv[])
@@ -596,4 +2874,52 @@ main (int argc, char *argv[])
     v4sockTest();
     std::cout << "\nIPv6 sockaddr Test\n";
     v6sockTest();
+    std::cout << "\nRaw Packet Test\n";
+    pktTest();
+    std::cout << "\nIPv6 Address Conversion Test\n";
+    in6Test();
+    std::cout << "\nDual-stack Test\n";
+    dualTest();
+    std::cout << "\nLazy Search Test\n";
+    queryTest();
+    std::cout << "\nHit Counter Test\n";
+    counterTest();
+    std::cout << "\nInline Payload Test\n";
+    payloadTest();
+    std::cout << "\nNode Pool Allocator Test\n";
+    poolTest();
+    std::cout << "\nMemory Usage Test\n";
+    memTest();
+    std::cout << "\nNUMA Replica Test\n";
+    numaTest();
+    std::cout << "\nField Set Test\n";
+    dimTest();
+    std::cout << "\nPartitioned ACL Test\n";
+    partTest();
+    std::cout << "\nSize-stratified ACL Test\n";
+    tierTest();
+    std::cout << "\nRFC Engine Test\n";
+    rfcTest();
+    std::cout << "\nBit-vector Engine Test\n";
+    bvTest();
+    std::cout << "\nEpoch Reclamation Test\n";
+    epochTest();
+    std::cout << "\nAsync Update Queue Test\n";
+    asyncTest();
+    std::cout << "\nTime-bounded Rule Test\n";
+    ttlTest();
+    std::cout << "\nDeamortized Insert Test\n";
+    deferTest();
+    std::cout << "\nQuery Cost Test\n";
+    explainTest();
+    std::cout << "\nRepack Test\n";
+    repackTest();
+    std::cout << "\nRegion Query Test\n";
+    regionTest();
+    std::cout << "\nZero-copy Traversal Test\n";
+    visitTest();
+    std::cout << "\nText Export Test\n";
+    textTest();
+    std::cout << "\nText Parse Test\n";
+    parseTest();
 }